@@ -12,7 +12,24 @@ int main() {
     std::vector<std::string> e    = {};
     std::vector<std::string> file_paths = {
         "include/kecx/kecx.hpp",
-        "include/kecx/tools/extract.hpp"
+        "include/kecx/kecx.h",
+        "include/kecx/kecx_lib.hpp",
+        "include/kecx/tools/extract.hpp",
+        "include/kecx/tools/store.hpp",
+        "include/kecx/tools/input.hpp",
+        "include/kecx/tools/spill.hpp",
+        "include/kecx/tools/tar.hpp",
+        "include/kecx/tools/rx.hpp",
+        "include/kecx/tools/keyindex.hpp",
+        "include/kecx/tools/multiplex.hpp",
+        "include/kecx/tools/server.hpp",
+        "include/kecx/tools/differential.hpp",
+        "include/kecx/tools/trace.hpp",
+        "include/kecx/tools/batch.hpp",
+        "include/kecx/tools/inventory.hpp",
+        "include/kecx/tools/shard.hpp",
+        "include/kecx/tools/transform.hpp",
+        "include/kecx/tools/parallel.hpp"
     };
 
     kecx::extract::extract(
@@ -47,7 +64,10 @@ int main() {
         "./doc/make_readme.cpp",
         "./examples/example_01.cpp",
         "./examples/example_02.cpp",
-        "./examples/example_03.cpp"
+        "./examples/example_03.cpp",
+        "./examples/example_04.cpp",
+        "./examples/example_05.cpp",
+        "./examples/example_06.cpp"
     };
     kecx::extract::extract(
         more_file_paths,
@@ -1,4 +1,3 @@
-
 #include<vector>
 #include<string>
 
@@ -7,16 +6,16 @@
 int main() {
     // @doc README.md
     // - `./examples/example_02.cpp`: Extract doxygen comments in
-    //   `./examples/data/input_02.cpp` into separate text files --- though
-    //   some clean-up work remains. Also, multiple function definitions
-    //   in the same file would currently be a problem as arguments with
-    //   the same name would be inserted into the same output file.
+    //   `./examples/data/input_02.cpp` into separate text files, with the
+    //   ` * ` gutter removed by a `kecx::transform::Pipeline`. Multiple
+    //   function definitions in the same file would currently be a problem
+    //   as arguments with the same name would be inserted into the same
+    //   output file.
     std::vector<std::string> ho   = {"@"};
     std::vector<std::string> hf_h = {};
     std::vector<std::string> hf_f = {};
     std::vector<std::string> e    = {};
-    kecx::extract::extract(
-        "./examples/data/input_02.cpp",
+    kecx::extract::Extractor extractor(
         "[/][*]",
         "[*][/]",
         "//",
@@ -24,11 +23,17 @@ int main() {
         hf_h,
         hf_f,
         e,
-        "./output/",
         true,
         false,
         false,
         0
     );
+    extractor.set_transforms(kecx::transform::Pipeline()
+        .then(kecx::transform::strip_gutter())
+        .then(kecx::transform::dedent()));
+    extractor.extract(
+        std::string("./examples/data/input_02.cpp"),
+        kecx::store::store_to_txt_factory("./output/")
+    );
     return(0);
 }
@@ -0,0 +1,33 @@
+#include<vector>
+#include<string>
+#include<iostream>
+
+#include "./include/kecx/kecx.hpp"
+
+int main() {
+    // @doc README.md
+    // - `./examples/example_04.cpp`: Check that the fast extraction engine
+    //   gives exactly the same results as the reference engine on random
+    //   corpora, and compare their speed.
+    kecx::extract::Settings settings;
+    settings.multiline_comment_start = "[/][*]";
+    settings.multiline_comment_stop = "[*][/]";
+    settings.singleline_comment = "//";
+    settings.header_only_tag_set = {"@chunk"};
+    settings.header_tag_set = {"@start"};
+    settings.footer_tag_set = {"@stop"};
+    settings.either_tag_set = {"@block"};
+
+    kecx::differential::Report report = kecx::differential::run(
+        settings,
+        1,
+        100,
+        1000
+    );
+    std::cout << kecx::differential::describe(report);
+    if (report.diverged) {
+        std::cout << "corpus:\n" << report.corpus << std::endl;
+        return(1);
+    }
+    return(0);
+}
@@ -0,0 +1,48 @@
+#include<vector>
+#include<string>
+#include<iostream>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "./include/kecx/kecx.hpp"
+
+int main() {
+    // @doc README.md
+    // - `./examples/example_05.cpp`: Start an extraction server in a child
+    //   process, extract `./examples/data/input_01.cpp` through it twice
+    //   (the second time from the server's cache) and stop the server.
+    std::string socket_path = "./kecx_example_05.sock";
+    kecx::extract::Settings settings;
+    settings.multiline_comment_start = "[/][*]";
+    settings.multiline_comment_stop = "[*][/]";
+    settings.singleline_comment = "//";
+    settings.header_only_tag_set = {"@chunk"};
+    settings.header_tag_set = {"@start"};
+    settings.footer_tag_set = {"@stop"};
+    settings.either_tag_set = {"@block"};
+
+    kecx::server::Server server(socket_path);
+    pid_t pid = fork();
+    if (pid == 0) {
+        server.serve();
+        return(0);
+    }
+
+    kecx::server::Client client(socket_path);
+    client.extract(
+        settings,
+        {"./examples/data/input_01.cpp"},
+        kecx::store::store_to_txt_factory("./output/")
+    );
+    client.extract(
+        settings,
+        {"./examples/data/input_01.cpp"},
+        [](const std::string&, const std::string&, const int&) -> void {}
+    );
+    std::cout << "files answered from the cache: " << client.cache_hits()
+        << std::endl;
+    client.shutdown();
+    waitpid(pid, nullptr, 0);
+    return(0);
+}
@@ -0,0 +1,71 @@
+#include<vector>
+#include<string>
+#include<sstream>
+#include<iostream>
+
+// must be defined in exactly one translation unit, before including kecx
+#define KECX_COUNT_ALLOCATIONS
+#include "./include/kecx/kecx.hpp"
+
+int main() {
+    // @doc README.md
+    // - `./examples/example_06.cpp`: Count heap allocations with
+    //   `KECX_COUNT_ALLOCATIONS` and check that the line loop makes none per
+    //   line, i.e. that the count does not grow with the number of lines
+    //   extracted. Exits with `1` otherwise.
+    kecx::extract::Settings settings;
+    settings.multiline_comment_start = "[/][*]";
+    settings.multiline_comment_stop = "[*][/]";
+    settings.singleline_comment = "//";
+    settings.header_only_tag_set = {"@chunk"};
+    settings.header_tag_set = {"@start"};
+    settings.footer_tag_set = {"@stop"};
+    settings.either_tag_set = {"@block"};
+    kecx::extract::Extractor extractor(settings);
+
+    const std::string block =
+        "// @start key_a\n"
+        "// a comment line of key_a\n"
+        "int x = 1;\n"
+        "// @stop key_a\n"
+        "/*\n"
+        "@block key_b\n"
+        "a comment line of key_b\n"
+        "@block key_b\n"
+        "*/\n"
+        "// @chunk key_c\n"
+        "// a comment line of key_c\n"
+        "\n";
+    // the buffers of the line loop grow up to the chunk size of about 1 MiB
+    // while warming up, so every input spans several chunks
+    unsigned long long first = 0;
+    for (const int& n_blocks : {10000, 40000, 160000}) {
+        std::string input;
+        for (int i = 0; i < n_blocks; ++i) {
+            input += block;
+        }
+        std::istringstream stream(input);
+        unsigned long long stored = 0;
+        kecx::extract::Stats stats;
+        extractor.extract(
+            stream,
+            [&stored](const std::string&, const std::string&, const int&) -> void {
+                stored += 1;
+            },
+            stats
+        );
+        if (!stats.allocations_counted) {
+            std::cout << "allocations are not counted" << std::endl;
+            return(1);
+        }
+        std::cout << stats.lines << " lines, " << stored << " stored, "
+            << stats.line_loop_allocations << " allocations" << std::endl;
+        if (first == 0) {
+            first = stats.line_loop_allocations;
+        } else if (stats.line_loop_allocations > first) {
+            std::cout << "the allocations grow with the input" << std::endl;
+            return(1);
+        }
+    }
+    return(0);
+}
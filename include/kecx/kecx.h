@@ -0,0 +1,169 @@
+#ifndef kecx_H
+#define kecx_H
+
+#include <stddef.h>
+
+/*
+@docstart README.md
+
+## C interface
+
+`./include/kecx/kecx.h` exposes the extractor to C and to anything that can
+call C (Python's `ctypes`/`cffi`, Rust's FFI, ...) through a shared library,
+so that other runtimes can embed kecx instead of running a driver
+programme and reading `./output/` back. Build it with
+
+```
+g++ -std=c++17 -O2 -shared -fPIC -I./ src/kecx_c.cpp -o libkecx.so
+```
+
+(add `-DKECX_WITH_ZLIB` and `-lz` for gzip input, see "Compressed input"). A
+`kecx_config` is created with `kecx_config_new`, given its comment markers
+and tags, and run on files or in-memory buffers; results arrive through a
+callback in batches of `kecx_record`s, each a `(key, line, line_no)` view
+that is valid during the call. Functions return `KECX_OK` or an error code,
+with a description in `kecx_last_error()`.
+
+@docstop README.md
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief
+ * Version of this interface; changes only when existing declarations do.
+*/
+#define KECX_ABI_VERSION 1
+
+/* return codes */
+#define KECX_OK 0
+/* invalid argument, e.g. an invalid regex or an inaccessible file */
+#define KECX_ERROR_ARGUMENT 1
+/* a header tag for an already open block, or a footer without header */
+#define KECX_ERROR_KEY 2
+/* header-footer blocks still open at the end of the input */
+#define KECX_ERROR_UNCLOSED_BLOCK 3
+/* anything else, e.g. corrupt compressed input */
+#define KECX_ERROR 4
+
+/* tag kinds, see `kecx::extract::Settings` */
+#define KECX_TAG_HEADER_ONLY 0
+#define KECX_TAG_HEADER 1
+#define KECX_TAG_FOOTER 2
+#define KECX_TAG_EITHER 3
+
+/**
+ * @brief
+ * One extracted line. The strings are not NUL-terminated and only valid
+ * during the callback they are passed to.
+*/
+typedef struct {
+    const char* key;
+    size_t key_size;
+    const char* line;
+    size_t line_size;
+    int line_no;
+} kecx_record;
+
+/**
+ * @brief
+ * Receives `n_records` records, in order; called any number of times per
+ * extraction.
+*/
+typedef void (*kecx_callback)(
+    void* user_data,
+    const kecx_record* records,
+    size_t n_records
+);
+
+typedef struct kecx_config kecx_config;
+
+/**
+ * @brief
+ * Version of the library, to compare with `KECX_ABI_VERSION`.
+*/
+int kecx_abi_version(void);
+
+/**
+ * @brief
+ * Description of the last error of the calling thread; empty if none.
+*/
+const char* kecx_last_error(void);
+
+/**
+ * @brief
+ * A configuration without comment markers or tags; `NULL` if out of
+ * memory. Free it with `kecx_config_free`.
+*/
+kecx_config* kecx_config_new(void);
+
+void kecx_config_free(kecx_config* config);
+
+/**
+ * @brief
+ * Set the comment marker regexes; `NULL` or `""` disables a marker.
+*/
+int kecx_config_set_comments(
+    kecx_config* config,
+    const char* multiline_comment_start,
+    const char* multiline_comment_stop,
+    const char* singleline_comment
+);
+
+/**
+ * @brief
+ * Add tag regex `tag` of kind `kind` (one of the `KECX_TAG_` values).
+*/
+int kecx_config_add_tag(kecx_config* config, int kind, const char* tag);
+
+/**
+ * @brief
+ * Whether only comment lines are stored for blocks of tag kind `kind`
+ * (`KECX_TAG_HEADER` and `KECX_TAG_FOOTER` both mean header-footer
+ * blocks). Defaults: header-only 1, header-footer 0, either 0.
+*/
+int kecx_config_set_store_only_comments(
+    kecx_config* config,
+    int kind,
+    int store_only_comments
+);
+
+/**
+ * @brief
+ * Compile the configuration. Optional: extraction compiles it when
+ * needed, but a configuration shared by threads should be compiled
+ * before and not changed after.
+*/
+int kecx_config_compile(kecx_config* config);
+
+/**
+ * @brief
+ * Extract from the file at `file_path`. Records found before an error
+ * are still passed to `callback`.
+*/
+int kecx_extract_file(
+    kecx_config* config,
+    const char* file_path,
+    kecx_callback callback,
+    void* user_data
+);
+
+/**
+ * @brief
+ * Extract from `data[0, size)`.
+*/
+int kecx_extract_buffer(
+    kecx_config* config,
+    const char* data,
+    size_t size,
+    kecx_callback callback,
+    void* user_data
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
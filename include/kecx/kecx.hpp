@@ -3,6 +3,20 @@
 
 #include "./tools/store.hpp"
 #include "./tools/extract.hpp"
+#include "./tools/input.hpp"
+#include "./tools/spill.hpp"
+#include "./tools/tar.hpp"
+#include "./tools/rx.hpp"
+#include "./tools/keyindex.hpp"
+#include "./tools/multiplex.hpp"
+#include "./tools/server.hpp"
+#include "./tools/differential.hpp"
+#include "./tools/trace.hpp"
+#include "./tools/batch.hpp"
+#include "./tools/inventory.hpp"
+#include "./tools/shard.hpp"
+#include "./tools/transform.hpp"
+#include "./tools/parallel.hpp"
 
 /*
 @doc README.md
@@ -35,6 +49,20 @@ you can use this line in `my_file.hpp`:
 namespace kecx {
     namespace store = store;
     namespace extract = extract;
+    namespace input = input;
+    namespace spill = spill;
+    namespace tar = tar;
+    namespace rx = rx;
+    namespace keyindex = keyindex;
+    namespace multiplex = multiplex;
+    namespace server = server;
+    namespace differential = differential;
+    namespace trace = trace;
+    namespace batch = batch;
+    namespace inventory = inventory;
+    namespace shard = shard;
+    namespace transform = transform;
+    namespace parallel = parallel;
 }
 
 #endif
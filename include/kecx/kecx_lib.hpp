@@ -0,0 +1,185 @@
+#ifndef kecx_LIB_HPP
+#define kecx_LIB_HPP
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+#include <memory>
+#include <atomic>
+
+#include "./tools/settings.hpp"
+#include "./tools/store.hpp"
+#include "./tools/transform.hpp"
+
+/*
+@docstart README.md
+
+## Compiled library
+
+`kecx.hpp` compiles the whole engine (and `<regex>`) in every translation
+unit that includes it. Projects including kecx in many files can instead
+build the engine once, with full optimisation, as a library
+
+```
+g++ -std=c++17 -O2 -flto -c -I./ src/kecx.cpp -o kecx.o
+ar rcs libkecx.a kecx.o
+```
+
+(or `g++ -std=c++17 -O2 -flto -shared -fPIC -I./ src/kecx.cpp -o libkecx.so`,
+and `-DKECX_WITH_ZLIB`/`-DKECX_WITH_ZSTD` as in "Compressed input"), and
+include only `./include/kecx/kecx_lib.hpp`. It declares
+`kecx::extract::CompiledExtractor`, which takes the same
+`kecx::extract::Settings` and setters as `kecx::extract::Extractor` and
+extracts into a `kecx::store::store_type` or a `kecx::store::BlockStore`:
+
+```
+#include "./kecx/include/kecx/kecx_lib.hpp"
+
+kecx::extract::CompiledExtractor extractor(settings);
+extractor.extract(file_paths, kecx::store::store_to_txt_factory("./output/"));
+```
+
+Link with `libkecx.a` (and `-flto` again to inline across the boundary).
+Translation units that do include `kecx.hpp` and call `Extractor::extract`
+with a `store_type` can define `KECX_EXTERN_TEMPLATES` before including it
+to use the instantiations in the library instead of compiling their own.
+
+@docstop README.md
+*/
+
+namespace extract {
+    class Extractor;
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * An `Extractor` compiled into `src/kecx.cpp`, so that including this
+     * header does not compile the engine. Stores are passed as
+     * `store::store_type`; use `Extractor` from `kecx.hpp` to have a
+     * concrete store inlined into the line loop.
+    */
+    class CompiledExtractor {
+        private:
+            std::unique_ptr<Extractor> extractor_;
+
+        public:
+            /**
+             * @brief
+             * Compile `settings`, see `Extractor::Extractor`.
+            */
+            CompiledExtractor(const Settings& settings);
+            CompiledExtractor(CompiledExtractor&& other) noexcept;
+            CompiledExtractor& operator=(CompiledExtractor&& other) noexcept;
+            ~CompiledExtractor();
+
+            const Settings& settings() const;
+
+            /**
+             * @brief
+             * See `Extractor::set_engine`.
+            */
+            void set_engine(const Engine& engine);
+
+            /**
+             * @brief
+             * See `Extractor::set_prefilter`.
+            */
+            void set_prefilter(const bool& prefilter);
+
+            /**
+             * @brief
+             * See `Extractor::set_key_filter`.
+            */
+            void set_key_filter(const KeyFilter& key_filter);
+
+            /**
+             * @brief
+             * See `Extractor::set_stop`.
+            */
+            void set_stop(const std::atomic<bool>* stop);
+
+            /**
+             * @brief
+             * See `Extractor::set_max_line_length`.
+            */
+            void set_max_line_length(const std::size_t& max_line_length);
+
+            /**
+             * @brief
+             * See `Extractor::set_skip_binary`.
+            */
+            void set_skip_binary(const bool& skip_binary);
+
+            /**
+             * @brief
+             * See `Extractor::set_transforms`.
+            */
+            void set_transforms(const transform::Pipeline& transforms);
+
+            /**
+             * @brief
+             * The underlying `Extractor`, for translation units that also
+             * include `kecx.hpp`.
+            */
+            const Extractor& extractor() const;
+
+            /**
+             * @brief
+             * See the `Extractor::extract` overloads of the same arguments.
+            */
+            void extract(
+                const std::string& file_path,
+                const store::store_type& store,
+                Stats& stats
+            ) const;
+            void extract(
+                const std::string& file_path,
+                const store::store_type& store
+            ) const;
+            void extract(
+                const std::vector<std::string>& file_paths,
+                const store::store_type& store,
+                Stats& stats
+            ) const;
+            void extract(
+                const std::vector<std::string>& file_paths,
+                const store::store_type& store
+            ) const;
+            void extract(
+                std::istream& input,
+                const store::store_type& store,
+                Stats& stats
+            ) const;
+            void extract_buffer(
+                const char* data,
+                const std::size_t& n,
+                const store::store_type& store,
+                Stats& stats
+            ) const;
+            void extract(
+                const std::string& file_path,
+                store::BlockStore& blocks,
+                Stats& stats
+            ) const;
+            void extract(
+                std::istream& input,
+                store::BlockStore& blocks,
+                Stats& stats,
+                const std::string& file = ""
+            ) const;
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace extract
+
+namespace kecx {
+    namespace store = store;
+    namespace extract = extract;
+    namespace transform = transform;
+}
+
+#endif
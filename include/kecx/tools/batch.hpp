@@ -0,0 +1,564 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "trace.hpp"
+
+namespace batch {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Reading many small files
+    //
+    // For trees of many small files the system calls per file, not the
+    // parsing, set the pace. The multi-file `kecx::extract::extract` (and
+    // `Extractor::extract(file_paths, ...)`) therefore read their inputs
+    // through a `kecx::batch::Reader`, which keeps up to `queue_depth`
+    // files in flight: their opens, `statx` calls and reads are submitted
+    // together through Linux's io_uring and reaped as they complete, while
+    // the extractor works on the files that are already in memory. Each
+    // `statx` is made on the opened file, so a file replaced or grown
+    // meanwhile is read as it was when it was opened, never cut short. Files
+    // come out in the order of `file_paths`, so the output does not change.
+    //
+    // Where io_uring is not available (old kernels, seccomp filters) each
+    // file is read with `open`, `fstat` and `pread` instead. Files larger
+    // than `max_file_size`, other than regular files, and files that cannot
+    // be opened are left to the usual per-file path (mapped, decompressed,
+    // or reported with the usual exception).
+    //
+    // @docstop README.md
+
+    /**
+     * @brief
+     * Default number of files a `Reader` keeps in flight.
+    */
+    const std::size_t default_queue_depth = 64;
+
+    /**
+     * @brief
+     * Default size above which a `Reader` leaves a file to the caller;
+     * large files are better mapped than copied.
+    */
+    const std::size_t default_max_file_size = std::size_t(1) << 20;
+
+    /**
+     * @brief
+     * One input of a `Reader`.
+    */
+    struct File {
+        // position in the `file_paths` of the reader
+        std::size_t index = 0;
+        // `true` if `data` holds the whole file; else the caller has to
+        // read it itself (see `Reader`)
+        bool loaded = false;
+        std::vector<char> data;
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Minimal io_uring submission and completion rings, driven through the
+     * raw system calls. `ok()` is `false` if the kernel does not provide
+     * io_uring or lacks the operations used here.
+    */
+    class Ring {
+        private:
+            int fd = -1;
+            void* sq_ring = MAP_FAILED;
+            std::size_t sq_ring_size = 0;
+            void* cq_ring = MAP_FAILED;
+            std::size_t cq_ring_size = 0;
+            io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+            std::size_t sqes_size = 0;
+
+            unsigned* sq_head = nullptr;
+            unsigned* sq_tail = nullptr;
+            unsigned sq_mask = 0;
+            unsigned sq_entries = 0;
+            unsigned* sq_array = nullptr;
+            unsigned* cq_head = nullptr;
+            unsigned* cq_tail = nullptr;
+            unsigned cq_mask = 0;
+            io_uring_cqe* cqes = nullptr;
+
+            // prepared but not yet submitted; the kernel sees them when
+            // `sq_tail` is set to `tail` by `enter`
+            unsigned to_submit = 0;
+            unsigned tail = 0;
+
+            static unsigned* at(void* ring, const uint32_t& offset) {
+                return(reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset));
+            }
+
+            void release() {
+                if (sqes != MAP_FAILED) {
+                    ::munmap(sqes, sqes_size);
+                }
+                if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+                    ::munmap(cq_ring, cq_ring_size);
+                }
+                if (sq_ring != MAP_FAILED) {
+                    ::munmap(sq_ring, sq_ring_size);
+                }
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                fd = -1;
+            }
+
+        public:
+            Ring(const unsigned& entries) {
+                io_uring_params params;
+                std::memset(&params, 0, sizeof(params));
+                fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+                if (fd < 0) {
+                    return;
+                }
+                // IORING_OP_OPENAT, _STATX, _READ and _CLOSE came with 5.6,
+                // as did IORING_FEAT_RW_CUR_POS
+                const uint32_t required = IORING_FEAT_SINGLE_MMAP |
+                    IORING_FEAT_NODROP |
+                    IORING_FEAT_RW_CUR_POS;
+                if ((params.features & required) != required) {
+                    release();
+                    return;
+                }
+                sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                sq_ring_size = std::max(sq_ring_size, cq_ring_size);
+                sq_ring = ::mmap(
+                    nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING
+                );
+                cq_ring = sq_ring;
+                sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+                sqes = static_cast<io_uring_sqe*>(::mmap(
+                    nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES
+                ));
+                if (sq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+                    release();
+                    return;
+                }
+                sq_head = at(sq_ring, params.sq_off.head);
+                sq_tail = at(sq_ring, params.sq_off.tail);
+                sq_mask = *at(sq_ring, params.sq_off.ring_mask);
+                sq_entries = *at(sq_ring, params.sq_off.ring_entries);
+                sq_array = at(sq_ring, params.sq_off.array);
+                cq_head = at(cq_ring, params.cq_off.head);
+                cq_tail = at(cq_ring, params.cq_off.tail);
+                cq_mask = *at(cq_ring, params.cq_off.ring_mask);
+                cqes = reinterpret_cast<io_uring_cqe*>(
+                    static_cast<char*>(cq_ring) + params.cq_off.cqes
+                );
+                tail = *sq_tail;
+            }
+
+            Ring(const Ring&) = delete;
+            Ring& operator=(const Ring&) = delete;
+
+            ~Ring() {
+                release();
+            }
+
+            bool ok() const {
+                return(fd >= 0);
+            }
+
+            /**
+             * @brief
+             * A cleared submission queue entry, submitted with the next
+             * `enter`; submits the prepared ones first if the queue is full.
+            */
+            io_uring_sqe* prepare() {
+                if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+                    enter(0);
+                }
+                unsigned index = tail & sq_mask;
+                io_uring_sqe* sqe = &sqes[index];
+                std::memset(sqe, 0, sizeof(*sqe));
+                sq_array[index] = index;
+                tail += 1;
+                to_submit += 1;
+                return(sqe);
+            }
+
+            /**
+             * @brief
+             * Submit the prepared entries and wait for at least
+             * `min_complete` completions.
+            */
+            void enter(const unsigned& min_complete) {
+                if (to_submit == 0 && min_complete == 0) {
+                    return;
+                }
+                __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+                while (true) {
+                    long submitted = ::syscall(
+                        __NR_io_uring_enter, fd, to_submit, min_complete,
+                        min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0
+                    );
+                    if (submitted >= 0) {
+                        to_submit -= static_cast<unsigned>(submitted);
+                        if (to_submit == 0 || min_complete > 0) {
+                            return;
+                        }
+                    } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                        throw std::runtime_error(
+                            std::string("kecx: io_uring_enter failed: ") + std::strerror(errno)
+                        );
+                    }
+                }
+            }
+
+            /**
+             * @brief
+             * Pass each available completion to `f(user_data, res)`.
+            */
+            template<typename F>
+            void reap(const F& f) {
+                unsigned head = *cq_head;
+                unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+                while (head != tail) {
+                    const io_uring_cqe& cqe = cqes[head & cq_mask];
+                    uint64_t user_data = cqe.user_data;
+                    int32_t res = cqe.res;
+                    head += 1;
+                    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+                    f(user_data, res);
+                    tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+                }
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Reads the files at `file_paths` ahead of their use, through io_uring
+     * if available, else with `pread`; see "Reading many small files".
+     * `file_paths` must outlive the reader.
+    */
+    class Reader {
+        private:
+            enum Op : uint64_t {
+                op_open = 0,
+                op_statx = 1,
+                op_read = 2,
+                op_close = 3
+            };
+
+            struct Slot {
+                File file;
+                struct statx stx;
+                int fd = -1;
+                std::size_t size = 0;
+                std::size_t read = 0;
+                bool done = false;
+            };
+
+            const std::vector<std::string>& file_paths;
+            std::size_t queue_depth;
+            std::size_t max_file_size;
+            trace::Recorder* recorder;
+            std::unique_ptr<Ring> ring;
+            // file `i` is in slot `i % queue_depth` while in flight
+            std::vector<Slot> slots;
+            // next file to return and next file to start
+            std::size_t next_index = 0;
+            std::size_t started = 0;
+            // submitted operations without completion
+            std::size_t in_flight = 0;
+
+            /**
+             * @brief
+             * Whether a file of this type and size is read here.
+            */
+            bool wanted(const bool& regular, const std::size_t& size) const {
+                return(regular && size <= max_file_size);
+            }
+
+            void close_fd(Slot& slot) {
+                if (slot.fd < 0) {
+                    return;
+                }
+                if (ring) {
+                    io_uring_sqe* sqe = ring->prepare();
+                    sqe->opcode = IORING_OP_CLOSE;
+                    sqe->fd = slot.fd;
+                    sqe->user_data = op_close;
+                    in_flight += 1;
+                } else {
+                    ::close(slot.fd);
+                }
+                slot.fd = -1;
+            }
+
+            void finish(Slot& slot, const bool& loaded) {
+                close_fd(slot);
+                slot.file.loaded = loaded;
+                if (!loaded) {
+                    slot.file.data = std::vector<char>();
+                }
+                slot.done = true;
+            }
+
+            void submit(Slot& slot, const uint8_t& opcode, const uint64_t& op) {
+                io_uring_sqe* sqe = ring->prepare();
+                sqe->opcode = opcode;
+                sqe->user_data = (static_cast<uint64_t>(slot.file.index) << 2) | op;
+                const char* path = file_paths[slot.file.index].c_str();
+                if (op == op_open) {
+                    sqe->fd = AT_FDCWD;
+                    sqe->addr = reinterpret_cast<uint64_t>(path);
+                    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+                } else if (op == op_statx) {
+                    // the opened file, not `path`, which may have been
+                    // replaced since
+                    sqe->fd = slot.fd;
+                    sqe->addr = reinterpret_cast<uint64_t>("");
+                    sqe->statx_flags = AT_EMPTY_PATH;
+                    sqe->len = STATX_TYPE | STATX_SIZE;
+                    sqe->off = reinterpret_cast<uint64_t>(&slot.stx);
+                } else {
+                    sqe->fd = slot.fd;
+                    sqe->addr = reinterpret_cast<uint64_t>(slot.file.data.data() + slot.read);
+                    sqe->len = static_cast<uint32_t>(slot.size - slot.read);
+                    sqe->off = slot.read;
+                }
+                in_flight += 1;
+            }
+
+            void complete(const uint64_t& user_data, const int32_t& res) {
+                in_flight -= 1;
+                uint64_t op = user_data & 3;
+                if (op == op_close) {
+                    return;
+                }
+                Slot& slot = slots[(user_data >> 2) % queue_depth];
+                if (op == op_open) {
+                    if (res < 0) {
+                        finish(slot, false);
+                    } else {
+                        slot.fd = res;
+                        submit(slot, IORING_OP_STATX, op_statx);
+                    }
+                    return;
+                }
+                if (op == op_statx) {
+                    if (res < 0) {
+                        finish(slot, false);
+                        return;
+                    }
+                    slot.size = static_cast<std::size_t>(slot.stx.stx_size);
+                    if (!wanted(S_ISREG(slot.stx.stx_mode), slot.size)) {
+                        finish(slot, false);
+                    } else if (slot.size == 0) {
+                        finish(slot, true);
+                    } else {
+                        slot.file.data.resize(slot.size);
+                        submit(slot, IORING_OP_READ, op_read);
+                    }
+                    return;
+                }
+                if (res < 0) {
+                    finish(slot, false);
+                } else if (res == 0 || slot.read + res == slot.size) {
+                    // a file that shrank since `statx` is taken as it is now
+                    slot.read += static_cast<std::size_t>(res);
+                    slot.file.data.resize(slot.read);
+                    finish(slot, true);
+                } else {
+                    slot.read += static_cast<std::size_t>(res);
+                    submit(slot, IORING_OP_READ, op_read);
+                }
+            }
+
+            /**
+             * @brief
+             * Read file `slot.file.index` without io_uring.
+            */
+            void read_now(Slot& slot) {
+                slot.fd = ::open(file_paths[slot.file.index].c_str(), O_RDONLY | O_CLOEXEC);
+                struct stat st;
+                if (slot.fd < 0 || ::fstat(slot.fd, &st) != 0 ||
+                        !wanted(S_ISREG(st.st_mode), static_cast<std::size_t>(st.st_size))) {
+                    finish(slot, false);
+                    return;
+                }
+                slot.file.data.resize(static_cast<std::size_t>(st.st_size));
+                std::size_t read = 0;
+                while (read < slot.file.data.size()) {
+                    ssize_t n = ::pread(
+                        slot.fd, slot.file.data.data() + read,
+                        slot.file.data.size() - read, static_cast<off_t>(read)
+                    );
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n < 0) {
+                        finish(slot, false);
+                        return;
+                    }
+                    if (n == 0) {
+                        break;
+                    }
+                    read += static_cast<std::size_t>(n);
+                }
+                slot.file.data.resize(read);
+                finish(slot, true);
+            }
+
+            /**
+             * @brief
+             * Start files until `queue_depth` of them are in flight.
+            */
+            void fill() {
+                while (started < file_paths.size() && started < next_index + queue_depth) {
+                    Slot& slot = slots[started % queue_depth];
+                    slot = Slot();
+                    slot.file.index = started;
+                    started += 1;
+                    if (ring) {
+                        submit(slot, IORING_OP_OPENAT, op_open);
+                    } else {
+                        read_now(slot);
+                    }
+                }
+            }
+
+        public:
+            /**
+             * @brief
+             * @param file_paths
+             * Files to read, in the order they are returned by `next`.
+             * @param queue_depth
+             * Number of files read ahead; also bounds the memory held.
+             * @param max_file_size
+             * Larger files are not read here, see `File::loaded`.
+             * @param use_io_uring
+             * If `false`, the `pread` fallback is used.
+             * @param recorder
+             * If not `nullptr`, waits for completions are recorded as
+             * trace spans.
+            */
+            Reader(
+                const std::vector<std::string>& file_paths,
+                const std::size_t& queue_depth = default_queue_depth,
+                const std::size_t& max_file_size = default_max_file_size,
+                const bool& use_io_uring = true,
+                trace::Recorder* recorder = nullptr
+            ) :
+                file_paths(file_paths),
+                queue_depth(std::max<std::size_t>(queue_depth, 1)),
+                max_file_size(std::min<std::size_t>(max_file_size, UINT32_MAX)),
+                recorder(recorder),
+                slots(this->queue_depth)
+            {
+                if (use_io_uring && file_paths.size() > 1) {
+                    // per file at most one operation plus a close
+                    ring.reset(new Ring(static_cast<unsigned>(4 * this->queue_depth)));
+                    if (!ring->ok()) {
+                        ring.reset();
+                    }
+                }
+            }
+
+            Reader(const Reader&) = delete;
+            Reader& operator=(const Reader&) = delete;
+
+            ~Reader() {
+                if (ring) {
+                    // the kernel may still write into the slots, e.g. if
+                    // the caller stopped early because of an exception
+                    try {
+                        while (in_flight > 0) {
+                            ring->enter(1);
+                            ring->reap([this](const uint64_t& user_data, const int32_t& res) {
+                                in_flight -= 1;
+                                if ((user_data & 3) == op_open && res >= 0) {
+                                    ::close(res);
+                                }
+                            });
+                        }
+                    } catch (...) {
+                        // the operations cannot be waited for: keep the ring
+                        // and the buffers they write to alive
+                        ring.release();
+                        new std::vector<Slot>(std::move(slots));
+                    }
+                }
+                for (Slot& slot : slots) {
+                    if (slot.fd >= 0) {
+                        ::close(slot.fd);
+                    }
+                }
+            }
+
+            /**
+             * @brief
+             * Whether the files are read through io_uring.
+            */
+            bool uses_io_uring() const {
+                return(ring != nullptr);
+            }
+
+            /**
+             * @brief
+             * The next file, in the order of `file_paths`; `false` after
+             * the last one.
+            */
+            bool next(File& file) {
+                if (next_index >= file_paths.size()) {
+                    return(false);
+                }
+                fill();
+                Slot& slot = slots[next_index % queue_depth];
+                if (!slot.done) {
+                    trace::Span span(recorder, "wait", "input", file_paths[next_index]);
+                    while (!slot.done) {
+                        ring->enter(1);
+                        ring->reap([this](const uint64_t& user_data, const int32_t& res) {
+                            complete(user_data, res);
+                        });
+                    }
+                }
+                std::swap(file, slot.file);
+                next_index += 1;
+                fill();
+                if (ring) {
+                    // start the reads of files that completed their opens
+                    // while the caller works on `file`
+                    ring->enter(0);
+                }
+                return(true);
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace batch
+
+#endif
@@ -0,0 +1,376 @@
+#ifndef DIFFERENTIAL_HPP
+#define DIFFERENTIAL_HPP
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <random>
+#include <chrono>
+#include <set>
+#include <iterator>
+#include <algorithm>
+
+#include "keysets.hpp"
+#include "scan.hpp"
+#include "extractor.hpp"
+
+namespace differential {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Differential testing of engines
+    //
+    // `kecx::extract::Extractor` can run either the default `fast` engine or
+    // the original `reference` engine (`std::getline` plus `std::regex` for
+    // everything). `kecx::differential::run` feeds randomly generated corpora
+    // built from the configured comment markers and tags through both engines
+    // and compares the full `(key, line, line_no)` streams, including any
+    // exception thrown at the end. It reports the first divergence and the
+    // throughput of both engines, so any new fast path can be checked
+    // against the reference semantics before it is switched on.
+    //
+    // @docstop README.md
+
+    struct Record {
+        std::string key;
+        std::string line;
+        int line_no;
+
+        bool operator==(const Record& other) const {
+            return(key == other.key && line == other.line && line_no == other.line_no);
+        }
+        bool operator!=(const Record& other) const {
+            return(!(*this == other));
+        }
+    };
+
+    /**
+     * @brief
+     * Everything an engine produced for one input: the records, the name of
+     * the exception it ended with (empty if none) and the time it took.
+    */
+    struct Outcome {
+        std::vector<Record> records;
+        std::string error;
+        double seconds = 0.0;
+    };
+
+    /**
+     * @brief
+     * Summary of `run`. If `diverged`, `corpus` is the first corpus on which
+     * the engines disagreed, `record_index` the position of the first
+     * differing record and `reference` / `fast` describe what each engine
+     * produced there.
+    */
+    struct Report {
+        unsigned long long corpora = 0;
+        unsigned long long bytes = 0;
+        unsigned long long records = 0;
+        double reference_seconds = 0.0;
+        double fast_seconds = 0.0;
+        bool diverged = false;
+        std::string corpus;
+        std::size_t record_index = 0;
+        std::string reference;
+        std::string fast;
+
+        /**
+         * @brief
+         * How many times faster the fast engine was than the reference.
+        */
+        double speedup() const {
+            return(fast_seconds > 0.0 ? reference_seconds / fast_seconds : 0.0);
+        }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Run `extractor` on `input` and collect what it produces.
+    */
+    inline Outcome run_engine(
+        const extract::Extractor& extractor,
+        const std::string& input
+    ) {
+        Outcome outcome;
+        std::istringstream input_stream(input);
+        auto t0 = std::chrono::steady_clock::now();
+        try {
+            extractor.extract(
+                input_stream,
+                [&outcome](
+                    const std::string& key,
+                    const std::string& line,
+                    const int& line_no
+                ) -> void
+                {
+                    outcome.records.push_back(Record{key, line, line_no});
+                }
+            );
+        } catch (const keysets::KeyAlreadyActiveException&) {
+            outcome.error = "KeyAlreadyActiveException";
+        } catch (const keysets::KeyNotActiveException&) {
+            outcome.error = "KeyNotActiveException";
+        } catch (const keysets::KeySetNotEmptyException&) {
+            outcome.error = "KeySetNotEmptyException";
+        } catch (const std::exception& e) {
+            outcome.error = std::string("std::exception: ") + e.what();
+        }
+        outcome.seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - t0
+        ).count();
+        return(outcome);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * A string likely to be matched by regex `re`: its literal if it has
+     * one, else its characters without regex syntax (e.g. `"#"` for
+     * `"[#]+"`, `"@doc"` for `"@(doc)"`). May be empty.
+    */
+    inline std::string sample_of(const std::string& re) {
+        std::string sample;
+        if (scan::regex_to_literal(re, sample)) {
+            return(sample);
+        }
+        const std::string meta = "^$.*+?()[]{}|";
+        for (std::size_t i = 0; i < re.size(); ++i) {
+            if (re[i] == '\\' && i + 1 < re.size()) {
+                i += 1;
+                if (std::ispunct(static_cast<unsigned char>(re[i]))) {
+                    sample += re[i];
+                }
+            } else if (meta.find(re[i]) == std::string::npos) {
+                sample += re[i];
+            }
+        }
+        return(sample);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Random text of `n_lines` lines made of code, the comment
+     * markers and tags of `settings` (or samples of them, see `sample_of`),
+     * keys, spaces and stray `'\r'`s.
+     * Header/footer tags are mostly kept balanced so that corpora are not
+     * cut short by exceptions too often.
+    */
+    inline std::string random_corpus(
+        const extract::Settings& settings,
+        std::mt19937_64& rng,
+        const std::size_t& n_lines
+    ) {
+        auto literals_of = [](const std::vector<std::string>& regexes) {
+            std::vector<std::string> out;
+            for (const std::string& re : regexes) {
+                std::string sample = sample_of(re);
+                if (sample != "") {
+                    out.push_back(sample);
+                }
+            }
+            return(out);
+        };
+        std::vector<std::string> markers = literals_of({
+            settings.multiline_comment_start,
+            settings.multiline_comment_stop,
+            settings.singleline_comment
+        });
+        std::vector<std::string> tags_ho = literals_of(settings.header_only_tag_set);
+        std::vector<std::string> tags_h = literals_of(settings.header_tag_set);
+        std::vector<std::string> tags_f = literals_of(settings.footer_tag_set);
+        std::vector<std::string> tags_e = literals_of(settings.either_tag_set);
+        std::vector<std::string> fillers = {
+            "int x = 1;", "text", "x", " ", "  ", "*", "/", "#", "@", "\r", "\t"
+        };
+        std::vector<std::string> keys = {"a", "b", "key_1", "some key"};
+        std::set<std::string> open_hf_keys;
+
+        auto pick = [&rng](const std::vector<std::string>& x) -> std::string {
+            if (x.size() == 0) {
+                return("");
+            }
+            return(x[rng() % x.size()]);
+        };
+
+        std::string corpus;
+        for (std::size_t i = 0; i < n_lines; ++i) {
+            std::string line;
+            unsigned int kind = rng() % 10;
+            if (kind < 4) {
+                // code, sometimes with a marker somewhere
+                line += pick(fillers);
+                if (rng() % 4 == 0) {
+                    line += pick(markers);
+                }
+                line += pick(fillers);
+            } else if (kind < 7) {
+                // plain comment
+                line += pick({"", " ", "    "});
+                line += pick(markers);
+                line += pick(fillers);
+            } else {
+                // tag line
+                line += pick({"", " ", "    "});
+                line += pick(markers);
+                line += pick({"", " ", "  "});
+                unsigned int tag_kind = rng() % 4;
+                std::string key = pick(keys);
+                if (tag_kind == 0) {
+                    line += pick(tags_ho);
+                } else if (tag_kind == 1) {
+                    line += pick(tags_e);
+                } else if (open_hf_keys.size() > 0 && rng() % 2 == 0) {
+                    // close an open header/footer block
+                    key = *std::next(
+                        open_hf_keys.begin(), rng() % open_hf_keys.size()
+                    );
+                    open_hf_keys.erase(key);
+                    line += pick(tags_f);
+                } else {
+                    if (open_hf_keys.count(key) > 0) {
+                        // a header for an open key would throw
+                        key = "new " + key;
+                    }
+                    if (tags_h.size() > 0) {
+                        open_hf_keys.insert(key);
+                    }
+                    line += pick(tags_h);
+                }
+                line += pick({" ", "  ", "", " "});
+                line += key;
+                if (rng() % 8 == 0) {
+                    line += pick({" ", "\r", " \r", "  "});
+                }
+            }
+            corpus += line;
+            if (i + 1 < n_lines || rng() % 2 == 0) {
+                corpus += "\n";
+            }
+        }
+        return(corpus);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Describe record `i` of `outcome` (or its end) for a report.
+    */
+    inline std::string describe_at(const Outcome& outcome, const std::size_t& i) {
+        if (i < outcome.records.size()) {
+            const Record& r = outcome.records[i];
+            return(
+                "key = \"" + r.key + "\", line = \"" + r.line +
+                "\", line_no = " + std::to_string(r.line_no)
+            );
+        }
+        if (outcome.error != "") {
+            return("end of records with exception " + outcome.error);
+        }
+        return("end of records");
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Compare the reference and fast engines on `n_corpora` random corpora.
+     * Stops at the first divergence.
+     * @param settings
+     * Extraction settings; the literal comment markers and tags in it are
+     * used to generate the corpora.
+     * @param seed
+     * Seed of the corpus generator; runs are reproducible.
+     * @param n_corpora
+     * Number of corpora to generate.
+     * @param n_lines
+     * Number of lines per corpus.
+    */
+    inline Report run(
+        const extract::Settings& settings,
+        const unsigned long long& seed = 1,
+        const std::size_t& n_corpora = 100,
+        const std::size_t& n_lines = 1000
+    ) {
+        extract::Settings quiet_settings = settings;
+        quiet_settings.verbosity = 0;
+        extract::Extractor reference_extractor(quiet_settings);
+        reference_extractor.set_engine(extract::Engine::reference);
+        extract::Extractor fast_extractor(quiet_settings);
+        fast_extractor.set_engine(extract::Engine::fast);
+
+        Report report;
+        std::mt19937_64 rng(seed);
+        for (std::size_t c = 0; c < n_corpora; ++c) {
+            std::string corpus = random_corpus(settings, rng, n_lines);
+            Outcome reference = run_engine(reference_extractor, corpus);
+            Outcome fast = run_engine(fast_extractor, corpus);
+            report.corpora += 1;
+            report.bytes += corpus.size();
+            report.records += reference.records.size();
+            report.reference_seconds += reference.seconds;
+            report.fast_seconds += fast.seconds;
+
+            std::size_t n = std::min(reference.records.size(), fast.records.size());
+            std::size_t i = 0;
+            while (i < n && reference.records[i] == fast.records[i]) {
+                i += 1;
+            }
+            bool same = i == n &&
+                reference.records.size() == fast.records.size() &&
+                reference.error == fast.error;
+            if (!same) {
+                report.diverged = true;
+                report.corpus = corpus;
+                report.record_index = i;
+                report.reference = describe_at(reference, i);
+                report.fast = describe_at(fast, i);
+                break;
+            }
+        }
+        return(report);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Human-readable summary of `report`.
+    */
+    inline std::string describe(const Report& report) {
+        std::ostringstream out;
+        out << "corpora: " << report.corpora
+            << ", bytes: " << report.bytes
+            << ", records: " << report.records << "\n"
+            << "reference engine: " << report.reference_seconds << " s, "
+            << "fast engine: " << report.fast_seconds << " s, "
+            << "speedup: " << report.speedup() << "x\n";
+        if (report.diverged) {
+            out << "DIVERGED at record " << report.record_index << "\n"
+                << "  reference: " << report.reference << "\n"
+                << "  fast:      " << report.fast << "\n";
+        } else {
+            out << "no divergence\n";
+        }
+        return(out.str());
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace differential
+
+#endif
@@ -0,0 +1,2103 @@
+#ifndef EXTRACTOR_HPP
+#define EXTRACTOR_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <iterator>
+
+#include "settings.hpp"
+#include "misc_utils.hpp"
+#include "keysets.hpp"
+#include "store.hpp"
+#include "scan.hpp"
+#include "reference.hpp"
+#include "input.hpp"
+#include "trace.hpp"
+#include "batch.hpp"
+#include "inventory.hpp"
+#include "transform.hpp"
+
+namespace extract {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Compiled extraction settings. The regexes and marker literals are
+     * prepared once in the constructor and can then be applied to any
+     * number of files. See `kecx::extract::extract` for the meaning of the
+     * constructor arguments.
+     *
+     * Input is read in large chunks. Each chunk is split into lines and,
+     * for comment markers that are plain literals (e.g. `"[/][*]"`, `"//"`,
+     * `"#"`), every line is flagged in bulk by `scan::classify_lines`
+     * instead of running `std::regex_search` on each line. Markers that are
+     * real regexes (e.g. `"^"`) are still matched per line, by the built-in
+     * engine `rx::Regex`; so are non-literal tags and cleaning steps.
+     *
+     * The line loop reuses its buffers, keeps keys as views into the line
+     * until they are activated and reuses the storage of deactivated keys,
+     * so with literal markers and literal tags it makes no heap allocations
+     * per line once warmed up. This can be checked with
+     * `Stats::line_loop_allocations`.
+    */
+    class Extractor {
+        private:
+            // -----------------------------------------------------------------
+            // settings --------------------------------------------------------
+            Settings settings_;
+            Engine engine_ = Engine::fast;
+
+            // comment markers -------------------------------------------------
+            struct Marker {
+                bool active = false;
+                rx::Regex re;
+                // bit in the flags of `scan::classify_lines`, or -1 if the
+                // marker has to be matched with `re`
+                int literal_bit = -1;
+            };
+            Marker mlc_start;
+            Marker mlc_stop;
+            Marker slc;
+            std::vector<std::string> marker_literals;
+
+            // cleaning --------------------------------------------------------
+            struct CleanStep {
+                // `literal` is set if the step is `[ ]*<literal>[ ]?`
+                std::string literal;
+                rx::Regex re;
+            };
+            std::vector<CleanStep> clean_steps;
+
+            // tags ------------------------------------------------------------
+            bool search_for_hf;
+            bool search_for_e;
+            bool search_for_ho;
+            keysets::TagSetMatcher tags_hf_h;
+            keysets::TagSetMatcher tags_hf_f;
+            keysets::TagSetMatcher tags_e;
+            keysets::TagSetMatcher tags_ho;
+
+            // prefilter -------------------------------------------------------
+            // literals of which every tag match contains at least one; empty
+            // if some tag has no such literal
+            std::vector<std::string> prefilter_literals;
+            bool prefilter_possible = true;
+            bool prefilter_ = true;
+
+            // tracing ---------------------------------------------------------
+            trace::Recorder* trace_ = nullptr;
+
+            // pathological input ---------------------------------------------
+            std::size_t max_line_length_ = 0;
+            bool skip_binary_ = false;
+
+            // key filter and stop signal --------------------------------------
+            KeyFilter key_filter_;
+            const std::atomic<bool>* stop_ = nullptr;
+
+            // transforms ------------------------------------------------------
+            transform::Pipeline transforms_;
+
+            // -----------------------------------------------------------------
+            // block events ----------------------------------------------------
+            /**
+             * @brief
+             * Collects the lines of the open blocks for a `store::BlockStore`
+             * and passes them on in batches, or only counts them for an
+             * `inventory::Manifest`.
+            */
+            class BlockEvents {
+                private:
+                    struct OpenBlock {
+                        store::Block block;
+                        bool open = false;
+                        int lines = 0;
+                        std::string text;
+                        std::vector<std::size_t> ends;
+                        std::vector<int> line_nos;
+                    };
+                    store::BlockStore* sink;
+                    std::string file;
+                    trace::Recorder* recorder;
+                    inventory::Manifest* manifest;
+                    uint32_t file_index;
+                    // slots are reused once their block has ended
+                    std::vector<OpenBlock> blocks;
+
+                    OpenBlock* find(
+                        const store::BlockKind& kind,
+                        const std::string_view& key
+                    ) {
+                        for (OpenBlock& b : blocks) {
+                            if (b.open && b.block.kind == kind && b.block.key == key) {
+                                return(&b);
+                            }
+                        }
+                        return(nullptr);
+                    }
+
+                    void flush(OpenBlock& b) {
+                        if (b.ends.size() > 0) {
+                            trace::Span span(recorder, "store", "extract", file);
+                            sink->lines(b.block, store::LineBatch{b.text, b.ends, b.line_nos});
+                        }
+                        b.text.clear();
+                        b.ends.clear();
+                        b.line_nos.clear();
+                    }
+
+                    void close(OpenBlock& b, const int& last_line) {
+                        b.open = false;
+                        if (manifest != nullptr) {
+                            manifest->add_entry(inventory::Entry{
+                                manifest->add_key(b.block.key),
+                                file_index,
+                                b.block.kind,
+                                b.block.line_no,
+                                last_line,
+                                b.lines
+                            });
+                            return;
+                        }
+                        flush(b);
+                        sink->end(b.block);
+                    }
+
+                public:
+                    // a block's lines are passed on once they exceed this
+                    static constexpr std::size_t batch_bytes = 1 << 20;
+
+                    BlockEvents(
+                        store::BlockStore& sink,
+                        const std::string& file,
+                        trace::Recorder* recorder
+                    ) :
+                        sink(&sink),
+                        file(file),
+                        recorder(recorder),
+                        manifest(nullptr),
+                        file_index(0)
+                    {}
+
+                    BlockEvents(
+                        inventory::Manifest& manifest,
+                        const uint32_t& file_index,
+                        const std::string& file
+                    ) :
+                        sink(nullptr),
+                        file(file),
+                        recorder(nullptr),
+                        manifest(&manifest),
+                        file_index(file_index)
+                    {}
+
+                    /**
+                     * @brief
+                     * Whether lines are only counted, so need not be
+                     * cleaned.
+                    */
+                    bool counts_only() const {
+                        return(manifest != nullptr);
+                    }
+
+                    void begin(
+                        const store::BlockKind& kind,
+                        const std::string_view& key,
+                        const int& line_no
+                    ) {
+                        OpenBlock* slot = nullptr;
+                        for (OpenBlock& b : blocks) {
+                            if (!b.open) {
+                                slot = &b;
+                                break;
+                            }
+                        }
+                        if (slot == nullptr) {
+                            blocks.emplace_back();
+                            slot = &blocks.back();
+                        }
+                        slot->block.key.assign(key.data(), key.size());
+                        slot->block.kind = kind;
+                        slot->block.file = file;
+                        slot->block.line_no = line_no;
+                        slot->open = true;
+                        slot->lines = 0;
+                        if (sink != nullptr) {
+                            sink->begin(slot->block);
+                        }
+                    }
+
+                    void add(
+                        const store::BlockKind& kind,
+                        const std::string& key,
+                        const std::string& line,
+                        const int& line_no
+                    ) {
+                        OpenBlock* b = find(kind, key);
+                        b->lines += 1;
+                        if (manifest != nullptr) {
+                            return;
+                        }
+                        b->text += line;
+                        b->ends.push_back(b->text.size());
+                        b->text += '\n';
+                        b->line_nos.push_back(line_no);
+                        if (b->text.size() >= batch_bytes) {
+                            flush(*b);
+                        }
+                    }
+
+                    void end(
+                        const store::BlockKind& kind,
+                        const std::string_view& key,
+                        const int& last_line
+                    ) {
+                        close(*find(kind, key), last_line);
+                    }
+
+                    void end_all(const store::BlockKind& kind, const int& last_line) {
+                        for (OpenBlock& b : blocks) {
+                            if (b.open && b.block.kind == kind) {
+                                close(b, last_line);
+                            }
+                        }
+                    }
+
+                    /**
+                     * @brief
+                     * Pass on the lines of all open blocks without ending
+                     * them, e.g. before an exception propagates.
+                    */
+                    void flush_all() {
+                        for (OpenBlock& b : blocks) {
+                            if (b.open) {
+                                flush(b);
+                            }
+                        }
+                    }
+            };
+
+            // -----------------------------------------------------------------
+            // per-file state --------------------------------------------------
+            struct State {
+                keysets::KeySet key_set_ho;
+                keysets::KeySet key_set_hf;
+                keysets::KeySet key_set_e;
+                int line_no = -1;
+                bool is_comment_line = false;
+                bool in_multiline_comment = false;
+                std::string clean_line;
+                // set when extracting into a `store::BlockStore`; lines then
+                // go there instead of to the line store
+                BlockEvents* blocks = nullptr;
+                // shown with the trace spans of the input
+                const std::string* file = &trace::no_detail;
+                // with `KeyFilter::once_per_file`: which of its keys have
+                // been activated
+                std::vector<bool> keys_seen;
+                std::size_t n_keys_seen = 0;
+                // set when the rest of the input is not needed
+                bool stopped = false;
+                bool stopped_by_caller = false;
+                // transform state of the open blocks; slots of blocks that
+                // have ended are reused. Each slot keeps its own transformed
+                // line, as the stores of all keys of a line (e.g. the
+                // pending records of `Records`) may hold on to them; a deque
+                // keeps them in place when slots are added.
+                struct TransformBlock {
+                    store::BlockKind kind;
+                    std::string key;
+                    transform::BlockState state;
+                    std::string line;
+                };
+                std::deque<TransformBlock> transform_blocks;
+            };
+
+            static constexpr std::size_t chunk_size = 1 << 20;
+
+            void prepare_marker(
+                Marker& marker,
+                const std::string& re,
+                const bool& active
+            ) {
+                marker.active = active;
+                marker.re = rx::Regex(re);
+                std::string literal;
+                if (marker.active && scan::regex_to_literal(re, literal)) {
+                    marker.literal_bit = static_cast<int>(marker_literals.size());
+                    marker_literals.push_back(literal);
+                }
+            }
+
+            void add_clean_step(const std::string& re) {
+                std::string clean_re_prefix = "[ ]*";
+                std::string clean_re_suffix = "[ ]?";
+                CleanStep step;
+                std::string literal;
+                if (scan::regex_to_literal(re, literal) && literal[0] != ' ') {
+                    step.literal = literal;
+                } else {
+                    step.re = rx::Regex(clean_re_prefix + re + clean_re_suffix);
+                }
+                clean_steps.push_back(step);
+            }
+
+            static bool marker_found(
+                const Marker& marker,
+                const std::string_view& line,
+                const uint8_t& flags
+            ) {
+                if (marker.literal_bit >= 0) {
+                    return((flags >> marker.literal_bit) & 1);
+                }
+                return(marker.re.search(line));
+            }
+
+            /**
+             * @brief
+             * Same as `std::regex_replace` of `[ ]*<literal>[ ]?` with
+             * `format_first_only`: remove the first occurrence of `literal`
+             * together with the spaces right before it and at most one
+             * space right after it.
+            */
+            static void clean_literal(std::string& x, const std::string& literal) {
+                std::string::size_type p = x.find(literal);
+                if (p == std::string::npos) {
+                    return;
+                }
+                std::string::size_type first = p;
+                while (first > 0 && x[first - 1] == ' ') {
+                    first -= 1;
+                }
+                std::string::size_type last = p + literal.size();
+                if (last < x.size() && x[last] == ' ') {
+                    last += 1;
+                }
+                x.erase(first, last - first);
+            }
+
+            static void deactivate_all_ho(State& state) {
+                if (state.blocks != nullptr && state.key_set_ho.size() > 0) {
+                    // the current line no longer belongs to the blocks
+                    state.blocks->end_all(store::BlockKind::header_only, state.line_no - 1);
+                }
+                state.key_set_ho.deactivate_all();
+            }
+
+            /**
+             * @brief
+             * Whether `key`, found by a tag, passes the key filter; keeps
+             * track of the keys seen for `KeyFilter::once_per_file`.
+            */
+            bool key_passes(State& state, const std::string_view& key) const {
+                if (key_filter_.empty()) {
+                    return(true);
+                }
+                int i = key_filter_.match(key);
+                if (i >= 0 && key_filter_.once_per_file) {
+                    if (state.keys_seen.size() == 0) {
+                        state.keys_seen.assign(key_filter_.keys.size(), false);
+                    }
+                    if (!state.keys_seen[i]) {
+                        state.keys_seen[i] = true;
+                        state.n_keys_seen += 1;
+                    }
+                }
+                return(i != KeyFilter::no_match);
+            }
+
+            static const keysets::KeySet& key_set_of(
+                const State& state,
+                const store::BlockKind& kind
+            ) {
+                switch (kind) {
+                    case store::BlockKind::header_footer: return(state.key_set_hf);
+                    case store::BlockKind::either: return(state.key_set_e);
+                    default: return(state.key_set_ho);
+                }
+            }
+
+            /**
+             * @brief
+             * Transform slot of the open block of `key`.
+            */
+            static State::TransformBlock& transform_block(
+                State& state,
+                const store::BlockKind& kind,
+                const std::string_view& key
+            ) {
+                for (State::TransformBlock& b : state.transform_blocks) {
+                    if (b.kind == kind && b.key == key) {
+                        return(b);
+                    }
+                }
+                // not reached: `begin_block` has made a slot
+                throw std::logic_error("kecx: no transform state for key \"" + std::string(key) + "\"");
+            }
+
+            /**
+             * @brief
+             * Bookkeeping of a block that has just begun.
+            */
+            void begin_block(
+                State& state,
+                const store::BlockKind& kind,
+                const std::string_view& key,
+                const int& line_no
+            ) const {
+                if (state.blocks != nullptr) {
+                    state.blocks->begin(kind, key, line_no);
+                }
+                if (transforms_.empty()) {
+                    return;
+                }
+                State::TransformBlock* slot = nullptr;
+                for (State::TransformBlock& b : state.transform_blocks) {
+                    if (b.kind == kind && b.key == key) {
+                        slot = &b;
+                        break;
+                    }
+                    if (slot == nullptr && !key_set_of(state, b.kind).is_active(b.key)) {
+                        slot = &b;
+                    }
+                }
+                if (slot == nullptr) {
+                    state.transform_blocks.emplace_back();
+                    slot = &state.transform_blocks.back();
+                }
+                slot->kind = kind;
+                slot->key.assign(key.data(), key.size());
+                slot->state.reset();
+            }
+
+            /**
+             * @brief
+             * Pass `state.clean_line`, after the transforms, to `store`, or
+             * to the open block of `key` when extracting into a
+             * `store::BlockStore`.
+            */
+            template<typename Store>
+            void deliver(
+                State& state,
+                const store::BlockKind& kind,
+                const std::string& key,
+                const int& line_no,
+                const Store& store,
+                Stats& stats
+            ) const {
+                const std::string* line = &state.clean_line;
+                // an inventory has no cleaned lines to transform
+                if (!transforms_.empty() &&
+                        (state.blocks == nullptr || !state.blocks->counts_only())) {
+                    std::string_view view(state.clean_line);
+                    State::TransformBlock& slot = transform_block(state, kind, key);
+                    if (!transforms_.apply(view, slot.state)) {
+                        stats.store_calls -= 1;
+                        stats.lines_dropped += 1;
+                        return;
+                    }
+                    if (view.data() != state.clean_line.data() ||
+                            view.size() != state.clean_line.size()) {
+                        slot.line.assign(view.data(), view.size());
+                        line = &slot.line;
+                    }
+                }
+                if (state.blocks != nullptr) {
+                    state.blocks->add(kind, key, *line, line_no);
+                } else {
+                    store(key, *line, line_no);
+                }
+            }
+
+            template<typename Store>
+            void process_line(
+                State& state,
+                const std::string_view& line_view,
+                const uint8_t& flags,
+                const Store& store,
+                Stats& stats
+            ) const {
+                // -------------------------------------------------------------
+                // -------------------------------------------------------------
+                state.line_no += 1;
+                const int& line_no = state.line_no;
+                bool& is_comment_line = state.is_comment_line;
+                bool& in_multiline_comment = state.in_multiline_comment;
+                if (settings_.verbosity >= 2) {
+                    utils::print(line_no, "line_no");
+                }
+
+                // -------------------------------------------------------------
+                // comment detection -------------------------------------------
+                bool is_multiline_comment_start = false;
+                bool is_multiline_comment_stop = false;
+                if (mlc_start.active && mlc_stop.active) {
+                    if (in_multiline_comment) {
+                        // check whether multiline stops here
+                        is_multiline_comment_stop = marker_found(
+                            mlc_stop, line_view, flags
+                        );
+                        if (is_multiline_comment_stop) {
+                            in_multiline_comment = false;
+                            is_comment_line = true;
+                        }
+                    } else {
+                        // check whether multiline starts here
+                        is_multiline_comment_start = marker_found(
+                            mlc_start, line_view, flags
+                        );
+                        if (is_multiline_comment_start) {
+                            in_multiline_comment = true;
+                            is_comment_line = true;
+                        }
+                    }
+                }
+                // singleline comment detection --------------------------------
+                bool is_singleline_comment = false;
+                if (!in_multiline_comment && slc.active) {
+                    is_singleline_comment = marker_found(slc, line_view, flags);
+                    is_comment_line = is_singleline_comment;
+                }
+
+                stats.lines += 1;
+                stats.comment_lines += is_comment_line;
+
+                // comment detection verbosity ---------------------------------
+                if (settings_.verbosity >= 2) {
+                    utils::print(is_multiline_comment_start, "is_multiline_comment_start");
+                    utils::print(is_multiline_comment_stop, "is_multiline_comment_stop");
+                    utils::print(in_multiline_comment, "in_multiline_comment");
+                    utils::print(is_singleline_comment, "is_singleline_comment");
+                    utils::print(is_comment_line, "is_comment_line");
+                }
+
+                // -------------------------------------------------------------
+                // key detection -----------------------------------------------
+                // keys are views into the line; nothing is copied until a key
+                // is activated
+                bool line_has_key = false;
+
+                // detect header -----------------------------------------------
+                // e.g. "// @start my_key"
+                std::string_view key_hf_h;
+                if (search_for_hf && is_comment_line && !line_has_key) {
+                    if (tags_hf_h.find_key(line_view, key_hf_h)) {
+                        // found a header tag
+                        line_has_key = true;
+                        if (key_passes(state, key_hf_h)) {
+                            state.key_set_hf.activate(key_hf_h);
+                            begin_block(
+                                state, store::BlockKind::header_footer, key_hf_h, line_no
+                            );
+                        }
+                    }
+                }
+
+                // detect footer -----------------------------------------------
+                // e.g. "// @stop my_key"
+                std::string_view key_hf_f;
+                if (search_for_hf && is_comment_line && !line_has_key) {
+                    if (tags_hf_f.find_key(line_view, key_hf_f)) {
+                        // found a footer tag
+                        line_has_key = true;
+                        if (key_filter_.empty() ||
+                                key_filter_.match(key_hf_f) != KeyFilter::no_match) {
+                            state.key_set_hf.deactivate(key_hf_f);
+                            if (state.blocks != nullptr) {
+                                state.blocks->end(
+                                    store::BlockKind::header_footer, key_hf_f, line_no
+                                );
+                            }
+                        }
+                    }
+                }
+
+                // detect either -----------------------------------------------
+                // e.g. "// @block my_key"
+                std::string_view key_e;
+                if (search_for_e && is_comment_line && !line_has_key) {
+                    if (tags_e.find_key(line_view, key_e)) {
+                        // found an either tag
+                        line_has_key = true;
+                        deactivate_all_ho(state);
+                        if (!key_passes(state, key_e)) {
+                            // filtered out
+                        } else if (state.key_set_e.is_active(key_e)) {
+                            state.key_set_e.deactivate(key_e);
+                            if (state.blocks != nullptr) {
+                                state.blocks->end(store::BlockKind::either, key_e, line_no);
+                            }
+                        } else {
+                            state.key_set_e.activate(key_e);
+                            begin_block(state, store::BlockKind::either, key_e, line_no);
+                        }
+                    }
+                }
+
+                // detect header_only ------------------------------------------
+                // e.g. "// @chunk my_key"
+                std::string_view key_ho;
+                if (search_for_ho && is_comment_line && !line_has_key) {
+                    tags_ho.find_key(line_view, key_ho);
+                }
+                if (key_ho.size() > 0) {
+                    // found a header_only tag
+                    line_has_key = true;
+                    deactivate_all_ho(state);
+                    if (key_passes(state, key_ho)) {
+                        state.key_set_ho.activate(key_ho);
+                        begin_block(state, store::BlockKind::header_only, key_ho, line_no);
+                    }
+                } else if (!is_comment_line || line_has_key) {
+                    deactivate_all_ho(state);
+                }
+
+                // -------------------------------------------------------------
+                // key detection verbosity -------------------------------------
+                if (settings_.verbosity >= 2) {
+                    utils::print(std::string(line_view), "line");
+                    utils::print(state.key_set_ho.get(), "key_set_ho.get()");
+                    utils::print(state.key_set_hf.get(), "key_set_hf.get()");
+                    utils::print(state.key_set_e.get(), "key_set_e.get()");
+                    utils::print(line_has_key, "line_has_key");
+                }
+
+                // -------------------------------------------------------------
+                // store -------------------------------------------------------
+                bool store_hf = !line_has_key &&
+                    state.key_set_hf.size() > 0 &&
+                    (is_comment_line || !settings_.store_only_comments_hf);
+                bool store_e = !line_has_key &&
+                    state.key_set_e.size() > 0 &&
+                    (is_comment_line || !settings_.store_only_comments_e);
+                bool store_ho = !line_has_key &&
+                    state.key_set_ho.size() > 0 &&
+                    (is_comment_line || !settings_.store_only_comments_ho);
+                bool store_any = store_hf || store_e || store_ho;
+                std::string& clean_line = state.clean_line;
+                if (store_any) {
+                    // an inventory only counts the lines
+                    if (state.blocks == nullptr || !state.blocks->counts_only()) {
+                        clean_line.assign(line_view.data(), line_view.size());
+                        for (const CleanStep& step : clean_steps) {
+                            if (step.literal.size() > 0) {
+                                clean_literal(clean_line, step.literal);
+                            } else {
+                                step.re.erase_first(clean_line);
+                            }
+                        }
+                    }
+                    stats.stored_lines += 1;
+                    stats.store_calls += state.key_set_hf.size() * store_hf +
+                        state.key_set_e.size() * store_e +
+                        state.key_set_ho.size() * store_ho;
+                    if (store_hf) {
+                        for (int i = 0; i < state.key_set_hf.size(); ++i) {
+                            deliver(
+                                state, store::BlockKind::header_footer,
+                                state.key_set_hf.key(i), line_no, store, stats
+                            );
+                        }
+                    }
+                    if (store_e) {
+                        for (int i = 0; i < state.key_set_e.size(); ++i) {
+                            deliver(
+                                state, store::BlockKind::either,
+                                state.key_set_e.key(i), line_no, store, stats
+                            );
+                        }
+                    }
+                    if (store_ho) {
+                        for (int i = 0; i < state.key_set_ho.size(); ++i) {
+                            deliver(
+                                state, store::BlockKind::header_only,
+                                state.key_set_ho.key(i), line_no, store, stats
+                            );
+                        }
+                    }
+                } else if (settings_.verbosity >= 2) {
+                    clean_line.assign(line_view.data(), line_view.size());
+                }
+
+                // -------------------------------------------------------------
+                // store verbosity ---------------------------------------------
+                if (settings_.verbosity >= 2) {
+                    utils::print(clean_line, "clean_line");
+                    utils::print(store_hf, "store_hf");
+                    utils::print(store_e, "store_e");
+                    utils::print(store_ho, "store_ho");
+                    utils::print(store_any, "store_any");
+                    if (settings_.verbosity >= 3) {
+                        utils::press_enter_to_proceed();
+                    }
+                }
+
+                // -------------------------------------------------------------
+                // early end ---------------------------------------------------
+                // nothing more can pass a once-per-file filter of exact keys
+                // once all of them have been seen and closed
+                if (key_filter_.once_per_file &&
+                        key_filter_.prefixes.size() == 0 &&
+                        state.n_keys_seen == key_filter_.keys.size() &&
+                        state.n_keys_seen > 0 &&
+                        state.key_set_hf.size() == 0 &&
+                        state.key_set_e.size() == 0 &&
+                        state.key_set_ho.size() == 0) {
+                    state.stopped = true;
+                }
+            }
+
+            // scratch buffers of `process_block`, reused across blocks, and
+            // the position in the current block
+            struct Scratch {
+                std::vector<uint32_t> positions;
+                std::vector<std::size_t> line_ends;
+                std::vector<uint8_t> flags;
+                const char* data = nullptr;
+                std::size_t line = 0;
+                std::size_t line_start = 0;
+            };
+
+            /**
+             * @brief
+             * Classify the lines of `data[0, n)`, which must end at the end
+             * of a line or of the input, for `next_line`.
+            */
+            void start_block(
+                Scratch& scratch,
+                const char* data,
+                const std::size_t& n
+            ) const {
+                scan::classify_lines(
+                    data, n, marker_literals,
+                    scratch.positions, scratch.line_ends, scratch.flags
+                );
+                scratch.data = data;
+                scratch.line = 0;
+                scratch.line_start = 0;
+            }
+
+            /**
+             * @brief
+             * Process the next line of the block of `start_block`; `false`
+             * if there is none or extraction has stopped.
+            */
+            template<typename Store>
+            bool next_line(
+                State& state,
+                Scratch& scratch,
+                const Store& store,
+                Stats& stats
+            ) const {
+                if (scratch.line == scratch.line_ends.size()) {
+                    return(false);
+                }
+                if (stop_ != nullptr && stop_->load(std::memory_order_relaxed)) {
+                    state.stopped = true;
+                    state.stopped_by_caller = true;
+                }
+                if (state.stopped) {
+                    return(false);
+                }
+                std::size_t line_end = scratch.line_ends[scratch.line];
+                std::string_view line(
+                    scratch.data + scratch.line_start, line_end - scratch.line_start
+                );
+                uint8_t flags = scratch.flags[scratch.line];
+                if (max_line_length_ > 0 && line.size() > max_line_length_) {
+                    line = line.substr(0, max_line_length_);
+                    flags = scan::literal_flags(line, marker_literals);
+                    stats.lines_truncated += 1;
+                }
+                process_line(state, line, flags, store, stats);
+                scratch.line += 1;
+                scratch.line_start = line_end + 1;
+                return(true);
+            }
+
+            /**
+             * @brief
+             * Process the lines of `data[0, n)`, which must end at the end
+             * of a line or of the input.
+            */
+            template<typename Store>
+            void process_block(
+                State& state,
+                Scratch& scratch,
+                const char* data,
+                const std::size_t& n,
+                const Store& store,
+                Stats& stats
+            ) const {
+                start_block(scratch, data, n);
+                while (next_line(state, scratch, store, stats)) {}
+            }
+
+            /**
+             * @brief
+             * Bookkeeping and final checks at the end of the input.
+            */
+            void finish(
+                State& state,
+                const unsigned long long& allocations_before,
+                Stats& stats
+            ) const {
+                stats.files += 1;
+                stats.allocations_counted = utils::allocation_counting_enabled();
+                stats.line_loop_allocations +=
+                    utils::allocation_counter() - allocations_before;
+
+                stats.files_stopped += state.stopped;
+
+                // "either" and header-only blocks end with the input
+                if (state.blocks != nullptr) {
+                    if (state.stopped_by_caller) {
+                        state.blocks->end_all(store::BlockKind::header_footer, state.line_no);
+                    }
+                    state.blocks->end_all(store::BlockKind::either, state.line_no);
+                    state.blocks->end_all(store::BlockKind::header_only, state.line_no);
+                    state.blocks->flush_all();
+                }
+
+                // -------------------------------------------------------------
+                // final checks ------------------------------------------------
+                auto key_set_hf_at_end = state.key_set_hf.get();
+                // a caller who stopped early does not get to see the footers
+                if (key_set_hf_at_end.size() > 0 && !state.stopped_by_caller) {
+                    throw keysets::KeySetNotEmptyException(key_set_hf_at_end);
+                }
+
+                if (settings_.verbosity >= 1) {
+                    std::cout <<
+                        "kecx::extract::extract: while loop done --- processed "
+                        << state.line_no << " lines in total"
+                        << std::endl;
+                }
+            }
+
+            /**
+             * @brief
+             * Splits the input into blocks of about `chunk_size` bytes that
+             * end at the end of a line or of the input: views of a mapped
+             * file or buffer, or the contents of a buffer refilled from a
+             * stream. Lines of a stream longer than `max_line_length` (if
+             * not 0) are cut while they are read, so the buffer stays
+             * bounded.
+            */
+            class Chunks {
+                private:
+                    // mapped input
+                    const char* data = nullptr;
+                    std::size_t n = 0;
+                    std::size_t begin = 0;
+                    // stream input
+                    std::istream* input = nullptr;
+                    Stats* stats = nullptr;
+                    std::vector<char> buffer;
+                    std::size_t filled = 0;
+                    // bytes of `buffer` returned by the last `next`
+                    std::size_t returned = 0;
+                    bool at_end = false;
+                    // set while dropping the rest of a line cut at the
+                    // maximum line length
+                    bool cutting = false;
+                    std::size_t max_line_length;
+
+                    void read() {
+                        if (filled == buffer.size()) {
+                            // a single line longer than the buffer
+                            buffer.resize(2 * buffer.size());
+                        }
+                        input->read(buffer.data() + filled, buffer.size() - filled);
+                        filled += static_cast<std::size_t>(input->gcount());
+                        stats->bytes += static_cast<unsigned long long>(input->gcount());
+                        at_end = !*input;
+                    }
+
+                    bool next_mapped(const char*& chunk, std::size_t& size) {
+                        if (begin >= n) {
+                            return(false);
+                        }
+                        std::size_t end = begin + chunk_size;
+                        if (end >= n) {
+                            end = n;
+                        } else {
+                            const char* last = static_cast<const char*>(
+                                memrchr(data + begin, '\n', end - begin)
+                            );
+                            if (last == nullptr) {
+                                // a single line longer than a block
+                                last = static_cast<const char*>(
+                                    std::memchr(data + end, '\n', n - end)
+                                );
+                            }
+                            end = last == nullptr ? n : static_cast<std::size_t>(last - data) + 1;
+                        }
+                        chunk = data + begin;
+                        size = end - begin;
+                        begin = end;
+                        return(true);
+                    }
+
+                public:
+                    /**
+                     * @brief
+                     * Blocks of `data[0, n)`, which is not copied; `n` is
+                     * added to `stats.bytes`.
+                    */
+                    Chunks(
+                        const char* data,
+                        const std::size_t& n,
+                        Stats& stats
+                    ) :
+                        data(data),
+                        n(n),
+                        max_line_length(0)
+                    {
+                        stats.bytes += n;
+                    }
+
+                    /**
+                     * @brief
+                     * Blocks of `input`, read until its end; the bytes read
+                     * are added to `stats.bytes`.
+                    */
+                    Chunks(
+                        std::istream& input,
+                        Stats& stats,
+                        const std::size_t& max_line_length
+                    ) :
+                        input(&input),
+                        stats(&stats),
+                        buffer(chunk_size),
+                        max_line_length(max_line_length)
+                    {}
+
+                    /**
+                     * @brief
+                     * Whether the input looks binary (see
+                     * `scan::looks_binary`); reads the first block of a
+                     * stream. Call before `next`.
+                    */
+                    bool looks_binary() {
+                        if (input == nullptr) {
+                            return(scan::looks_binary(data, n));
+                        }
+                        if (filled == 0 && !at_end) {
+                            read();
+                        }
+                        return(scan::looks_binary(buffer.data(), filled));
+                    }
+
+                    /**
+                     * @brief
+                     * The next block `chunk[0, size)`, valid until the next
+                     * call; `false` at the end of the input. `cut` is set if
+                     * the block is the start of a line cut at the maximum
+                     * line length.
+                    */
+                    bool next(const char*& chunk, std::size_t& size, bool& cut) {
+                        cut = false;
+                        if (input == nullptr) {
+                            return(next_mapped(chunk, size));
+                        }
+                        std::memmove(buffer.data(), buffer.data() + returned, filled - returned);
+                        filled -= returned;
+                        returned = 0;
+                        while (true) {
+                            if (cutting) {
+                                const char* end_of_line = static_cast<const char*>(
+                                    std::memchr(buffer.data(), '\n', filled)
+                                );
+                                if (end_of_line == nullptr) {
+                                    filled = 0;
+                                } else {
+                                    std::size_t rest =
+                                        static_cast<std::size_t>(end_of_line - buffer.data()) + 1;
+                                    std::memmove(buffer.data(), buffer.data() + rest, filled - rest);
+                                    filled -= rest;
+                                    cutting = false;
+                                }
+                            }
+                            // only complete lines are returned before the end
+                            std::size_t usable = filled;
+                            if (!at_end) {
+                                while (usable > 0 && buffer[usable - 1] != '\n') {
+                                    usable -= 1;
+                                }
+                            }
+                            if (usable == 0 && !at_end &&
+                                    max_line_length > 0 && filled > max_line_length) {
+                                // the buffer holds the start of a line that
+                                // is too long: return what is kept of it, drop
+                                // the rest
+                                chunk = buffer.data();
+                                size = max_line_length;
+                                cut = true;
+                                filled = 0;
+                                cutting = true;
+                                return(true);
+                            }
+                            if (usable > 0) {
+                                chunk = buffer.data();
+                                size = usable;
+                                returned = usable;
+                                return(true);
+                            }
+                            if (at_end) {
+                                return(false);
+                            }
+                            read();
+                        }
+                    }
+            };
+
+            /**
+             * @brief
+             * Whether `chunks` is to be skipped as binary; counts it if so.
+            */
+            bool skip_as_binary(Chunks& chunks, Stats& stats) const {
+                if (skip_binary_ && chunks.looks_binary()) {
+                    stats.files += 1;
+                    stats.files_binary += 1;
+                    return(true);
+                }
+                return(false);
+            }
+
+            /**
+             * @brief
+             * Whether the prefilter skips the contents `data[0, n)` of the
+             * file at `file_path`; counts it if so.
+            */
+            bool skip_by_prefilter(
+                const std::string& file_path,
+                const char* data,
+                const std::size_t& n,
+                Stats& stats
+            ) const {
+                if (prefilter_ && prefilter_possible && settings_.verbosity == 0) {
+                    trace::Span span(trace_, "prefilter", "extract", file_path);
+                    if (!scan::contains_any(data, n, prefilter_literals)) {
+                        stats.files += 1;
+                        stats.files_skipped += 1;
+                        stats.bytes += n;
+                        return(true);
+                    }
+                }
+                return(false);
+            }
+
+            /**
+             * @brief
+             * The fast line loop over `chunks`.
+            */
+            template<typename Store>
+            void scan_chunks(
+                State& state,
+                Chunks& chunks,
+                const Store& store,
+                Stats& stats
+            ) const {
+                if (settings_.verbosity >= 1) {
+                    std::cout <<
+                        "kecx::extract::extract: preparations done --- "
+                        << "starting while loop over lines"
+                        << std::endl;
+                }
+                trace::Span span(trace_, "scan", "extract", *state.file);
+                Scratch scratch;
+                unsigned long long allocations_before = utils::allocation_counter();
+                const char* chunk;
+                std::size_t size;
+                bool cut;
+                while (!state.stopped && chunks.next(chunk, size, cut)) {
+                    process_block(state, scratch, chunk, size, store, stats);
+                    stats.lines_truncated += cut;
+                }
+                finish(state, allocations_before, stats);
+            }
+
+            /**
+             * @brief
+             * Same as `extract(std::istream&, ...)` on the contents
+             * `data[0, n)` of a mapped file, without copying them.
+            */
+            template<typename Store>
+            void extract_mapped(
+                State& state,
+                const char* data,
+                const std::size_t& n,
+                const Store& store,
+                Stats& stats
+            ) const {
+                Chunks chunks(data, n, stats);
+                if (skip_as_binary(chunks, stats)) {
+                    return;
+                }
+                scan_chunks(state, chunks, store, stats);
+            }
+
+            /**
+             * @brief
+             * The fast line loop over `input`, read in chunks.
+            */
+            template<typename Store>
+            void extract_stream(
+                State& state,
+                std::istream& input,
+                const Store& store,
+                Stats& stats
+            ) const {
+                Chunks chunks(input, stats, max_line_length_);
+                if (skip_as_binary(chunks, stats)) {
+                    return;
+                }
+                scan_chunks(state, chunks, store, stats);
+            }
+
+            /**
+             * @brief
+             * The prefilter and the fast line loop over the uncompressed
+             * contents `data[0, n)` of the file at `file_path`.
+            */
+            template<typename Store>
+            void extract_contents(
+                State& state,
+                const std::string& file_path,
+                const char* data,
+                const std::size_t& n,
+                const Store& store,
+                Stats& stats
+            ) const {
+                if (skip_by_prefilter(file_path, data, n, stats)) {
+                    return;
+                }
+                extract_mapped(state, data, n, store, stats);
+            }
+
+            /**
+             * @brief
+             * The fast line loop over the file at `file_path`: mapped and
+             * possibly skipped by the prefilter if it is an uncompressed
+             * regular file, else read through `input::FileInput`.
+            */
+            template<typename Store>
+            void extract_file(
+                State& state,
+                const std::string& file_path,
+                const Store& store,
+                Stats& stats
+            ) const {
+                state.file = &file_path;
+                trace::Span open_span(trace_, "open", "extract", file_path);
+                if (utils::is_regular_file(file_path)) {
+                    utils::MappedFile file(file_path);
+                    if (input::detect_compression(
+                                file.data(), std::min<std::size_t>(file.size(), 4)
+                            ) == input::Compression::none) {
+                        open_span.end();
+                        extract_contents(
+                            state, file_path, file.data(), file.size(), store, stats
+                        );
+                        return;
+                    }
+                }
+                input::FileInput file_input(file_path);
+                open_span.end();
+                extract_stream(state, file_input.stream(), store, stats);
+            }
+
+            /**
+             * @brief
+             * Same as `extract_file` on a file that may have been read by a
+             * `batch::Reader` already.
+            */
+            template<typename Store>
+            void extract_read(
+                State& state,
+                const std::string& file_path,
+                const batch::File& file,
+                const Store& store,
+                Stats& stats
+            ) const {
+                state.file = &file_path;
+                if (file.loaded && input::detect_compression(
+                            file.data.data(), std::min<std::size_t>(file.data.size(), 4)
+                        ) == input::Compression::none) {
+                    extract_contents(
+                        state, file_path, file.data.data(), file.data.size(), store, stats
+                    );
+                } else {
+                    extract_file(state, file_path, store, stats);
+                }
+            }
+
+            /**
+             * @brief
+             * Call `run(file_path, file)` for each of `file_paths`, in order,
+             * with the files read ahead by a `batch::Reader`, until the stop
+             * signal is set.
+            */
+            template<typename F>
+            void read_files(
+                const std::vector<std::string>& file_paths,
+                const F& run
+            ) const {
+                batch::Reader reader(
+                    file_paths,
+                    batch::default_queue_depth,
+                    batch::default_max_file_size,
+                    true,
+                    trace_
+                );
+                batch::File file;
+                while (!stopped() && reader.next(file)) {
+                    run(file_paths[file.index], file);
+                }
+            }
+
+            /**
+             * @brief
+             * Run `extract_stream` or `extract_file` with `events` and pass
+             * on the collected lines if it throws.
+            */
+            template<typename F>
+            void with_blocks(
+                BlockEvents& events,
+                const std::string& file,
+                const F& run
+            ) const {
+                State state;
+                state.blocks = &events;
+                state.file = &file;
+                try {
+                    run(state);
+                } catch (...) {
+                    events.flush_all();
+                    throw;
+                }
+            }
+
+        public:
+            /**
+             * @brief
+             * Compile the settings. See `kecx::extract::extract` for the
+             * arguments.
+            */
+            Extractor(
+                const std::string& multiline_comment_start,
+                const std::string& multiline_comment_stop,
+                const std::string& singleline_comment,
+                const std::vector<std::string>& header_only_tag_set,
+                const std::vector<std::string>& header_tag_set,
+                const std::vector<std::string>& footer_tag_set,
+                const std::vector<std::string>& either_tag_set,
+                const bool& store_only_comments_ho = true,
+                const bool& store_only_comments_hf = false,
+                const bool& store_only_comments_e  = false,
+                const int& verbosity = 0
+            ) : Extractor(Settings{
+                    multiline_comment_start,
+                    multiline_comment_stop,
+                    singleline_comment,
+                    header_only_tag_set,
+                    header_tag_set,
+                    footer_tag_set,
+                    either_tag_set,
+                    store_only_comments_ho,
+                    store_only_comments_hf,
+                    store_only_comments_e,
+                    verbosity
+                })
+            {}
+
+            /**
+             * @brief
+             * Compile `settings`.
+            */
+            Extractor(const Settings& settings) : settings_(settings) {
+                const std::string& multiline_comment_start =
+                    settings.multiline_comment_start;
+                const std::string& multiline_comment_stop =
+                    settings.multiline_comment_stop;
+                const std::string& singleline_comment = settings.singleline_comment;
+                const std::vector<std::string>& header_only_tag_set =
+                    settings.header_only_tag_set;
+                const std::vector<std::string>& header_tag_set =
+                    settings.header_tag_set;
+                const std::vector<std::string>& footer_tag_set =
+                    settings.footer_tag_set;
+                const std::vector<std::string>& either_tag_set =
+                    settings.either_tag_set;
+
+                // -------------------------------------------------------------
+                // -------------------------------------------------------------
+                bool search_for_multiline_comments = multiline_comment_start != "" &&
+                    multiline_comment_stop != "";
+                bool search_for_singleline_comments = singleline_comment != "";
+                prepare_marker(
+                    mlc_start, multiline_comment_start, search_for_multiline_comments
+                );
+                prepare_marker(
+                    mlc_stop, multiline_comment_stop, search_for_multiline_comments
+                );
+                prepare_marker(slc, singleline_comment, search_for_singleline_comments);
+
+                if (search_for_multiline_comments) {
+                    add_clean_step(multiline_comment_start);
+                    add_clean_step(multiline_comment_stop);
+                }
+                if (search_for_singleline_comments) {
+                    add_clean_step(singleline_comment);
+                }
+
+                // -------------------------------------------------------------
+                // -------------------------------------------------------------
+                // header, footer ----------------------------------------------
+                search_for_hf = header_tag_set.size() > 0 &&
+                    footer_tag_set.size() > 0;
+                if (search_for_hf) {
+                    tags_hf_h = keysets::TagSetMatcher(header_tag_set);
+                    tags_hf_f = keysets::TagSetMatcher(footer_tag_set);
+                }
+                // either ------------------------------------------------------
+                search_for_e = either_tag_set.size() > 0;
+                if (search_for_e) {
+                    tags_e = keysets::TagSetMatcher(either_tag_set);
+                }
+                // header_only -------------------------------------------------
+                search_for_ho = header_only_tag_set.size() > 0;
+                if (search_for_ho) {
+                    tags_ho = keysets::TagSetMatcher(header_only_tag_set);
+                }
+
+                // -------------------------------------------------------------
+                // prefilter ---------------------------------------------------
+                // without a tag no key is activated, so a file in which no tag
+                // can match produces no records and no exceptions
+                std::vector<const std::vector<std::string>*> searched_tag_sets;
+                if (search_for_hf) {
+                    searched_tag_sets.push_back(&header_tag_set);
+                    searched_tag_sets.push_back(&footer_tag_set);
+                }
+                if (search_for_e) {
+                    searched_tag_sets.push_back(&either_tag_set);
+                }
+                if (search_for_ho) {
+                    searched_tag_sets.push_back(&header_only_tag_set);
+                }
+                for (const std::vector<std::string>* tag_set : searched_tag_sets) {
+                    for (const std::string& tag : *tag_set) {
+                        std::string literal;
+                        if (!scan::required_literal(tag, literal)) {
+                            prefilter_possible = false;
+                        }
+                        prefilter_literals.push_back(literal);
+                    }
+                }
+                if (!prefilter_possible) {
+                    prefilter_literals.clear();
+                }
+            }
+
+            const Settings& settings() const {
+                return(settings_);
+            }
+
+            Engine engine() const {
+                return(engine_);
+            }
+
+            /**
+             * @brief
+             * Select the line loop; see `extract::Engine`. Throws
+             * `std::invalid_argument` for `Engine::reference` if transforms
+             * are set, see `set_transforms`.
+            */
+            void set_engine(const Engine& engine) {
+                if (engine == Engine::reference && !transforms_.empty()) {
+                    throw std::invalid_argument(
+                        "The reference engine does not apply transforms; "
+                        "call set_transforms with an empty pipeline first"
+                    );
+                }
+                engine_ = engine;
+            }
+
+            bool prefilter() const {
+                return(prefilter_);
+            }
+
+            /**
+             * @brief
+             * Enable or disable (default: enabled) the whole-file prefilter
+             * of `extract(file_path, ...)`: files in which none of the
+             * literals required by the tags occur are skipped without
+             * looking at their lines, see `Stats::files_skipped`. It is only
+             * applied by the fast engine, to uncompressed regular files, if
+             * `verbosity` is 0 and if a required literal can be derived
+             * from every tag (see `scan::required_literal`).
+            */
+            void set_prefilter(const bool& prefilter) {
+                prefilter_ = prefilter;
+            }
+
+            const KeyFilter& key_filter() const {
+                return(key_filter_);
+            }
+
+            /**
+             * @brief
+             * Extract only keys passing `key_filter`. Keys that do not pass
+             * are dropped when their tag is found: their lines are neither
+             * cleaned nor stored, and their blocks are not checked (e.g. for
+             * a missing footer). Their tags still end header-only blocks as
+             * usual. With `KeyFilter::once_per_file` and no prefixes, the
+             * rest of a file is skipped once each key has been seen and all
+             * blocks are closed (see `Stats::files_stopped`). Only applied
+             * by the fast engine.
+            */
+            void set_key_filter(const KeyFilter& key_filter) {
+                key_filter_ = key_filter;
+            }
+
+            /**
+             * @brief
+             * Check `*stop` before each line and stop extracting (the file
+             * and any following files of `extract(file_paths, ...)`) once it
+             * is `true`, e.g. when set by `store`. Blocks open at that point
+             * are ended without error. `nullptr` (the default) disables the
+             * check. `stop` must outlive the extractions. Only checked by the
+             * fast engine, and between files.
+            */
+            void set_stop(const std::atomic<bool>* stop) {
+                stop_ = stop;
+            }
+
+            /**
+             * @brief
+             * Whether the stop signal of `set_stop` is set.
+            */
+            bool stopped() const {
+                return(stop_ != nullptr && stop_->load(std::memory_order_relaxed));
+            }
+
+            std::size_t max_line_length() const {
+                return(max_line_length_);
+            }
+
+            /**
+             * @brief
+             * Cut lines longer than `max_line_length` bytes to their first
+             * `max_line_length` bytes before they are looked at (see
+             * `Stats::lines_truncated`); 0 (the default) means no limit. The
+             * rest of a cut line is dropped as it is read, so a stream never
+             * buffers much more than one such line. Only applied by the fast
+             * engine.
+            */
+            void set_max_line_length(const std::size_t& max_line_length) {
+                max_line_length_ = max_line_length;
+            }
+
+            bool skip_binary() const {
+                return(skip_binary_);
+            }
+
+            /**
+             * @brief
+             * Skip (default: do not skip) inputs that look binary (see
+             * `scan::looks_binary`), counting them in `Stats::files_binary`.
+             * Only applied by the fast engine.
+            */
+            void set_skip_binary(const bool& skip_binary) {
+                skip_binary_ = skip_binary;
+            }
+
+            const transform::Pipeline& transforms() const {
+                return(transforms_);
+            }
+
+            /**
+             * @brief
+             * Apply `transforms` to the cleaned lines of each block before
+             * they are stored (see `kecx::transform`); an empty pipeline
+             * (the default) stores them as they are. The state of
+             * `transform::Pipeline` stages is kept per block. `inventory`
+             * counts lines before the transforms. Only the fast engine
+             * applies transforms, so a non-empty `transforms` throws
+             * `std::invalid_argument` with `Engine::reference` rather than
+             * let the engines' output differ.
+            */
+            void set_transforms(const transform::Pipeline& transforms) {
+                if (engine_ == Engine::reference && !transforms.empty()) {
+                    throw std::invalid_argument(
+                        "The reference engine does not apply transforms; "
+                        "call set_engine(Engine::fast) first"
+                    );
+                }
+                transforms_ = transforms;
+            }
+
+            trace::Recorder* trace() const {
+                return(trace_);
+            }
+
+            /**
+             * @brief
+             * Record trace spans of the fast engine with `recorder` (see
+             * `kecx::trace`), or stop recording if it is `nullptr` (the
+             * default). `recorder` must outlive the extractions; it may be
+             * shared by extractions running on several threads.
+            */
+            void set_trace(trace::Recorder* recorder) {
+                trace_ = recorder;
+            }
+
+            /**
+             * @brief
+             * Extract keyed comments from `input` and pass them to `store`.
+             * @param input
+             * Stream to read until its end.
+             * @param store
+             * See `kecx::extract::extract`.
+             * @param stats
+             * Counters to add to.
+            */
+            template<typename Store, typename = store::if_store<Store>>
+            void extract(
+                std::istream& input,
+                const Store& store,
+                Stats& stats
+            ) const {
+                if (engine_ == Engine::reference) {
+                    reference::extract(
+                        input,
+                        settings_.multiline_comment_start,
+                        settings_.multiline_comment_stop,
+                        settings_.singleline_comment,
+                        settings_.header_only_tag_set,
+                        settings_.header_tag_set,
+                        settings_.footer_tag_set,
+                        settings_.either_tag_set,
+                        store::store_type(std::cref(store)),
+                        settings_.store_only_comments_ho,
+                        settings_.store_only_comments_hf,
+                        settings_.store_only_comments_e,
+                        settings_.verbosity
+                    );
+                    stats.files += 1;
+                    return;
+                }
+                State state;
+                extract_stream(state, input, store, stats);
+            }
+
+            /**
+             * @brief
+             * Extract keyed comments from `data[0, n)` and pass them to
+             * `store`, without copying the data.
+            */
+            template<typename Store, typename = store::if_store<Store>>
+            void extract_buffer(
+                const char* data,
+                const std::size_t& n,
+                const Store& store,
+                Stats& stats
+            ) const {
+                if (engine_ == Engine::reference) {
+                    std::istringstream input(std::string(data, n));
+                    extract(input, store, stats);
+                    return;
+                }
+                State state;
+                extract_mapped(state, data, n, store, stats);
+            }
+
+            /**
+             * @brief
+             * Extract keyed comments from `input`, read until its end, and
+             * pass them to `store`.
+            */
+            template<typename Store, typename = store::if_store<Store>>
+            void extract(
+                std::istream& input,
+                const Store& store
+            ) const {
+                Stats stats;
+                extract(input, store, stats);
+            }
+
+            /**
+             * @brief
+             * Extract keyed comments from the file at `file_path` and pass
+             * them to `store`. gzip- and zstd-compressed files are
+             * decompressed on the fly (see `input::FileInput`).
+            */
+            template<typename Store, typename = store::if_store<Store>>
+            void extract(
+                const std::string& file_path,
+                const Store& store,
+                Stats& stats
+            ) const {
+                if (engine_ == Engine::fast) {
+                    State state;
+                    extract_file(state, file_path, store, stats);
+                    return;
+                }
+                input::FileInput file_input(file_path);
+                extract(file_input.stream(), store, stats);
+            }
+
+            template<typename Store, typename = store::if_store<Store>>
+            void extract(
+                const std::string& file_path,
+                const Store& store
+            ) const {
+                Stats stats;
+                extract(file_path, store, stats);
+            }
+
+            /**
+             * @brief
+             * Extract keyed comments from the files at `file_paths`, in
+             * this order, and pass them to `store`. With the fast engine
+             * small files are read ahead in batches (see
+             * `kecx::batch::Reader`).
+            */
+            template<typename Store, typename = store::if_store<Store>>
+            void extract(
+                const std::vector<std::string>& file_paths,
+                const Store& store,
+                Stats& stats
+            ) const {
+                if (engine_ != Engine::fast) {
+                    for (const std::string& file_path : file_paths) {
+                        if (stopped()) {
+                            return;
+                        }
+                        extract(file_path, store, stats);
+                    }
+                    return;
+                }
+                read_files(file_paths, [&](
+                    const std::string& file_path,
+                    const batch::File& file
+                ) {
+                    State state;
+                    extract_read(state, file_path, file, store, stats);
+                });
+            }
+
+            template<typename Store, typename = store::if_store<Store>>
+            void extract(
+                const std::vector<std::string>& file_paths,
+                const Store& store
+            ) const {
+                Stats stats;
+                extract(file_paths, store, stats);
+            }
+
+            /**
+             * @brief
+             * Extract keyed comments from `input` and pass them to `blocks`
+             * block by block (see `store::BlockStore`). Always uses the fast
+             * engine.
+             * @param file
+             * Reported as `store::Block::file`.
+            */
+            void extract(
+                std::istream& input,
+                store::BlockStore& blocks,
+                Stats& stats,
+                const std::string& file = ""
+            ) const {
+                BlockEvents events(blocks, file, trace_);
+                with_blocks(events, file, [&](State& state) {
+                    extract_stream(state, input, store::NullStore(), stats);
+                });
+            }
+
+            /**
+             * @brief
+             * Extract keyed comments from the file at `file_path` and pass
+             * them to `blocks` block by block (see `store::BlockStore`).
+             * Always uses the fast engine.
+            */
+            void extract(
+                const std::string& file_path,
+                store::BlockStore& blocks,
+                Stats& stats
+            ) const {
+                BlockEvents events(blocks, file_path, trace_);
+                with_blocks(events, file_path, [&](State& state) {
+                    extract_file(state, file_path, store::NullStore(), stats);
+                });
+            }
+
+            void extract(
+                const std::string& file_path,
+                store::BlockStore& blocks
+            ) const {
+                Stats stats;
+                extract(file_path, blocks, stats);
+            }
+
+            /**
+             * @brief
+             * List the blocks of the file at `file_path` in `manifest`
+             * without cleaning or storing their lines (see
+             * `kecx::inventory`). Blocks closed before an exception are
+             * listed. Always uses the fast engine.
+            */
+            void inventory(
+                const std::string& file_path,
+                inventory::Manifest& manifest,
+                Stats& stats
+            ) const {
+                BlockEvents events(manifest, manifest.add_file(file_path), file_path);
+                with_blocks(events, file_path, [&](State& state) {
+                    extract_file(state, file_path, store::NullStore(), stats);
+                });
+            }
+
+            /**
+             * @brief
+             * List the blocks of the files at `file_paths` in `manifest`,
+             * read in batches as by `extract(file_paths, ...)`. A file that
+             * throws is recorded in `inventory::Manifest::errors()` instead.
+            */
+            void inventory(
+                const std::vector<std::string>& file_paths,
+                inventory::Manifest& manifest,
+                Stats& stats
+            ) const {
+                read_files(file_paths, [&](
+                    const std::string& file_path,
+                    const batch::File& file
+                ) {
+                    uint32_t file_index = manifest.add_file(file_path);
+                    BlockEvents events(manifest, file_index, file_path);
+                    try {
+                        with_blocks(events, file_path, [&](State& state) {
+                            extract_read(state, file_path, file, store::NullStore(), stats);
+                        });
+                    } catch (const std::exception& e) {
+                        manifest.add_error(file_index, e.what());
+                    }
+                });
+            }
+
+            void inventory(
+                const std::vector<std::string>& file_paths,
+                inventory::Manifest& manifest
+            ) const {
+                Stats stats;
+                inventory(file_paths, manifest, stats);
+            }
+
+            // -----------------------------------------------------------------
+            // pull interface --------------------------------------------------
+            /**
+             * @brief
+             * The records of one input, extracted as they are pulled with
+             * `next` or by iterating: a line is only read and processed
+             * once the records of the previous one have been consumed, so
+             * stopping early skips the rest of the input. Exceptions of the
+             * line loop are thrown by `next`. The extractor must outlive
+             * the records. Always uses the fast engine.
+            */
+            class Records {
+                private:
+                    // collects the records of one line
+                    struct Collect {
+                        std::vector<Record>* records;
+
+                        void operator()(
+                            const std::string& key,
+                            const std::string& line,
+                            const int& line_no
+                        ) const {
+                            records->push_back(Record{key, line, line_no});
+                        }
+                    };
+
+                    const Extractor& extractor;
+                    std::string file_path;
+                    utils::MappedFile mapped;
+                    std::unique_ptr<input::FileInput> file_input;
+                    // before `chunks`, which counts into it
+                    Stats stats_;
+                    std::unique_ptr<Chunks> chunks;
+                    State state;
+                    Scratch scratch;
+                    std::vector<Record> pending;
+                    std::size_t next_pending = 0;
+                    unsigned long long allocations_before = 0;
+                    bool done = false;
+
+                    void start() {
+                        if (extractor.skip_as_binary(*chunks, stats_)) {
+                            done = true;
+                            return;
+                        }
+                        allocations_before = utils::allocation_counter();
+                    }
+
+                    /**
+                     * @brief
+                     * Process one line into `pending`, or start the next
+                     * block, or finish.
+                    */
+                    void advance() {
+                        if (extractor.next_line(state, scratch, Collect{&pending}, stats_)) {
+                            return;
+                        }
+                        const char* chunk;
+                        std::size_t size;
+                        bool cut;
+                        if (!state.stopped && chunks->next(chunk, size, cut)) {
+                            extractor.start_block(scratch, chunk, size);
+                            stats_.lines_truncated += cut;
+                            return;
+                        }
+                        done = true;
+                        extractor.finish(state, allocations_before, stats_);
+                    }
+
+                public:
+                    /**
+                     * @brief
+                     * Records of the file at `file_path`, mapped if it is an
+                     * uncompressed regular file (and then possibly skipped
+                     * by the prefilter), else read through
+                     * `input::FileInput`.
+                    */
+                    Records(const Extractor& extractor, const std::string& file_path) :
+                        extractor(extractor),
+                        file_path(file_path)
+                    {
+                        state.file = &this->file_path;
+                        if (utils::is_regular_file(file_path)) {
+                            mapped = utils::MappedFile(file_path);
+                            if (input::detect_compression(
+                                        mapped.data(), std::min<std::size_t>(mapped.size(), 4)
+                                    ) == input::Compression::none) {
+                                if (extractor.skip_by_prefilter(
+                                            file_path, mapped.data(), mapped.size(), stats_
+                                        )) {
+                                    done = true;
+                                    return;
+                                }
+                                chunks.reset(new Chunks(mapped.data(), mapped.size(), stats_));
+                                start();
+                                return;
+                            }
+                        }
+                        file_input.reset(new input::FileInput(file_path));
+                        chunks.reset(new Chunks(
+                            file_input->stream(), stats_, extractor.max_line_length_
+                        ));
+                        start();
+                    }
+
+                    /**
+                     * @brief
+                     * Records of `data[0, n)`, which is not copied and must
+                     * outlive the records.
+                    */
+                    Records(const Extractor& extractor, const char* data, const std::size_t& n) :
+                        extractor(extractor),
+                        chunks(new Chunks(data, n, stats_))
+                    {
+                        start();
+                    }
+
+                    /**
+                     * @brief
+                     * Records of `input`, which must outlive the records.
+                    */
+                    Records(const Extractor& extractor, std::istream& input) :
+                        extractor(extractor),
+                        chunks(new Chunks(input, stats_, extractor.max_line_length_))
+                    {
+                        start();
+                    }
+
+                    Records(const Records&) = delete;
+                    Records& operator=(const Records&) = delete;
+
+                    /**
+                     * @brief
+                     * Set `record` to the next record; `false` at the end of
+                     * the input.
+                    */
+                    bool next(Record& record) {
+                        while (next_pending == pending.size()) {
+                            if (done) {
+                                return(false);
+                            }
+                            pending.clear();
+                            next_pending = 0;
+                            try {
+                                advance();
+                            } catch (...) {
+                                done = true;
+                                throw;
+                            }
+                        }
+                        record = pending[next_pending];
+                        next_pending += 1;
+                        return(true);
+                    }
+
+                    /**
+                     * @brief
+                     * Counters of the input so far.
+                    */
+                    const Stats& stats() const {
+                        return(stats_);
+                    }
+
+                    class iterator {
+                        private:
+                            Records* records = nullptr;
+                            Record record;
+
+                        public:
+                            typedef std::input_iterator_tag iterator_category;
+                            typedef Record value_type;
+                            typedef std::ptrdiff_t difference_type;
+                            typedef const Record* pointer;
+                            typedef const Record& reference;
+
+                            // the end
+                            iterator() {}
+
+                            explicit iterator(Records* records) : records(records) {
+                                ++*this;
+                            }
+
+                            const Record& operator*() const {
+                                return(record);
+                            }
+
+                            const Record* operator->() const {
+                                return(&record);
+                            }
+
+                            iterator& operator++() {
+                                if (!records->next(record)) {
+                                    records = nullptr;
+                                }
+                                return(*this);
+                            }
+
+                            bool operator==(const iterator& other) const {
+                                return(records == other.records);
+                            }
+
+                            bool operator!=(const iterator& other) const {
+                                return(records != other.records);
+                            }
+                    };
+
+                    /**
+                     * @brief
+                     * Pulls the first record; records can only be iterated
+                     * over once.
+                    */
+                    iterator begin() {
+                        return(iterator(this));
+                    }
+
+                    iterator end() {
+                        return(iterator());
+                    }
+            };
+
+            /**
+             * @brief
+             * Records of the file at `file_path`, extracted as they are
+             * pulled (see `Records`).
+            */
+            Records records(const std::string& file_path) const {
+                return(Records(*this, file_path));
+            }
+
+            /**
+             * @brief
+             * Records of `data[0, n)`, extracted as they are pulled.
+            */
+            Records records(const char* data, const std::size_t& n) const {
+                return(Records(*this, data, n));
+            }
+
+            /**
+             * @brief
+             * Records of `input`, extracted as they are pulled.
+            */
+            Records records(std::istream& input) const {
+                return(Records(*this, input));
+            }
+    };
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+#ifdef KECX_EXTERN_TEMPLATES
+    // instantiated in `src/kecx.cpp`, see `kecx_lib.hpp`
+    extern template void Extractor::extract<store::store_type, void>(
+        const std::string& file_path,
+        const store::store_type& store,
+        Stats& stats
+    ) const;
+    extern template void Extractor::extract<store::store_type, void>(
+        const std::string& file_path,
+        const store::store_type& store
+    ) const;
+    extern template void Extractor::extract<store::store_type, void>(
+        const std::vector<std::string>& file_paths,
+        const store::store_type& store,
+        Stats& stats
+    ) const;
+    extern template void Extractor::extract<store::store_type, void>(
+        const std::vector<std::string>& file_paths,
+        const store::store_type& store
+    ) const;
+    extern template void Extractor::extract<store::store_type, void>(
+        std::istream& input,
+        const store::store_type& store,
+        Stats& stats
+    ) const;
+    extern template void Extractor::extract<store::store_type, void>(
+        std::istream& input,
+        const store::store_type& store
+    ) const;
+    extern template void Extractor::extract_buffer<store::store_type, void>(
+        const char* data,
+        const std::size_t& n,
+        const store::store_type& store,
+        Stats& stats
+    ) const;
+#endif // KECX_EXTERN_TEMPLATES
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace extract
+
+#endif
@@ -0,0 +1,395 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+#ifdef KECX_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef KECX_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "misc_utils.hpp"
+
+namespace input {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Compressed input
+    //
+    // Files compressed with gzip (`.gz`) or zstd (`.zst`) are decompressed
+    // on the fly while they are extracted: the decompressed text is fed to
+    // the line loop in fixed-size chunks, so memory use does not grow with
+    // the file size and no temporary files are written. The format is
+    // recognised by the magic bytes at the start of the file. Since this
+    // library is header-only, the decompressors are opt-in: define
+    // `KECX_WITH_ZLIB` (link with `-lz`) and/or `KECX_WITH_ZSTD` (link with
+    // `-lzstd`) before including `kecx.hpp`. Without them, compressed files
+    // are rejected with a `std::invalid_argument`.
+    //
+    // ## Skipping files without tags
+    //
+    // Uncompressed regular files are memory-mapped. Before their lines are
+    // looked at, the whole file is searched for the literals every tag
+    // requires (e.g. `begin` for `begin(_doc)?`); a file containing none of
+    // them cannot produce any output and is skipped. In trees where most
+    // files carry no documentation this is several times faster than the
+    // line loop. Skipped files are counted in `Stats::files_skipped`; the
+    // prefilter is disabled with `Extractor::set_prefilter(false)` and is not
+    // used if `verbosity` is above 0 or if a tag has no required literal.
+    //
+    // ## Long lines and binary files
+    //
+    // Minified sources and stray binaries can hold lines of many megabytes.
+    // The fast engine looks at each byte a bounded number of times, but tags
+    // or markers that only `std::regex` can match are matched per line, and
+    // cleaned lines are copied. `Extractor::set_max_line_length(n)` cuts
+    // every line to its first `n` bytes before it is looked at, and the rest
+    // of a cut line is dropped while it is read instead of being buffered;
+    // `Stats::lines_truncated` counts the cut lines.
+    // `Extractor::set_skip_binary(true)` skips inputs that start with a
+    // UTF-16/32 byte order mark or have a NUL byte in their first 8 KiB
+    // (`Stats::files_binary`). Both are off by default.
+    //
+    // @docstop README.md
+
+    enum class Compression {
+        none,
+        gzip,
+        zstd
+    };
+
+    /**
+     * @brief
+     * Size of the compressed and decompressed buffers of the decompressing
+     * stream buffers.
+    */
+    const std::size_t decompression_buffer_size = 1 << 16;
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Detect the compression of the data starting with `magic`.
+     * @param magic
+     * At least the first four bytes of the data (fewer if it is shorter).
+     * @param n
+     * Number of bytes in `magic`.
+    */
+    inline Compression detect_compression(const char* magic, const std::size_t& n) {
+        const unsigned char* m = reinterpret_cast<const unsigned char*>(magic);
+        if (n >= 2 && m[0] == 0x1f && m[1] == 0x8b) {
+            return(Compression::gzip);
+        }
+        if (n >= 4 && m[0] == 0x28 && m[1] == 0xb5 && m[2] == 0x2f && m[3] == 0xfd) {
+            return(Compression::zstd);
+        }
+        return(Compression::none);
+    }
+
+#ifdef KECX_WITH_ZLIB
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Stream buffer that inflates gzip (or zlib) data read from `source`.
+     * Concatenated gzip members are decompressed one after the other, as
+     * `gunzip` does. Corrupt or truncated data throws `std::runtime_error`.
+    */
+    class GzipStreambuf : public std::streambuf {
+        private:
+            std::istream& source;
+            z_stream z;
+            std::vector<char> in_buffer;
+            std::vector<char> out_buffer;
+            bool source_done = false;
+            bool stream_done = false;
+
+            bool refill() {
+                if (z.avail_in > 0 || source_done) {
+                    return(z.avail_in > 0);
+                }
+                source.read(in_buffer.data(), in_buffer.size());
+                std::streamsize n = source.gcount();
+                if (n <= 0) {
+                    source_done = true;
+                    return(false);
+                }
+                z.next_in = reinterpret_cast<Bytef*>(in_buffer.data());
+                z.avail_in = static_cast<uInt>(n);
+                return(true);
+            }
+
+        protected:
+            int_type underflow() override {
+                if (gptr() < egptr()) {
+                    return(traits_type::to_int_type(*gptr()));
+                }
+                while (true) {
+                    bool have_input = refill();
+                    if (stream_done) {
+                        if (!have_input) {
+                            return(traits_type::eof());
+                        }
+                        // another gzip member follows
+                        inflateReset(&z);
+                        stream_done = false;
+                    }
+                    z.next_out = reinterpret_cast<Bytef*>(out_buffer.data());
+                    z.avail_out = static_cast<uInt>(out_buffer.size());
+                    int ret = inflate(&z, Z_NO_FLUSH);
+                    if (ret == Z_STREAM_END) {
+                        stream_done = true;
+                    } else if (ret == Z_BUF_ERROR && !have_input) {
+                        throw std::runtime_error(
+                            "kecx: gzip stream is truncated"
+                        );
+                    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                        throw std::runtime_error(
+                            std::string("kecx: gzip stream is corrupt: ")
+                            + (z.msg != nullptr ? z.msg : "unknown error")
+                        );
+                    }
+                    std::size_t produced = out_buffer.size() - z.avail_out;
+                    if (produced > 0) {
+                        setg(
+                            out_buffer.data(),
+                            out_buffer.data(),
+                            out_buffer.data() + produced
+                        );
+                        return(traits_type::to_int_type(*gptr()));
+                    }
+                }
+            }
+
+        public:
+            GzipStreambuf(std::istream& source) :
+                source(source),
+                in_buffer(decompression_buffer_size),
+                out_buffer(decompression_buffer_size)
+            {
+                z = z_stream();
+                // 15 window bits + 32: accept both gzip and zlib headers
+                if (inflateInit2(&z, 15 + 32) != Z_OK) {
+                    throw std::runtime_error("kecx: inflateInit2 failed");
+                }
+                setg(out_buffer.data(), out_buffer.data(), out_buffer.data());
+            }
+
+            GzipStreambuf(const GzipStreambuf&) = delete;
+            GzipStreambuf& operator=(const GzipStreambuf&) = delete;
+
+            ~GzipStreambuf() {
+                inflateEnd(&z);
+            }
+    };
+#endif
+
+#ifdef KECX_WITH_ZSTD
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Stream buffer that decompresses zstd data read from `source`,
+     * including concatenated frames. Corrupt or truncated data throws
+     * `std::runtime_error`.
+    */
+    class ZstdStreambuf : public std::streambuf {
+        private:
+            std::istream& source;
+            ZSTD_DStream* stream;
+            std::vector<char> in_buffer;
+            std::vector<char> out_buffer;
+            ZSTD_inBuffer in;
+            bool source_done = false;
+            // `true` between frames, where the input may legally end
+            bool frame_done = true;
+
+        protected:
+            int_type underflow() override {
+                if (gptr() < egptr()) {
+                    return(traits_type::to_int_type(*gptr()));
+                }
+                while (true) {
+                    if (in.pos == in.size && !source_done) {
+                        source.read(in_buffer.data(), in_buffer.size());
+                        std::streamsize n = source.gcount();
+                        if (n <= 0) {
+                            source_done = true;
+                        }
+                        in.src = in_buffer.data();
+                        in.size = n > 0 ? static_cast<std::size_t>(n) : 0;
+                        in.pos = 0;
+                    }
+                    if (in.pos == in.size && source_done) {
+                        if (!frame_done) {
+                            throw std::runtime_error(
+                                "kecx: zstd stream is truncated"
+                            );
+                        }
+                        return(traits_type::eof());
+                    }
+                    ZSTD_outBuffer out = {out_buffer.data(), out_buffer.size(), 0};
+                    std::size_t ret = ZSTD_decompressStream(stream, &out, &in);
+                    if (ZSTD_isError(ret)) {
+                        throw std::runtime_error(
+                            std::string("kecx: zstd stream is corrupt: ")
+                            + ZSTD_getErrorName(ret)
+                        );
+                    }
+                    frame_done = ret == 0;
+                    if (out.pos > 0) {
+                        setg(
+                            out_buffer.data(),
+                            out_buffer.data(),
+                            out_buffer.data() + out.pos
+                        );
+                        return(traits_type::to_int_type(*gptr()));
+                    }
+                }
+            }
+
+        public:
+            ZstdStreambuf(std::istream& source) :
+                source(source),
+                stream(ZSTD_createDStream()),
+                in_buffer(ZSTD_DStreamInSize()),
+                out_buffer(ZSTD_DStreamOutSize())
+            {
+                if (stream == nullptr) {
+                    throw std::runtime_error("kecx: ZSTD_createDStream failed");
+                }
+                ZSTD_initDStream(stream);
+                in = {in_buffer.data(), 0, 0};
+                setg(out_buffer.data(), out_buffer.data(), out_buffer.data());
+            }
+
+            ZstdStreambuf(const ZstdStreambuf&) = delete;
+            ZstdStreambuf& operator=(const ZstdStreambuf&) = delete;
+
+            ~ZstdStreambuf() {
+                ZSTD_freeDStream(stream);
+            }
+    };
+#endif
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Wrap `source` into a stream that yields its decompressed contents, or
+     * return `nullptr` if `compression` is `Compression::none`. Errors
+     * while decompressing are thrown from reads of the returned stream.
+     * `streambuf` receives the decompressing buffer, which must outlive the
+     * returned stream.
+     * @param name
+     * Used in error messages, e.g. the file path.
+    */
+    inline std::unique_ptr<std::istream> decompressing_stream(
+        [[maybe_unused]] std::istream& source,
+        const Compression& compression,
+        std::unique_ptr<std::streambuf>& streambuf,
+        const std::string& name
+    ) {
+        switch (compression) {
+            case Compression::none:
+                return(nullptr);
+            case Compression::gzip:
+#ifdef KECX_WITH_ZLIB
+                streambuf.reset(new GzipStreambuf(source));
+                break;
+#else
+                throw std::invalid_argument(
+                    "\"" + name + "\" is gzip-compressed, but kecx was built "
+                    "without KECX_WITH_ZLIB"
+                );
+#endif
+            case Compression::zstd:
+#ifdef KECX_WITH_ZSTD
+                streambuf.reset(new ZstdStreambuf(source));
+                break;
+#else
+                throw std::invalid_argument(
+                    "\"" + name + "\" is zstd-compressed, but kecx was built "
+                    "without KECX_WITH_ZSTD"
+                );
+#endif
+        }
+        std::unique_ptr<std::istream> stream(new std::istream(streambuf.get()));
+        // let decompression errors through instead of ending the input
+        stream->exceptions(std::ios::badbit);
+        return(stream);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * A file opened for extraction. Compressed files are decompressed
+     * transparently; `stream()` always yields the plain text.
+    */
+    class FileInput {
+        private:
+            std::ifstream file;
+            std::unique_ptr<std::streambuf> decompressor;
+            std::unique_ptr<std::istream> decompressed;
+            Compression compression_ = Compression::none;
+
+        public:
+            /**
+             * @brief
+             * Open `file_path`; throws `std::invalid_argument` if it is not
+             * accessible or compressed in a format kecx was built without.
+            */
+            FileInput(const std::string& file_path) {
+                if (!utils::file_is_accessible(file_path)) {
+                    throw std::invalid_argument(
+                        "file_path = \""
+                        + file_path
+                        + "\" is not accessible --- does it exist?"
+                    );
+                }
+                file.open(file_path, std::ios::binary);
+                char magic[4];
+                file.read(magic, sizeof(magic));
+                compression_ = detect_compression(
+                    magic, static_cast<std::size_t>(file.gcount())
+                );
+                file.clear();
+                file.seekg(0);
+                decompressed = decompressing_stream(
+                    file, compression_, decompressor, file_path
+                );
+            }
+
+            std::istream& stream() {
+                if (decompressed) {
+                    return(*decompressed);
+                }
+                return(file);
+            }
+
+            Compression compression() const {
+                return(compression_);
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace input
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef INVENTORY_HPP
+#define INVENTORY_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <stdexcept>
+
+#include "store.hpp"
+
+namespace inventory {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Inventory of keys
+    //
+    // `Extractor::inventory` lists the blocks in one or more files without
+    // extracting them: for each block its key, tag kind, file, first and
+    // last line and the number of lines it would store. Lines are not
+    // cleaned and nothing is stored, so listing a whole tree runs at the
+    // speed of the key detection. The result is a `kecx::inventory::Manifest`
+    // in memory; keys and file paths are stored once and referenced by
+    // index. With several files, a file that cannot be read or has
+    // inconsistent tags is recorded in `Manifest::errors()` and the others
+    // are still listed.
+    //
+    // ```
+    // kecx::inventory::Manifest manifest;
+    // extractor.inventory(file_paths, manifest);
+    // manifest.write("./output/manifest.tsv");
+    // ```
+    //
+    // @docstop README.md
+
+    /**
+     * @brief
+     * One block of a `Manifest`. Line numbers are those passed to `store`.
+    */
+    struct Entry {
+        // indices into `Manifest::keys()` and `Manifest::files()`
+        uint32_t key;
+        uint32_t file;
+        store::BlockKind kind;
+        // line of the tag that opened the block
+        int32_t first_line;
+        // line of the tag that closed it; for blocks closed otherwise
+        // (header-only blocks, blocks open at the end of the file) its last
+        // line
+        int32_t last_line;
+        // lines that would be stored for the block
+        int32_t lines;
+    };
+
+    /**
+     * @brief
+     * A file that could not be listed completely.
+    */
+    struct Error {
+        uint32_t file;
+        std::string message;
+    };
+
+    inline const char* kind_name(const store::BlockKind& kind) {
+        switch (kind) {
+            case store::BlockKind::header_footer: return("header_footer");
+            case store::BlockKind::either: return("either");
+            default: return("header_only");
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Blocks found by `Extractor::inventory`, in the order they were closed
+     * within each file.
+    */
+    class Manifest {
+        private:
+            std::vector<std::string> keys_;
+            std::unordered_map<std::string, uint32_t> key_ids;
+            std::vector<std::string> files_;
+            std::vector<Entry> entries_;
+            std::vector<Error> errors_;
+
+        public:
+            const std::vector<std::string>& keys() const {
+                return(keys_);
+            }
+
+            const std::vector<std::string>& files() const {
+                return(files_);
+            }
+
+            const std::vector<Entry>& entries() const {
+                return(entries_);
+            }
+
+            const std::vector<Error>& errors() const {
+                return(errors_);
+            }
+
+            const std::string& key(const Entry& entry) const {
+                return(keys_[entry.key]);
+            }
+
+            const std::string& file(const Entry& entry) const {
+                return(files_[entry.file]);
+            }
+
+            /**
+             * @brief
+             * Index of `key` in `keys()`, added if new.
+            */
+            uint32_t add_key(const std::string_view& key) {
+                auto it = key_ids.find(std::string(key));
+                if (it != key_ids.end()) {
+                    return(it->second);
+                }
+                uint32_t id = static_cast<uint32_t>(keys_.size());
+                keys_.emplace_back(key);
+                key_ids.emplace(keys_.back(), id);
+                return(id);
+            }
+
+            /**
+             * @brief
+             * Index of a new file in `files()`.
+            */
+            uint32_t add_file(const std::string& file_path) {
+                files_.push_back(file_path);
+                return(static_cast<uint32_t>(files_.size() - 1));
+            }
+
+            void add_entry(const Entry& entry) {
+                entries_.push_back(entry);
+            }
+
+            void add_error(const uint32_t& file, const std::string& message) {
+                errors_.push_back(Error{file, message});
+            }
+
+            /**
+             * @brief
+             * Write the entries as tab-separated lines `key`, `kind`,
+             * `file`, `first_line`, `last_line`, `lines` after a header
+             * line, followed by one `#error` line per error.
+            */
+            void write(std::ostream& out) const {
+                out << "key\tkind\tfile\tfirst_line\tlast_line\tlines\n";
+                for (const Entry& entry : entries_) {
+                    out << key(entry) << '\t'
+                        << kind_name(entry.kind) << '\t'
+                        << file(entry) << '\t'
+                        << entry.first_line << '\t'
+                        << entry.last_line << '\t'
+                        << entry.lines << '\n';
+                }
+                for (const Error& error : errors_) {
+                    out << "#error\t" << files_[error.file] << '\t' << error.message << '\n';
+                }
+            }
+
+            void write(const std::string& file_path) const {
+                std::ofstream out(file_path);
+                if (!out) {
+                    throw std::invalid_argument(
+                        "Cannot write manifest to file_path = \"" + file_path + "\""
+                    );
+                }
+                write(out);
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace inventory
+
+#endif
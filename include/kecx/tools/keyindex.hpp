@@ -0,0 +1,823 @@
+#ifndef KEYINDEX_HPP
+#define KEYINDEX_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <string_view>
+#include <utility>
+#include <mutex>
+
+#include "misc_utils.hpp"
+#include "store.hpp"
+#include "extract.hpp"
+
+namespace keyindex {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Binary key index
+    //
+    // Instead of copying every extracted line into one text file per key,
+    // `kecx::keyindex::extract_to_index` writes a single binary index per run.
+    // The index holds a table of source files, a table of keys sorted by
+    // their bytes, and for each key a contiguous list of entries
+    // `(file_id, line_no, offset, length)` pointing at the cleaned text in the
+    // source files. A consumer can memory-map the index and the sources and
+    // slice the text out without copying anything.
+    //
+    // Layout (native byte order, every section 8-byte aligned):
+    //
+    // ```
+    // Header                                    (see keyindex::Header)
+    // FileRecord[n_files]     at files_offset
+    // KeyRecord[n_keys]       at keys_offset    (sorted by key)
+    // Entry[n_entries]        at entries_offset (grouped by key)
+    // uint64_t[n_key_refs]    at key_refs_offset (sorted key ids per file)
+    // uint64_t[n_files]       at file_order_offset (file ids sorted by path)
+    // char[strings_size]      at strings_offset (paths, keys, spilled text)
+    // ```
+    //
+    // When the cleaned text of a line is not a contiguous range of the source
+    // line (e.g. a comment marker removed from the middle of a line), the text
+    // is "spilled" into the string section and the entry gets the flag
+    // `keyindex::entry_in_strings`; `offset` then points into the string
+    // section. Passing `embed_text = true` spills every line, which makes the
+    // index self-contained at the cost of its size.
+    //
+    // `kecx::keyindex::Index` is the read side: it maps an index file and
+    // answers exact key lookups and prefix/range scans by binary search over
+    // the sorted key table, finds source files by binary search over the
+    // path-sorted file ids, and lists the keys found in each source file.
+    //
+    // ```
+    // kecx::keyindex::Index index("./output/kecx.idx");
+    // long long k = index.find("README.md");
+    // if (k >= 0) {
+    //     for (const kecx::keyindex::Entry& entry : index.entries(k)) {
+    //         std::cout << index.text(entry) << std::endl;
+    //     }
+    // }
+    // auto r = index.prefix("param ");
+    // for (std::size_t i = r.first; i < r.second; ++i) {
+    //     std::cout << index.key(i) << std::endl;
+    // }
+    // ```
+    //
+    // @docstop README.md
+
+    const char magic[8] = {'K', 'E', 'C', 'X', 'I', 'D', 'X', '\0'};
+    const uint32_t format_version = 3;
+    const uint32_t entry_in_strings = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t n_files;
+        uint64_t n_keys;
+        uint64_t n_entries;
+        uint64_t n_key_refs;
+        uint64_t files_offset;
+        uint64_t keys_offset;
+        uint64_t entries_offset;
+        uint64_t key_refs_offset;
+        uint64_t file_order_offset;
+        uint64_t strings_offset;
+        uint64_t strings_size;
+    };
+
+    struct FileRecord {
+        uint64_t path_offset;
+        uint64_t path_size;
+        uint64_t first_key_ref;
+        uint64_t n_key_refs;
+    };
+
+    struct KeyRecord {
+        uint64_t key_offset;
+        uint64_t key_size;
+        uint64_t first_entry;
+        uint64_t n_entries;
+    };
+
+    struct Entry {
+        uint32_t file_id;
+        uint32_t line_no;
+        uint64_t offset;
+        uint32_t length;
+        uint32_t flags;
+    };
+
+    static_assert(sizeof(Header) == 96, "unexpected keyindex::Header padding");
+    static_assert(sizeof(FileRecord) == 32, "unexpected keyindex::FileRecord padding");
+    static_assert(sizeof(KeyRecord) == 32, "unexpected keyindex::KeyRecord padding");
+    static_assert(sizeof(Entry) == 24, "unexpected keyindex::Entry padding");
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Collects index entries while files are being extracted and writes
+     * the binary index described above.
+     * Use `store_for` to obtain the `store` callback for each source file.
+    */
+    class IndexWriter {
+        private:
+            std::vector<std::string> file_paths;
+            std::map<std::string, std::vector<Entry>> key_entries;
+            std::string spill;
+            bool embed_text = false;
+
+            uint32_t current_file_id = 0xFFFFFFFF;
+            // the current source, mapped, and the starts of its lines up to
+            // `current_scanned`, found as entries ask for them
+            utils::MappedFile current_source;
+            std::vector<uint64_t> current_line_starts;
+            uint64_t current_scanned = 0;
+
+            void load_source(const std::string& file_path) {
+                if (utils::is_regular_file(file_path)) {
+                    current_source = utils::MappedFile(file_path);
+                } else {
+                    // e.g. a pipe: its lines are spilled
+                    current_source = utils::MappedFile();
+                }
+                current_line_starts.assign(1, 0);
+                current_scanned = 0;
+            }
+
+            /**
+             * @brief
+             * The range `[start, stop)` of line `line_no` of the current
+             * source, without its `'\n'`; `false` if there is no such line.
+            */
+            bool source_line(const uint64_t& line_no, uint64_t& start, uint64_t& stop) {
+                const char* data = current_source.data();
+                uint64_t n = current_source.size();
+                while (current_line_starts.size() <= line_no + 1 && current_scanned < n) {
+                    const char* end = static_cast<const char*>(
+                        std::memchr(data + current_scanned, '\n', n - current_scanned)
+                    );
+                    if (end == nullptr) {
+                        current_scanned = n;
+                        break;
+                    }
+                    current_scanned = static_cast<uint64_t>(end - data) + 1;
+                    current_line_starts.push_back(current_scanned);
+                }
+                if (line_no >= current_line_starts.size()) {
+                    return(false);
+                }
+                start = current_line_starts[line_no];
+                stop = line_no + 1 < current_line_starts.size() ?
+                    current_line_starts[line_no + 1] - 1 : n;
+                return(true);
+            }
+
+            static uint64_t pad_to_8(uint64_t n) {
+                return((n + 7) & ~uint64_t(7));
+            }
+
+        public:
+            /**
+             * @brief
+             * @param embed_text
+             * If `true`, the text of every entry is copied into the index so
+             * that readers never need the source files.
+            */
+            IndexWriter(const bool& embed_text = false) : embed_text(embed_text) {}
+
+            /**
+             * @brief
+             * Register `file_path` as the next source file and return
+             * a callback to pass as `store` to `kecx::extract::extract`
+             * for that file. Only the most recently registered file can
+             * receive entries.
+             * @param file_path
+             * Path to the source file, recorded in the index as given.
+            */
+            store::store_type store_for(const std::string& file_path) {
+                load_source(file_path);
+                file_paths.push_back(file_path);
+                current_file_id = static_cast<uint32_t>(file_paths.size() - 1);
+                uint32_t file_id = current_file_id;
+                return [this, file_id](
+                    const std::string& key,
+                    const std::string& line,
+                    const int& line_no
+                ) -> void
+                {
+                    add(file_id, key, line, line_no);
+                };
+            }
+
+            /**
+             * @brief
+             * Add an entry for `key`. The cleaned `line` is located within
+             * source line `line_no` of file `file_id`; if it is not
+             * a contiguous part of that line (or `embed_text` is set), it is
+             * spilled into the index.
+            */
+            void add(
+                const uint32_t& file_id,
+                const std::string& key,
+                const std::string& line,
+                const int& line_no
+            ) {
+                if (file_id != current_file_id) {
+                    throw std::invalid_argument(
+                        "keyindex::IndexWriter::add: entries can only be "
+                        "added for the most recently registered file"
+                    );
+                }
+                if (line.size() > UINT32_MAX) {
+                    throw std::invalid_argument(
+                        "file_path = \"" + file_paths[file_id] + "\" has a line "
+                        "of more than 4 GiB (line_no = " + std::to_string(line_no)
+                        + "), which a keyindex::Entry cannot hold"
+                    );
+                }
+                Entry entry;
+                entry.file_id = file_id;
+                entry.line_no = static_cast<uint32_t>(line_no);
+                entry.length = static_cast<uint32_t>(line.size());
+                entry.flags = 0;
+
+                bool located = false;
+                uint64_t start = 0;
+                uint64_t stop = 0;
+                if (!embed_text && line_no >= 0 &&
+                        source_line(static_cast<uint64_t>(line_no), start, stop)) {
+                    std::string_view source(current_source.data(), current_source.size());
+                    std::string_view::size_type pos = std::string_view::npos;
+                    if (line.size() <= stop - start &&
+                            source.compare(
+                                stop - line.size(), line.size(), line
+                            ) == 0) {
+                        // the usual case: the comment marker was removed
+                        // from the beginning of the line
+                        pos = stop - line.size();
+                    } else {
+                        pos = source.substr(0, stop).find(line, start);
+                    }
+                    if (pos != std::string_view::npos) {
+                        entry.offset = pos;
+                        located = true;
+                    }
+                }
+                if (!located) {
+                    entry.flags |= entry_in_strings;
+                    entry.offset = spill.size();
+                    spill += line;
+                }
+                key_entries[key].push_back(entry);
+            }
+
+            /**
+             * @brief
+             * Write the index into `index_path`, overwriting any existing
+             * file.
+            */
+            void write(const std::string& index_path) const {
+                // string section: spilled text first so that spill offsets
+                // recorded in `add` stay valid
+                std::string strings = spill;
+                std::vector<FileRecord> file_records;
+                for (const std::string& file_path : file_paths) {
+                    FileRecord r = {};
+                    r.path_offset = strings.size();
+                    r.path_size = file_path.size();
+                    strings += file_path;
+                    file_records.push_back(r);
+                }
+                std::vector<KeyRecord> key_records;
+                std::vector<Entry> entries;
+                std::vector<std::vector<uint64_t>> file_key_ids(file_paths.size());
+                for (const auto& key_and_entries : key_entries) {
+                    KeyRecord r;
+                    r.key_offset = strings.size();
+                    r.key_size = key_and_entries.first.size();
+                    r.first_entry = entries.size();
+                    r.n_entries = key_and_entries.second.size();
+                    strings += key_and_entries.first;
+                    entries.insert(
+                        entries.end(),
+                        key_and_entries.second.begin(),
+                        key_and_entries.second.end()
+                    );
+                    uint64_t key_id = key_records.size();
+                    for (const Entry& entry : key_and_entries.second) {
+                        std::vector<uint64_t>& key_ids = file_key_ids[entry.file_id];
+                        if (key_ids.size() == 0 || key_ids.back() != key_id) {
+                            key_ids.push_back(key_id);
+                        }
+                    }
+                    key_records.push_back(r);
+                }
+                std::vector<uint64_t> file_order(file_paths.size());
+                for (uint64_t file_id = 0; file_id < file_paths.size(); ++file_id) {
+                    file_order[file_id] = file_id;
+                }
+                std::stable_sort(file_order.begin(), file_order.end(), [this](
+                    const uint64_t& a,
+                    const uint64_t& b
+                ) {
+                    return(file_paths[a] < file_paths[b]);
+                });
+                std::vector<uint64_t> key_refs;
+                for (uint32_t file_id = 0; file_id < file_paths.size(); ++file_id) {
+                    file_records[file_id].first_key_ref = key_refs.size();
+                    file_records[file_id].n_key_refs = file_key_ids[file_id].size();
+                    key_refs.insert(
+                        key_refs.end(),
+                        file_key_ids[file_id].begin(),
+                        file_key_ids[file_id].end()
+                    );
+                }
+
+                Header header = {};
+                std::copy(magic, magic + 8, header.magic);
+                header.version = format_version;
+                header.n_files = static_cast<uint32_t>(file_records.size());
+                header.n_keys = key_records.size();
+                header.n_entries = entries.size();
+                header.n_key_refs = key_refs.size();
+                header.files_offset = sizeof(Header);
+                header.keys_offset = header.files_offset +
+                    file_records.size() * sizeof(FileRecord);
+                header.entries_offset = header.keys_offset +
+                    key_records.size() * sizeof(KeyRecord);
+                header.key_refs_offset = header.entries_offset +
+                    entries.size() * sizeof(Entry);
+                header.file_order_offset = header.key_refs_offset +
+                    key_refs.size() * sizeof(uint64_t);
+                header.strings_offset = header.file_order_offset +
+                    file_order.size() * sizeof(uint64_t);
+                header.strings_size = strings.size();
+
+                std::ofstream file_connection(
+                    index_path,
+                    std::ios::binary | std::ios::trunc
+                );
+                if (!file_connection.is_open()) {
+                    throw std::invalid_argument(
+                        "Cannot open index_path = \"" + index_path + "\" for writing"
+                    );
+                }
+                file_connection.write(
+                    reinterpret_cast<const char*>(&header), sizeof(Header)
+                );
+                file_connection.write(
+                    reinterpret_cast<const char*>(file_records.data()),
+                    file_records.size() * sizeof(FileRecord)
+                );
+                file_connection.write(
+                    reinterpret_cast<const char*>(key_records.data()),
+                    key_records.size() * sizeof(KeyRecord)
+                );
+                file_connection.write(
+                    reinterpret_cast<const char*>(entries.data()),
+                    entries.size() * sizeof(Entry)
+                );
+                file_connection.write(
+                    reinterpret_cast<const char*>(key_refs.data()),
+                    key_refs.size() * sizeof(uint64_t)
+                );
+                file_connection.write(
+                    reinterpret_cast<const char*>(file_order.data()),
+                    file_order.size() * sizeof(uint64_t)
+                );
+                file_connection.write(strings.data(), strings.size());
+                std::string padding(
+                    pad_to_8(strings.size()) - strings.size(), '\0'
+                );
+                file_connection.write(padding.data(), padding.size());
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Contiguous run of `T` inside a mapped index, usable in range-for loops.
+    */
+    template<typename T>
+    class Span {
+        private:
+            const T* first_;
+            const T* last_;
+
+        public:
+            Span(const T* first, const T* last) : first_(first), last_(last) {}
+            const T* begin() const {
+                return(first_);
+            }
+            const T* end() const {
+                return(last_);
+            }
+            std::size_t size() const {
+                return(last_ - first_);
+            }
+            const T& operator[](const std::size_t& i) const {
+                return(first_[i]);
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Read side of the binary key index. The index file is mapped into memory
+     * once; lookups are binary searches over the sorted key table and never
+     * open further files. Source files are only mapped (once each) when
+     * `text` is asked for an entry that references a source file.
+    */
+    class Index {
+        private:
+            utils::MappedFile index_file;
+            const Header* header = nullptr;
+            const FileRecord* files = nullptr;
+            const KeyRecord* keys = nullptr;
+            const Entry* entries_ = nullptr;
+            const uint64_t* key_refs = nullptr;
+            const uint64_t* file_order = nullptr;
+            const char* strings = nullptr;
+            // source files mapped by `text`, guarded by `sources_mutex` so
+            // that an `Index` can be read from several threads
+            mutable std::map<uint32_t, utils::MappedFile> sources;
+            mutable std::mutex sources_mutex;
+
+            std::string_view string_at(
+                const uint64_t& offset,
+                const uint64_t& size
+            ) const {
+                return(std::string_view(strings + offset, size));
+            }
+
+            static std::invalid_argument corrupt(
+                const std::string& index_path,
+                const std::string& what
+            ) {
+                return(std::invalid_argument(
+                    "index_path = \"" + index_path + "\" is a corrupt kecx "
+                    "index: " + what
+                ));
+            }
+
+            /**
+             * @brief
+             * Whether `count` records of `size` bytes at `offset` lie within
+             * the index file, aligned for the record types.
+            */
+            bool fits(
+                const uint64_t& offset,
+                const uint64_t& count,
+                const std::size_t& size
+            ) const {
+                return(
+                    (size == 1 || offset % 8 == 0) &&
+                    offset <= index_file.size() &&
+                    count <= (index_file.size() - offset) / size
+                );
+            }
+
+            static bool in_range(
+                const uint64_t& first,
+                const uint64_t& count,
+                const uint64_t& n
+            ) {
+                return(first <= n && count <= n - first);
+            }
+
+            bool in_strings(const uint64_t& offset, const uint64_t& size) const {
+                return(in_range(offset, size, header->strings_size));
+            }
+
+            std::size_t lower_bound(const std::string_view& key) const {
+                std::size_t lo = 0;
+                std::size_t hi = header->n_keys;
+                while (lo < hi) {
+                    std::size_t mid = lo + (hi - lo) / 2;
+                    if (this->key(mid) < key) {
+                        lo = mid + 1;
+                    } else {
+                        hi = mid;
+                    }
+                }
+                return(lo);
+            }
+
+        public:
+            /**
+             * @brief
+             * Map the index file at `index_path`. Throws
+             * `std::invalid_argument` if it is not a kecx index of the
+             * current format version or if its sections or file and key
+             * records point outside the file.
+             * @param index_path
+             * Path to an index written by `IndexWriter::write`.
+            */
+            Index(const std::string& index_path) : index_file(index_path) {
+                if (index_file.size() < sizeof(Header) ||
+                        !std::equal(magic, magic + 8, index_file.data())) {
+                    throw std::invalid_argument(
+                        "index_path = \"" + index_path + "\" is not a kecx index"
+                    );
+                }
+                header = reinterpret_cast<const Header*>(index_file.data());
+                if (header->version != format_version) {
+                    throw std::invalid_argument(
+                        "index_path = \"" + index_path + "\" has an unsupported "
+                        "format version"
+                    );
+                }
+                if (!fits(header->files_offset, header->n_files, sizeof(FileRecord)) ||
+                        !fits(header->keys_offset, header->n_keys, sizeof(KeyRecord)) ||
+                        !fits(header->entries_offset, header->n_entries, sizeof(Entry)) ||
+                        !fits(header->key_refs_offset, header->n_key_refs, sizeof(uint64_t)) ||
+                        !fits(header->file_order_offset, header->n_files, sizeof(uint64_t)) ||
+                        !fits(header->strings_offset, header->strings_size, 1)) {
+                    throw corrupt(index_path, "a section lies outside the file");
+                }
+                const char* base = index_file.data();
+                files = reinterpret_cast<const FileRecord*>(base + header->files_offset);
+                keys = reinterpret_cast<const KeyRecord*>(base + header->keys_offset);
+                entries_ = reinterpret_cast<const Entry*>(base + header->entries_offset);
+                key_refs = reinterpret_cast<const uint64_t*>(base + header->key_refs_offset);
+                file_order = reinterpret_cast<const uint64_t*>(base + header->file_order_offset);
+                strings = base + header->strings_offset;
+                for (std::size_t i = 0; i < header->n_files; ++i) {
+                    const FileRecord& r = files[i];
+                    if (!in_strings(r.path_offset, r.path_size) ||
+                            !in_range(r.first_key_ref, r.n_key_refs, header->n_key_refs)) {
+                        throw corrupt(index_path, "invalid file record " + std::to_string(i));
+                    }
+                }
+                for (std::size_t i = 0; i < header->n_keys; ++i) {
+                    const KeyRecord& r = keys[i];
+                    if (!in_strings(r.key_offset, r.key_size) ||
+                            !in_range(r.first_entry, r.n_entries, header->n_entries)) {
+                        throw corrupt(index_path, "invalid key record " + std::to_string(i));
+                    }
+                }
+                for (std::size_t i = 0; i < header->n_files; ++i) {
+                    if (file_order[i] >= header->n_files) {
+                        throw corrupt(index_path, "invalid file id in file order");
+                    }
+                }
+                for (std::size_t i = 0; i < header->n_key_refs; ++i) {
+                    if (key_refs[i] >= header->n_keys) {
+                        throw corrupt(index_path, "invalid key id in file key list");
+                    }
+                }
+            }
+
+            /**
+             * @brief
+             * Number of distinct keys in the index.
+            */
+            std::size_t n_keys() const {
+                return(header->n_keys);
+            }
+
+            /**
+             * @brief
+             * Number of source files in the index.
+            */
+            std::size_t n_files() const {
+                return(header->n_files);
+            }
+
+            /**
+             * @brief
+             * Key with id `key_id`; key ids follow the sorted order of keys.
+            */
+            std::string_view key(const std::size_t& key_id) const {
+                return(string_at(keys[key_id].key_offset, keys[key_id].key_size));
+            }
+
+            /**
+             * @brief
+             * Path of source file `file_id` as given to the writer.
+            */
+            std::string_view file(const std::size_t& file_id) const {
+                return(string_at(files[file_id].path_offset, files[file_id].path_size));
+            }
+
+            /**
+             * @brief
+             * Id of `key`, or `-1` if the index does not contain it.
+             * O(log n) in the number of keys.
+            */
+            long long find(const std::string_view& key) const {
+                std::size_t i = lower_bound(key);
+                if (i < header->n_keys && this->key(i) == key) {
+                    return(static_cast<long long>(i));
+                }
+                return(-1);
+            }
+
+            /**
+             * @brief
+             * Half-open range `[first, second)` of ids of keys starting with
+             * `prefix`.
+            */
+            std::pair<std::size_t, std::size_t> prefix(
+                const std::string_view& prefix
+            ) const {
+                // keys sharing a prefix are contiguous in the sorted table
+                std::size_t first = lower_bound(prefix);
+                std::size_t lo = first;
+                std::size_t hi = header->n_keys;
+                while (lo < hi) {
+                    std::size_t mid = lo + (hi - lo) / 2;
+                    if (this->key(mid).substr(0, prefix.size()) == prefix) {
+                        lo = mid + 1;
+                    } else {
+                        hi = mid;
+                    }
+                }
+                std::size_t last = lo;
+                return(std::make_pair(first, last));
+            }
+
+            /**
+             * @brief
+             * Half-open range `[first, second)` of ids of keys `k` with
+             * `lo <= k < hi`.
+            */
+            std::pair<std::size_t, std::size_t> range(
+                const std::string_view& lo,
+                const std::string_view& hi
+            ) const {
+                std::size_t first = lower_bound(lo);
+                std::size_t last = lower_bound(hi);
+                if (last < first) {
+                    last = first;
+                }
+                return(std::make_pair(first, last));
+            }
+
+            /**
+             * @brief
+             * Entries of key `key_id` in extraction order.
+            */
+            Span<Entry> entries(const std::size_t& key_id) const {
+                const Entry* first = entries_ + keys[key_id].first_entry;
+                return(Span<Entry>(first, first + keys[key_id].n_entries));
+            }
+
+            /**
+             * @brief
+             * Id of source file `file_path`, or `-1` if the index does not
+             * contain it. O(log n) in the number of files. If a path was
+             * given to the writer more than once, its first id.
+            */
+            long long find_file(const std::string_view& file_path) const {
+                std::size_t lo = 0;
+                std::size_t hi = header->n_files;
+                while (lo < hi) {
+                    std::size_t mid = lo + (hi - lo) / 2;
+                    if (file(file_order[mid]) < file_path) {
+                        lo = mid + 1;
+                    } else {
+                        hi = mid;
+                    }
+                }
+                if (lo < header->n_files && file(file_order[lo]) == file_path) {
+                    return(static_cast<long long>(file_order[lo]));
+                }
+                return(-1);
+            }
+
+            /**
+             * @brief
+             * Sorted ids of the keys that have entries in file `file_id`.
+            */
+            Span<uint64_t> keys_in_file(const std::size_t& file_id) const {
+                const uint64_t* first = key_refs + files[file_id].first_key_ref;
+                return(Span<uint64_t>(first, first + files[file_id].n_key_refs));
+            }
+
+            /**
+             * @brief
+             * Text of `entry`. Text spilled into the index is returned
+             * directly; otherwise the source file is mapped on first use.
+             * The view stays valid as long as this `Index` lives. Safe to
+             * call from several threads.
+            */
+            std::string_view text(const Entry& entry) const {
+                if (entry.flags & entry_in_strings) {
+                    if (!in_strings(entry.offset, entry.length)) {
+                        throw std::out_of_range(
+                            "kecx::keyindex::Index::text: entry text lies "
+                            "outside the index --- is the index corrupt?"
+                        );
+                    }
+                    return(string_at(entry.offset, entry.length));
+                }
+                if (entry.file_id >= header->n_files) {
+                    throw std::out_of_range(
+                        "kecx::keyindex::Index::text: entry of unknown file id "
+                        + std::to_string(entry.file_id)
+                    );
+                }
+                const utils::MappedFile* source = nullptr;
+                {
+                    // mapped files never move once in the map, so the view
+                    // stays valid after the lock is released
+                    std::lock_guard<std::mutex> lock(sources_mutex);
+                    auto it = sources.find(entry.file_id);
+                    if (it == sources.end()) {
+                        it = sources.emplace(
+                            entry.file_id,
+                            utils::MappedFile(std::string(file(entry.file_id)))
+                        ).first;
+                    }
+                    source = &it->second;
+                }
+                if (!in_range(entry.offset, entry.length, source->size())) {
+                    throw std::out_of_range(
+                        "kecx::keyindex::Index::text: source file \""
+                        + std::string(file(entry.file_id))
+                        + "\" is shorter than the index expects --- "
+                        + "has it changed since the index was written?"
+                    );
+                }
+                return(std::string_view(
+                    source->data() + entry.offset, entry.length
+                ));
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Extract keyed comments from `file_paths` and write a binary index into
+     * `index_path` instead of copying lines into per-key text files.
+     * @param file_paths
+     * One or more file paths to process.
+     * @param index_path
+     * Path of the index file to write.
+     * @param multiline_comment_start
+     * See `kecx::extract::extract` for this and the remaining arguments
+     * up to `verbosity`.
+     * @param embed_text
+     * See `IndexWriter::IndexWriter`.
+    */
+    inline void extract_to_index(
+        const std::vector<std::string>& file_paths,
+        const std::string& multiline_comment_start,
+        const std::string& multiline_comment_stop,
+        const std::string& singleline_comment,
+        const std::vector<std::string>& header_only_tag_set,
+        const std::vector<std::string>& header_tag_set,
+        const std::vector<std::string>& footer_tag_set,
+        const std::vector<std::string>& either_tag_set,
+        const std::string& index_path,
+        const bool& store_only_comments_ho = true,
+        const bool& store_only_comments_hf = false,
+        const bool& store_only_comments_e  = false,
+        const int& verbosity = 0,
+        const bool& embed_text = false
+    ) {
+        // compiled once for all files
+        extract::Extractor extractor(
+            multiline_comment_start,
+            multiline_comment_stop,
+            singleline_comment,
+            header_only_tag_set,
+            header_tag_set,
+            footer_tag_set,
+            either_tag_set,
+            store_only_comments_ho,
+            store_only_comments_hf,
+            store_only_comments_e,
+            verbosity
+        );
+        IndexWriter writer(embed_text);
+        for (const std::string& file_path : file_paths) {
+            extractor.extract(file_path, writer.store_for(file_path));
+        }
+        writer.write(index_path);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace keyindex
+
+#endif
@@ -7,8 +7,11 @@
 #include <iostream>
 #include <regex>
 #include <functional>
+#include <string_view>
+#include <algorithm>
 
 #include "misc_utils.hpp"
+#include "scan.hpp"
 
 namespace keysets{
     // -------------------------------------------------------------------------
@@ -16,21 +19,27 @@ namespace keysets{
     // -------------------------------------------------------------------------
     class KeyAlreadyActiveException : public std::exception {
         public:
-            KeyAlreadyActiveException(const std::string& key) : key_(key) {}
-
-            const char* what() const noexcept override {
-                std::string msg = 
-                    "Key \"" 
+            KeyAlreadyActiveException(const std::string& key) : key_(key) {
+                msg_ =
+                    "Key \""
                     + key_
                     + "\" already exists in the the of currently known keys"
                     + " --- "
                     + "most likely this is due to not properly closing a "
                     + "comment block.";
-                return(msg.c_str());
+            }
+
+            const char* what() const noexcept override {
+                return(msg_.c_str());
+            }
+
+            const std::string& key() const {
+                return(key_);
             }
 
         private:
             std::string key_;
+            std::string msg_;
     };
     
     // -------------------------------------------------------------------------
@@ -38,21 +47,27 @@ namespace keysets{
     // -------------------------------------------------------------------------
     class KeyNotActiveException : public std::exception {
         public:
-            KeyNotActiveException(const std::string& key) : key_(key) {}
-
-            const char* what() const noexcept override {
-                std::string msg = 
-                    "Key \"" 
+            KeyNotActiveException(const std::string& key) : key_(key) {
+                msg_ =
+                    "Key \""
                     + key_
                     + "\" does not exist in the the of currently known keys"
                     + " --- "
                     + "most likely this is due to an internal error that "
                     + "you should report to the maintainer.";
-                return(msg.c_str());
+            }
+
+            const char* what() const noexcept override {
+                return(msg_.c_str());
+            }
+
+            const std::string& key() const {
+                return(key_);
             }
 
         private:
             std::string key_;
+            std::string msg_;
     };
 
     // -------------------------------------------------------------------------
@@ -60,24 +75,31 @@ namespace keysets{
     // -------------------------------------------------------------------------
     class KeySetNotEmptyException : public std::exception {
         public:
-            KeySetNotEmptyException(const std::vector<std::string>& keys) : keys_(keys) {}
-
-            const char* what() const noexcept override {
-                std::string msg; 
-                msg += "The key set is not empty at the end of ";
-                msg += "the file. This indicates unclosed comment blocks. ";
-                msg += "Remaining keys: ";
+            KeySetNotEmptyException(const std::vector<std::string>& keys) : keys_(keys) {
+                msg_ += "The key set is not empty at the end of ";
+                msg_ += "the file. This indicates unclosed comment blocks. ";
+                msg_ += "Remaining keys: ";
 
                 for (const auto& key : keys_) {
-                    msg += key + ", ";
+                    msg_ += key + ", ";
                 }
-                msg.pop_back(); // Remove the last comma and space
-                msg.pop_back();
-                return(msg.c_str());
+                msg_.pop_back(); // Remove the last comma and space
+                msg_.pop_back();
+            }
+
+            // the message is built once: `what()` must not point into a
+            // temporary
+            const char* what() const noexcept override {
+                return(msg_.c_str());
+            }
+
+            const std::vector<std::string>& keys() const {
+                return(keys_);
             }
 
         private:
             std::vector<std::string> keys_;
+            std::string msg_;
     };
 
     // -------------------------------------------------------------------------
@@ -85,15 +107,28 @@ namespace keysets{
     // -------------------------------------------------------------------------
     class KeySet {
         private:
+            // the first `n_active` elements are the active keys in order of
+            // activation; the rest are kept only so that their capacity is
+            // reused by later activations
             std::vector<std::string> key_set;
+            std::size_t n_active = 0;
+
+            int find(const std::string_view& key) const {
+                for (std::size_t i = 0; i < n_active; ++i) {
+                    if (key_set[i] == key) {
+                        return(static_cast<int>(i));
+                    }
+                }
+                return(-1);
+            }
 
         public:
             /**
              * @brief 
              * Get number of elements in key set.
             */
-            int size() {
-                return(key_set.size());
+            int size() const {
+                return(static_cast<int>(n_active));
             }
 
             /**
@@ -102,8 +137,8 @@ namespace keysets{
              * @param key
              * A key to attempt to find in the key set.
             */
-            bool is_active(const std::string& key) {
-                return(utils::match_first(key, key_set) >= 0);
+            bool is_active(const std::string_view& key) const {
+                return(find(key) >= 0);
             }
 
             /**
@@ -115,40 +150,160 @@ namespace keysets{
              * A key to attempt to activate. If the key is already active,
              * a `KeyAlreadyActiveException` is thrown.
             */
-            void activate(const std::string& key) {
+            void activate(const std::string_view& key) {
                 if (is_active(key)) {
-                    throw KeyAlreadyActiveException(key);
+                    throw KeyAlreadyActiveException(std::string(key));
+                }
+                if (n_active < key_set.size()) {
+                    key_set[n_active].assign(key.data(), key.size());
                 } else {
-                    key_set.push_back(key);
+                    key_set.emplace_back(key);
                 }
+                n_active += 1;
             }
 
             /**
              * @brief 
              * Removes key from key set.
              * @param key
-             * A key to attempt to deactivate. If the key is already active,
-             * a `KeyAlreadyActiveException` is thrown.
+             * A key to attempt to deactivate. If the key is not active,
+             * a `KeyNotActiveException` is thrown.
             */
-            void deactivate(const std::string& key) {
-                int m = utils::match_first(key, key_set);
+            void deactivate(const std::string_view& key) {
+                int m = find(key);
                 if (m == -1) {
-                    throw KeyNotActiveException(key);
-                }
-                if (m >= 0) {
-                    key_set.erase(key_set.begin() + m);
+                    throw KeyNotActiveException(std::string(key));
                 }
+                // keep the order of the remaining keys
+                std::rotate(
+                    key_set.begin() + m,
+                    key_set.begin() + m + 1,
+                    key_set.begin() + n_active
+                );
+                n_active -= 1;
             }
             void deactivate_all() {
-                while (key_set.size() > 0) {
-                    key_set.pop_back();
+                n_active = 0;
+            }
+            std::vector<std::string> get() const {
+                return(std::vector<std::string>(
+                    key_set.begin(), key_set.begin() + n_active
+                ));
+            }
+
+            /**
+             * @brief
+             * The `i`th active key in order of activation. Unlike `get`, this
+             * does not copy anything.
+            */
+            const std::string& key(const int& i) const {
+                return(key_set[i]);
+            }
+
+    };
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Finds the key of a tag from a tag set in a line, with the same result
+     * as `utils::re_extract_last_group` with `utils::tag_set_to_regex`.
+     * If every tag is a plain literal (e.g. `"@doc"`), no regex is run and
+     * nothing is allocated; otherwise the regex is run by `rx::Regex`.
+    */
+    class TagSetMatcher {
+        private:
+            rx::Regex re;
+            std::vector<std::string> literals;
+            bool all_literal = false;
+
+        public:
+            TagSetMatcher() {}
+
+            /**
+             * @brief
+             * @param tag_set
+             * Non-empty set of tags, each a regex.
+            */
+            TagSetMatcher(const std::vector<std::string>& tag_set) :
+                re(utils::tag_set_to_rx(tag_set))
+            {
+                all_literal = true;
+                for (const std::string& tag : tag_set) {
+                    std::string literal;
+                    if (!scan::regex_to_literal(tag, literal)) {
+                        all_literal = false;
+                    }
+                    literals.push_back(literal);
                 }
             }
-            std::vector<std::string> get() {
-                return(key_set);
+
+            /**
+             * @brief
+             * Tags as literals, if `all_literal()`.
+            */
+            const std::vector<std::string>& tag_literals() const {
+                return(literals);
             }
 
+            bool is_all_literal() const {
+                return(all_literal);
+            }
+
+            /**
+             * @brief
+             * Set `key` to a view into `line` of the key following the
+             * leftmost tag and return `true`, or return `false` if `line`
+             * has no tag.
+            */
+            bool find_key(
+                const std::string_view& line,
+                std::string_view& key
+            ) const {
+                if (!all_literal) {
+                    rx::Match m;
+                    if (!re.search(line, m)) {
+                        return(false);
+                    }
+                    key = m.view(m.size() - 1);
+                    return(key.size() > 0);
+                }
+                // `(tags)[ ]*(.+)[ ]*$` needs at least one character after
+                // the tag and no '\r' or '\n' (not matched by `.`) after it;
+                // the leftmost tag wins, ties go to the earlier tag in the set
+                std::size_t after_last_cr = 0;
+                std::size_t cr = line.find_last_of("\r\n");
+                if (cr != std::string_view::npos) {
+                    after_last_cr = cr + 1;
+                }
+                std::size_t best = std::string_view::npos;
+                std::size_t best_size = 0;
+                for (const std::string& literal : literals) {
+                    std::size_t from = after_last_cr > literal.size() ?
+                        after_last_cr - literal.size() : 0;
+                    std::size_t p = line.find(literal, from);
+                    if (p == std::string_view::npos ||
+                            p + literal.size() >= line.size() ||
+                            p >= best) {
+                        continue;
+                    }
+                    best = p;
+                    best_size = literal.size();
+                }
+                if (best == std::string_view::npos) {
+                    return(false);
+                }
+                std::string_view rest = line.substr(best + best_size);
+                std::size_t n_spaces = rest.find_first_not_of(' ');
+                if (n_spaces == std::string_view::npos) {
+                    // `[ ]*` backtracks to leave one space to `(.+)`
+                    n_spaces = rest.size() - 1;
+                }
+                key = rest.substr(n_spaces);
+                return(true);
+            }
     };
+
     // -------------------------------------------------------------------------
     // -------------------------------------------------------------------------
     // -------------------------------------------------------------------------
@@ -7,7 +7,14 @@
 #include <iostream>
 #include <regex>
 #include <functional>
+#include <stdexcept>
+#include <utility>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "rx.hpp"
 
 namespace utils{
     // -------------------------------------------------------------------------
@@ -26,7 +33,7 @@ namespace utils{
     int match_first(const T& x, const std::vector<T>& y) {
         int m = -1;
         int i = -1;
-        for (T y_elem : y) {
+        for (const T& y_elem : y) {
             i += 1;
             if (x == y_elem) {
                 m = i;
@@ -119,6 +126,32 @@ namespace utils{
         return(out);
     }
 
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // The same with the built-in engine, see `rx::Regex`.
+    inline bool re_detect(const std::string& x, const rx::Regex& r) {
+        return(r.search(x));
+    }
+
+    inline std::string re_extract(const std::string& x, const rx::Regex& r) {
+        rx::Match m;
+        std::string out = "";
+        if (r.search(x, m)) {
+            out = m.str(0);
+        }
+        return(out);
+    }
+
+    inline std::string re_extract_last_group(const std::string& x, const rx::Regex& r) {
+        rx::Match m;
+        std::string out = "";
+        if (r.search(x, m)) {
+            out = m.str(m.size() - 1);
+        }
+        return(out);
+    }
+
     // -------------------------------------------------------------------------
     // -------------------------------------------------------------------------
     // -------------------------------------------------------------------------
@@ -127,7 +160,7 @@ namespace utils{
      * Defines what a key is allowed to look like. Currently allowed to contain
      * any characters on the same line (after the tag and any whitespace).
     */
-    std::string key_regex_string() {
+    inline std::string key_regex_string() {
         return(".+");
     }
 
@@ -136,21 +169,40 @@ namespace utils{
     // -------------------------------------------------------------------------
     /**
      * @brief
-     * Returns a regex which matches any tag supplied via `tag_set`
-     * plus any interim whitespaces, the key, and any trailing whitespaces.
-     * The key is in the last capture group of the regex.
+     * Pattern of `tag_set_to_regex`.
     */
-    std::regex tag_set_to_regex(const std::vector<std::string>& tag_set) {
+    inline std::string tag_set_to_regex_string(const std::vector<std::string>& tag_set) {
         std::string s = "(";
-        for (std::string tag : tag_set) {
+        for (const std::string& tag : tag_set) {
             s += "(" + tag + ")|";
         }
         s.pop_back(); // remove trailing |
         s += ")[ ]*(" + key_regex_string() + ")[ ]*$";
-        std::regex r = std::regex(s);
+        return(s);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Returns a regex which matches any tag supplied via `tag_set`
+     * plus any interim whitespaces, the key, and any trailing whitespaces.
+     * The key is in the last capture group of the regex.
+    */
+    inline std::regex tag_set_to_regex(const std::vector<std::string>& tag_set) {
+        std::regex r = std::regex(tag_set_to_regex_string(tag_set));
         return(r);
     }
 
+    /**
+     * @brief
+     * As `tag_set_to_regex`, compiled for the built-in engine.
+    */
+    inline rx::Regex tag_set_to_rx(const std::vector<std::string>& tag_set) {
+        return(rx::Regex(tag_set_to_regex_string(tag_set)));
+    }
+
     // -------------------------------------------------------------------------
     // -------------------------------------------------------------------------
     // -------------------------------------------------------------------------
@@ -178,7 +230,7 @@ namespace utils{
      * @param x_nm
      * Name of object in debug message.
     */
-    void print(const std::string& x, const std::string& x_nm) {
+    inline void print(const std::string& x, const std::string& x_nm) {
         std::cout << x_nm << " = \"" << x << "\"" << std::endl;
     }
 
@@ -215,7 +267,7 @@ namespace utils{
      * @brief
      * Requests user to press enter to proceed. Used in debugging.
     */
-    void press_enter_to_proceed() {
+    inline void press_enter_to_proceed() {
         std::cout << "press enter to proceed" << std::endl;
         std::cin.ignore();
     }
@@ -230,14 +282,173 @@ namespace utils{
      * @param file_path
      * Path to a file.
     */
-    bool file_is_accessible(const std::string& file_path) {
+    inline bool file_is_accessible(const std::string& file_path) {
         struct stat buffer;   
         return (stat (file_path.c_str(), &buffer) == 0); 
     }
 
+    /**
+     * @brief
+     * Returns `true` if `file_path` is a regular file (not a pipe, device,
+     * directory, ...), else `false`. Symbolic links are followed.
+    */
+    inline bool is_regular_file(const std::string& file_path) {
+        struct stat buffer;
+        return(stat(file_path.c_str(), &buffer) == 0 && S_ISREG(buffer.st_mode));
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Read-only memory mapping of a whole file. Empty files are not mapped
+     * and have `data() == nullptr`.
+    */
+    class MappedFile {
+        private:
+            const char* data_ = nullptr;
+            std::size_t size_ = 0;
+
+        public:
+            MappedFile() {}
+
+            /**
+             * @brief
+             * Map `file_path` into memory; throws `std::invalid_argument`
+             * if the file cannot be opened or mapped.
+             * @param file_path
+             * Path to a file.
+            */
+            MappedFile(const std::string& file_path) {
+                int fd = ::open(file_path.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    throw std::invalid_argument(
+                        "file_path = \""
+                        + file_path
+                        + "\" is not accessible --- does it exist?"
+                    );
+                }
+                struct stat st;
+                if (::fstat(fd, &st) != 0) {
+                    ::close(fd);
+                    throw std::invalid_argument(
+                        "Cannot stat file_path = \"" + file_path + "\""
+                    );
+                }
+                size_ = static_cast<std::size_t>(st.st_size);
+                if (size_ > 0) {
+                    void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (p == MAP_FAILED) {
+                        ::close(fd);
+                        throw std::invalid_argument(
+                            "Cannot map file_path = \"" + file_path + "\""
+                        );
+                    }
+                    data_ = static_cast<const char*>(p);
+                }
+                ::close(fd);
+            }
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            MappedFile(MappedFile&& other) noexcept {
+                std::swap(data_, other.data_);
+                std::swap(size_, other.size_);
+            }
+
+            MappedFile& operator=(MappedFile&& other) noexcept {
+                std::swap(data_, other.data_);
+                std::swap(size_, other.size_);
+                return(*this);
+            }
+
+            ~MappedFile() {
+                if (data_ != nullptr) {
+                    ::munmap(const_cast<char*>(data_), size_);
+                }
+            }
+
+            const char* data() const {
+                return(data_);
+            }
+
+            std::size_t size() const {
+                return(size_);
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Number of heap allocations made by the calling thread. Only counts
+     * when exactly one translation unit of the programme defines
+     * `KECX_COUNT_ALLOCATIONS` before including kecx; otherwise stays `0`.
+    */
+    inline unsigned long long& allocation_counter() {
+        thread_local unsigned long long n = 0;
+        return(n);
+    }
+
+    /**
+     * @brief
+     * `true` if the allocation counter is live, i.e. some translation unit
+     * defines `KECX_COUNT_ALLOCATIONS`.
+    */
+    inline bool& allocation_counting_enabled() {
+        static bool enabled = false;
+        return(enabled);
+    }
+
     // -------------------------------------------------------------------------
     // -------------------------------------------------------------------------
     // -------------------------------------------------------------------------
 } // namespace utils
 
+#ifdef KECX_COUNT_ALLOCATIONS
+// replacement global allocation functions feeding utils::allocation_counter;
+// may only be compiled into one translation unit of a programme
+#include <cstdlib>
+#include <new>
+
+static const bool kecx_allocation_counting_enabled =
+    (utils::allocation_counting_enabled() = true);
+
+void* operator new(std::size_t n) {
+    utils::allocation_counter() += 1;
+    void* p = std::malloc(n > 0 ? n : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return(p);
+}
+
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept {
+    utils::allocation_counter() += 1;
+    return(std::malloc(n > 0 ? n : 1));
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif // KECX_COUNT_ALLOCATIONS
+
 #endif // UTILS_HPP
\ No newline at end of file
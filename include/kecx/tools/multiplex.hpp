@@ -0,0 +1,723 @@
+#ifndef MULTIPLEX_HPP
+#define MULTIPLEX_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "misc_utils.hpp"
+#include "store.hpp"
+
+namespace multiplex {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Single multiplexed output file
+    //
+    // With many keys (e.g. tag `@` giving one key per parameter name, see
+    // `example_02.cpp`) one text file per key means a huge number of tiny
+    // files. `kecx::multiplex::Writer` instead writes every record into one
+    // sequential file through a single file descriptor, in large buffered
+    // writes. Its `store()` can be passed wherever a `store` is expected.
+    //
+    // The file is a stream of frames, each a `multiplex::FrameHeader`
+    // followed by `size` bytes of payload (native byte order):
+    //
+    // ```
+    // FileHeader                  "KECXMUX\0", version
+    // FrameHeader + key           kind = frame_key, defines key `key_id`
+    // FrameHeader + line          kind = frame_line, one extracted line
+    // ...
+    // FrameHeader + key table     kind = frame_table, written by close()
+    // Footer                      offset of the key table, "KECXEND\0"
+    // ```
+    //
+    // A key is defined by a `frame_key` frame just before its first line, so
+    // the file can be read front to back even if it was never closed. Files
+    // written by `kecx::shard::extract` also contain `frame_shard`,
+    // `frame_file` and `frame_error` frames (see "Sharding across
+    // processes"), which readers that do not need them skip. The
+    // key table at the end lists every key with its number of lines, so
+    // `multiplex::Reader::keys()` does not have to scan the file.
+    // `kecx::multiplex::split` turns a multiplexed file into the familiar
+    // one-file-per-key output of `store::store_to_txt_factory`.
+    //
+    // ```
+    // kecx::multiplex::Writer writer("./output/kecx.mux");
+    // kecx::extract::extract(
+    //     file_paths, "[/][*]", "[*][/]", "//", {"@"}, {}, {}, {},
+    //     writer.store()
+    // );
+    // writer.close();
+    // kecx::multiplex::split("./output/kecx.mux", "./output/");
+    // ```
+    //
+    // @docstop README.md
+
+    const char magic[8] = {'K', 'E', 'C', 'X', 'M', 'U', 'X', '\0'};
+    const char end_magic[8] = {'K', 'E', 'C', 'X', 'E', 'N', 'D', '\0'};
+    const uint32_t format_version = 1;
+
+    const uint32_t frame_key = 1;
+    const uint32_t frame_line = 2;
+    const uint32_t frame_table = 3;
+    const uint32_t frame_file = 4;
+    const uint32_t frame_error = 5;
+    const uint32_t frame_shard = 6;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+    };
+
+    /**
+     * @brief
+     * Header of every frame. For `frame_line` frames the payload is the line
+     * and `line_no` its line number; for `frame_key` frames the payload is
+     * the key; for the `frame_table` frame the payload is one `TableEntry`
+     * per key, in key id order, and `key_id` is the number of keys.
+     * `frame_file` frames start the lines of input file number `key_id`
+     * (payload: its path); a `frame_error` frame records that extracting
+     * input file `key_id` failed (payload: the message); the payload of a
+     * `frame_shard` frame, if any the first frame, is a `ShardHeader`.
+    */
+    struct FrameHeader {
+        uint32_t kind;
+        uint32_t key_id;
+        int32_t line_no;
+        uint32_t size;
+    };
+
+    struct TableEntry {
+        uint64_t n_lines;
+        uint64_t key_frame_offset;
+    };
+
+    struct Footer {
+        uint64_t table_offset;
+        uint64_t n_lines;
+        char magic[8];
+    };
+
+    /**
+     * @brief
+     * Which part of which input a file written by `kecx::shard::extract`
+     * holds.
+    */
+    struct ShardHeader {
+        uint32_t index;
+        uint32_t count;
+        uint64_t n_files;
+        // `kecx::shard::file_list_hash` of the input files
+        uint64_t file_list_hash;
+    };
+
+    static_assert(sizeof(FileHeader) == 16, "unexpected multiplex::FileHeader padding");
+    static_assert(sizeof(FrameHeader) == 16, "unexpected multiplex::FrameHeader padding");
+    static_assert(sizeof(TableEntry) == 16, "unexpected multiplex::TableEntry padding");
+    static_assert(sizeof(Footer) == 24, "unexpected multiplex::Footer padding");
+    static_assert(sizeof(ShardHeader) == 24, "unexpected multiplex::ShardHeader padding");
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Writes records into a multiplexed file. Frames are collected in a
+     * buffer of `buffer_size` bytes and written with one `write` call each
+     * time it fills up. `close()` writes the key table and the footer; the
+     * destructor calls it if it was not called, but ignores errors.
+    */
+    class Writer {
+        private:
+            std::string path;
+            int fd = -1;
+            std::vector<char> buffer;
+            std::size_t buffer_size;
+            uint64_t offset = 0;
+            uint64_t n_lines = 0;
+
+            std::unordered_map<std::string, uint32_t> key_ids;
+            std::vector<TableEntry> table;
+            // most keys come in runs of lines; skip the hash lookup for them
+            std::string last_key;
+            uint32_t last_key_id = 0;
+            bool has_last_key = false;
+
+            void flush() {
+                std::size_t done = 0;
+                while (done < buffer.size()) {
+                    ssize_t n = ::write(fd, buffer.data() + done, buffer.size() - done);
+                    if (n < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        throw std::runtime_error(
+                            "kecx: cannot write to \"" + path + "\": "
+                            + std::strerror(errno)
+                        );
+                    }
+                    done += static_cast<std::size_t>(n);
+                }
+                buffer.clear();
+            }
+
+            void append(const void* data, const std::size_t& size) {
+                if (buffer.size() + size > buffer_size && buffer.size() > 0) {
+                    flush();
+                }
+                const char* p = static_cast<const char*>(data);
+                buffer.insert(buffer.end(), p, p + size);
+                offset += size;
+            }
+
+            void append_frame(
+                const uint32_t& kind,
+                const uint32_t& key_id,
+                const int32_t& line_no,
+                const char* payload,
+                const std::size_t& size
+            ) {
+                FrameHeader frame = {kind, key_id, line_no, static_cast<uint32_t>(size)};
+                append(&frame, sizeof(FrameHeader));
+                append(payload, size);
+            }
+
+            uint32_t key_id_of(const std::string& key) {
+                if (has_last_key && key == last_key) {
+                    return(last_key_id);
+                }
+                auto it = key_ids.find(key);
+                uint32_t key_id;
+                if (it == key_ids.end()) {
+                    key_id = static_cast<uint32_t>(table.size());
+                    key_ids.emplace(key, key_id);
+                    table.push_back(TableEntry{0, offset});
+                    append_frame(frame_key, key_id, 0, key.data(), key.size());
+                } else {
+                    key_id = it->second;
+                }
+                last_key = key;
+                last_key_id = key_id;
+                has_last_key = true;
+                return(key_id);
+            }
+
+        public:
+            /**
+             * @brief
+             * Create (or truncate) the multiplexed file `path`; throws
+             * `std::invalid_argument` if it cannot be opened.
+            */
+            Writer(const std::string& path, const std::size_t& buffer_size = 1 << 20) :
+                path(path),
+                buffer_size(buffer_size)
+            {
+                fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd < 0) {
+                    throw std::invalid_argument(
+                        "Cannot open path = \"" + path + "\" for writing"
+                    );
+                }
+                buffer.reserve(buffer_size);
+                FileHeader header = {};
+                std::memcpy(header.magic, magic, sizeof(magic));
+                header.version = format_version;
+                append(&header, sizeof(FileHeader));
+            }
+
+            Writer(const Writer&) = delete;
+            Writer& operator=(const Writer&) = delete;
+
+            ~Writer() {
+                if (fd >= 0) {
+                    try {
+                        close();
+                    } catch (...) {
+                    }
+                }
+            }
+
+            /**
+             * @brief
+             * Append one record.
+            */
+            void add(const std::string& key, const std::string& line, const int& line_no) {
+                uint32_t key_id = key_id_of(key);
+                append_frame(frame_line, key_id, line_no, line.data(), line.size());
+                table[key_id].n_lines += 1;
+                n_lines += 1;
+            }
+
+            /**
+             * @brief
+             * Mark the following records as coming from input file number
+             * `file`, at `file_path`.
+            */
+            void begin_file(const uint32_t& file, const std::string& file_path) {
+                append_frame(frame_file, file, 0, file_path.data(), file_path.size());
+            }
+
+            /**
+             * @brief
+             * Record that extracting input file number `file` failed with
+             * `message`.
+            */
+            void add_error(const uint32_t& file, const std::string& message) {
+                append_frame(frame_error, file, 0, message.data(), message.size());
+            }
+
+            /**
+             * @brief
+             * Record which shard of the input the file holds; must be
+             * called before anything else is added.
+            */
+            void add_shard(const ShardHeader& shard) {
+                append_frame(
+                    frame_shard, 0, 0,
+                    reinterpret_cast<const char*>(&shard), sizeof(ShardHeader)
+                );
+            }
+
+            /**
+             * @brief
+             * A `store` callback appending to this writer, which must
+             * outlive it.
+            */
+            store::store_type store() {
+                return(
+                    [this](
+                        const std::string& key,
+                        const std::string& line,
+                        const int& line_no
+                    ) -> void
+                    {
+                        add(key, line, line_no);
+                    }
+                );
+            }
+
+            /**
+             * @brief
+             * Write the key table and the footer and close the file.
+            */
+            void close() {
+                if (fd < 0) {
+                    return;
+                }
+                Footer footer = {};
+                footer.table_offset = offset;
+                footer.n_lines = n_lines;
+                std::memcpy(footer.magic, end_magic, sizeof(end_magic));
+                append_frame(
+                    frame_table,
+                    static_cast<uint32_t>(table.size()),
+                    0,
+                    reinterpret_cast<const char*>(table.data()),
+                    table.size() * sizeof(TableEntry)
+                );
+                append(&footer, sizeof(Footer));
+                flush();
+                int ret = ::close(fd);
+                fd = -1;
+                if (ret != 0) {
+                    throw std::runtime_error(
+                        "kecx: cannot close \"" + path + "\": " + std::strerror(errno)
+                    );
+                }
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * One line read back from a multiplexed file. The views point into the
+     * mapped file.
+    */
+    struct Record {
+        uint32_t key_id;
+        std::string_view key;
+        std::string_view line;
+        int line_no;
+        // input file number of the last `frame_file` frame, else 0
+        uint32_t file;
+    };
+
+    /**
+     * @brief
+     * Read side of a multiplexed file: maps it and iterates its records in
+     * the order they were written. Files that were not closed (no key
+     * table) can be read as well, up to their last complete frame.
+    */
+    class Reader {
+        private:
+            std::string path_;
+            utils::MappedFile file;
+            std::vector<std::string_view> keys_;
+            std::vector<uint64_t> n_lines_;
+            bool complete_ = false;
+            std::size_t end = 0;
+            std::size_t position = sizeof(FileHeader);
+            uint32_t file_ = 0;
+            bool has_shard_ = false;
+            ShardHeader shard_ = {};
+            bool failed_ = false;
+            uint32_t failed_file_ = 0;
+            std::string_view error_;
+
+            static std::invalid_argument corrupt(
+                const std::string& path,
+                const std::string& what
+            ) {
+                return(std::invalid_argument(
+                    "path = \"" + path + "\" is a corrupt kecx multiplexed "
+                    "file: " + what
+                ));
+            }
+
+            FrameHeader frame_at(const std::size_t& at) const {
+                FrameHeader frame;
+                std::memcpy(&frame, file.data() + at, sizeof(FrameHeader));
+                return(frame);
+            }
+
+        public:
+            /**
+             * @brief
+             * Map `path`; throws `std::invalid_argument` if it is not a
+             * multiplexed file of a supported version or its key table is
+             * corrupt.
+            */
+            Reader(const std::string& path) : path_(path), file(path) {
+                FileHeader header;
+                if (file.size() < sizeof(FileHeader)) {
+                    throw std::invalid_argument(
+                        "path = \"" + path + "\" is not a kecx multiplexed file"
+                    );
+                }
+                std::memcpy(&header, file.data(), sizeof(FileHeader));
+                if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+                        header.version != format_version) {
+                    throw std::invalid_argument(
+                        "path = \"" + path + "\" is not a kecx multiplexed file "
+                        "of version " + std::to_string(format_version)
+                    );
+                }
+                end = file.size();
+
+                Footer footer;
+                if (file.size() >= sizeof(FileHeader) + sizeof(FrameHeader) + sizeof(Footer)) {
+                    std::memcpy(&footer, file.data() + file.size() - sizeof(Footer), sizeof(Footer));
+                    complete_ = std::memcmp(footer.magic, end_magic, sizeof(end_magic)) == 0;
+                }
+                if (complete_) {
+                    // the table frame is followed by the footer; the key
+                    // frames it points to come before it
+                    const std::size_t table_end = file.size() - sizeof(Footer);
+                    if (footer.table_offset < sizeof(FileHeader) ||
+                            footer.table_offset > table_end - sizeof(FrameHeader)) {
+                        throw corrupt(path, "key table offset out of range");
+                    }
+                    end = static_cast<std::size_t>(footer.table_offset);
+                    FrameHeader table_frame = frame_at(end);
+                    if (table_frame.kind != frame_table ||
+                            table_frame.size != uint64_t(table_frame.key_id) * sizeof(TableEntry) ||
+                            end + sizeof(FrameHeader) + table_frame.size != table_end) {
+                        throw corrupt(path, "invalid key table");
+                    }
+                    const char* entries = file.data() + end + sizeof(FrameHeader);
+                    for (uint32_t k = 0; k < table_frame.key_id; ++k) {
+                        TableEntry entry;
+                        std::memcpy(&entry, entries + k * sizeof(TableEntry), sizeof(TableEntry));
+                        if (entry.key_frame_offset < sizeof(FileHeader) ||
+                                entry.key_frame_offset > end - sizeof(FrameHeader)) {
+                            throw corrupt(path, "key frame offset out of range");
+                        }
+                        FrameHeader key_frame = frame_at(entry.key_frame_offset);
+                        if (key_frame.kind != frame_key || key_frame.size >
+                                end - entry.key_frame_offset - sizeof(FrameHeader)) {
+                            throw corrupt(path, "invalid key frame");
+                        }
+                        keys_.push_back(std::string_view(
+                            file.data() + entry.key_frame_offset + sizeof(FrameHeader),
+                            key_frame.size
+                        ));
+                        n_lines_.push_back(entry.n_lines);
+                    }
+                }
+
+                if (position + sizeof(FrameHeader) + sizeof(ShardHeader) <= end) {
+                    FrameHeader frame = frame_at(position);
+                    if (frame.kind == frame_shard && frame.size == sizeof(ShardHeader)) {
+                        std::memcpy(
+                            &shard_, file.data() + position + sizeof(FrameHeader),
+                            sizeof(ShardHeader)
+                        );
+                        has_shard_ = true;
+                    }
+                }
+            }
+
+            /**
+             * @brief
+             * `true` if the file was closed properly, i.e. has a key table.
+            */
+            bool complete() const {
+                return(complete_);
+            }
+
+            /**
+             * @brief
+             * Keys in order of first appearance. For files without a key
+             * table only the keys read so far by `next` are known.
+            */
+            const std::vector<std::string_view>& keys() const {
+                return(keys_);
+            }
+
+            /**
+             * @brief
+             * Number of lines of key `key_id`; only known for complete files.
+            */
+            uint64_t n_lines(const uint32_t& key_id) const {
+                return(key_id < n_lines_.size() ? n_lines_[key_id] : 0);
+            }
+
+            /**
+             * @brief
+             * Whether the file starts with a `ShardHeader`, returned by
+             * `shard()`.
+            */
+            bool has_shard() const {
+                return(has_shard_);
+            }
+
+            const ShardHeader& shard() const {
+                return(shard_);
+            }
+
+            /**
+             * @brief
+             * Whether a `frame_error` frame has been read by `next`; the
+             * failed input file is `failed_file()` and the message
+             * `error()`.
+            */
+            bool failed() const {
+                return(failed_);
+            }
+
+            uint32_t failed_file() const {
+                return(failed_file_);
+            }
+
+            const std::string_view& error() const {
+                return(error_);
+            }
+
+            /**
+             * @brief
+             * Read the next line record into `record`. Returns `false` at the
+             * end of the records. Throws `std::invalid_argument` for a line
+             * of a key that has not been defined.
+            */
+            bool next(Record& record) {
+                while (position + sizeof(FrameHeader) <= end) {
+                    FrameHeader frame = frame_at(position);
+                    std::size_t payload = position + sizeof(FrameHeader);
+                    if (payload + frame.size > end) {
+                        // incomplete last frame of an unclosed file
+                        break;
+                    }
+                    position = payload + frame.size;
+                    if (frame.kind == frame_key) {
+                        if (!complete_ && frame.key_id == keys_.size()) {
+                            keys_.push_back(std::string_view(file.data() + payload, frame.size));
+                        }
+                        continue;
+                    }
+                    if (frame.kind == frame_file) {
+                        file_ = frame.key_id;
+                        continue;
+                    }
+                    if (frame.kind == frame_error) {
+                        failed_ = true;
+                        failed_file_ = frame.key_id;
+                        error_ = std::string_view(file.data() + payload, frame.size);
+                        continue;
+                    }
+                    if (frame.kind != frame_line) {
+                        continue;
+                    }
+                    if (frame.key_id >= keys_.size()) {
+                        throw corrupt(path_, "line of undefined key " + std::to_string(frame.key_id));
+                    }
+                    record.key_id = frame.key_id;
+                    record.key = keys_[frame.key_id];
+                    record.line = std::string_view(file.data() + payload, frame.size);
+                    record.line_no = frame.line_no;
+                    record.file = file_;
+                    return(true);
+                }
+                position = end;
+                return(false);
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Appends lines to one text file per key, `output_dir_path + key`,
+     * exactly like `store::store_to_txt_factory(output_dir_path)` would.
+     * Lines are collected per output file in memory and appended to their
+     * files once `flush_threshold` bytes are pending, so that each file is
+     * opened rarely. Keys naming the same file (e.g. `x` and `./x`) share
+     * their pending lines, which keeps them in order. The destructor
+     * flushes, but ignores errors.
+    */
+    class TxtWriter {
+        private:
+            std::string output_dir_path;
+            std::size_t flush_threshold;
+            // output file of each key seen, and of each file identity
+            std::unordered_map<std::string, std::size_t> key_files;
+            std::unordered_map<std::string, std::size_t> file_ids;
+            std::vector<std::string> paths;
+            std::vector<std::string> pending;
+            std::size_t pending_bytes = 0;
+            std::string last_key;
+            std::size_t last_file = 0;
+            bool has_last_key = false;
+
+            /**
+             * @brief
+             * Device and inode of the file at `path`, which is created
+             * as appending to it would; `path` itself if it cannot be
+             * opened, as then nothing is written to it anyway.
+            */
+            static std::string file_identity(const std::string& path) {
+                int fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+                if (fd < 0) {
+                    return("path " + path);
+                }
+                struct stat st;
+                bool ok = ::fstat(fd, &st) == 0;
+                ::close(fd);
+                if (!ok) {
+                    return("path " + path);
+                }
+                return(
+                    "inode " + std::to_string(st.st_dev) + " " + std::to_string(st.st_ino)
+                );
+            }
+
+        public:
+            TxtWriter(
+                const std::string& output_dir_path,
+                const std::size_t& flush_threshold = 64 << 20
+            ) :
+                output_dir_path(output_dir_path),
+                flush_threshold(flush_threshold)
+            {}
+
+            TxtWriter(const TxtWriter&) = delete;
+            TxtWriter& operator=(const TxtWriter&) = delete;
+
+            ~TxtWriter() {
+                try {
+                    flush();
+                } catch (...) {
+                }
+            }
+
+            void add(const std::string_view& key, const std::string_view& line) {
+                if (!has_last_key || key != last_key) {
+                    auto it = key_files.find(std::string(key));
+                    if (it == key_files.end()) {
+                        std::string path = output_dir_path + std::string(key);
+                        auto file = file_ids.emplace(file_identity(path), paths.size()).first;
+                        if (file->second == paths.size()) {
+                            paths.push_back(path);
+                            pending.emplace_back();
+                        }
+                        it = key_files.emplace(std::string(key), file->second).first;
+                    }
+                    last_key.assign(key.data(), key.size());
+                    last_file = it->second;
+                    has_last_key = true;
+                }
+                std::string& lines = pending[last_file];
+                lines.append(line.data(), line.size());
+                lines += '\n';
+                pending_bytes += line.size() + 1;
+                if (pending_bytes >= flush_threshold) {
+                    flush();
+                }
+            }
+
+            void flush() {
+                for (std::size_t f = 0; f < pending.size(); ++f) {
+                    if (pending[f].size() == 0) {
+                        continue;
+                    }
+                    std::ofstream file_connection(
+                        paths[f],
+                        std::ios::binary | std::ios::app
+                    );
+                    file_connection.write(pending[f].data(), pending[f].size());
+                    pending[f].clear();
+                }
+                pending_bytes = 0;
+            }
+    };
+
+    /**
+     * @brief
+     * Write the records of the multiplexed file `path` into one text file per
+     * key, `output_dir_path + key`, appending to existing files exactly like
+     * `store::store_to_txt_factory(output_dir_path)` would have.
+     * @param path
+     * Multiplexed file written by `Writer`.
+     * @param output_dir_path
+     * Prefix of the output file paths, e.g. `"./output/"`.
+     * @param flush_threshold
+     * See `TxtWriter`.
+    */
+    inline void split(
+        const std::string& path,
+        const std::string& output_dir_path,
+        const std::size_t& flush_threshold = 64 << 20
+    ) {
+        Reader reader(path);
+        TxtWriter writer(output_dir_path, flush_threshold);
+        Record record;
+        while (reader.next(record)) {
+            writer.add(record.key, record.line);
+        }
+        writer.flush();
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace multiplex
+
+#endif
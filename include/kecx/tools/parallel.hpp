@@ -0,0 +1,461 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <cstdint>
+
+#include <sys/stat.h>
+
+#include "store.hpp"
+#include "extractor.hpp"
+#include "trace.hpp"
+
+namespace parallel {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Extracting files on several threads
+    //
+    // `kecx::parallel::extract` runs an `Extractor` over a list of files on
+    // several worker threads and still passes the records to `store` in
+    // the order a single `extractor.extract(file_paths, store)` would, on
+    // the calling thread, so `store` need not be thread-safe.
+    //
+    // ```
+    // kecx::parallel::Options options;
+    // options.threads = 8;
+    // kecx::parallel::extract(
+    //     extractor, file_paths,
+    //     kecx::store::store_to_txt_factory("./output/"), options
+    // );
+    // ```
+    //
+    // File sizes are looked up first, and every worker gets its own queue
+    // of files, largest first, so that a huge file does not start last and
+    // hold up the end of the run. A worker whose queue is empty steals the
+    // largest pending file of the queue with the most bytes left. Workers
+    // keep the records of each file in memory until all earlier files have
+    // been passed on. Once more than `Options::memory_budget` bytes are
+    // held back, workers start files in list order instead, so that the
+    // held-back files can be passed on.
+    //
+    // If a file throws, the records of the files before it are passed on
+    // and the exception is rethrown, as in the single-threaded case. A stop
+    // signal (see `Extractor::set_stop`) ends the run once the record that
+    // set it has been passed on.
+    //
+    // @docstop README.md
+
+    /**
+     * @brief
+     * Settings of `parallel::extract`.
+    */
+    struct Options {
+        // worker threads; `0` means `std::thread::hardware_concurrency()`.
+        // With one thread (or one file) the files are extracted on the
+        // calling thread, as by `Extractor::extract`.
+        unsigned int threads = 0;
+        // bytes of records held back for `store` before workers start
+        // files in list order
+        std::size_t memory_budget = std::size_t(256) << 20;
+    };
+
+    /**
+     * @brief
+     * What the scheduler did, see `parallel::extract`.
+    */
+    struct Report {
+        unsigned int threads = 0;
+        // files taken from another worker's queue
+        unsigned long long steals = 0;
+        // files started in list order because of the memory budget
+        unsigned long long files_in_order = 0;
+        // largest number of bytes held back for `store`
+        std::size_t peak_buffered = 0;
+    };
+
+    /**
+     * @brief
+     * Size of the file at `file_path` in bytes, `0` if it cannot be
+     * determined (e.g. a pipe or a missing file).
+    */
+    inline uint64_t file_size(const std::string& file_path) {
+        struct stat buffer;
+        if (stat(file_path.c_str(), &buffer) != 0 || !S_ISREG(buffer.st_mode)) {
+            return(0);
+        }
+        return(static_cast<uint64_t>(buffer.st_size));
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Records of one file, held until it is the file's turn to be passed
+     * to `store`. A key is kept only when it differs from the key of the
+     * record before.
+    */
+    class Records {
+        private:
+            struct Entry {
+                std::size_t key_size;
+                std::size_t line_size;
+                int line_no;
+                bool new_key;
+            };
+
+            std::string data;
+            std::vector<Entry> entries;
+            std::string last_key;
+
+        public:
+            // counters of the file's extraction
+            extract::Stats stats;
+            // what the extraction threw, if anything
+            std::exception_ptr error;
+
+            void add(const std::string& key, const std::string& line, const int& line_no) {
+                bool new_key = entries.size() == 0 || key != last_key;
+                if (new_key) {
+                    data += key;
+                    last_key = key;
+                }
+                data += line;
+                entries.push_back(Entry{key.size(), line.size(), line_no, new_key});
+            }
+
+            /**
+             * @brief
+             * Bytes of memory held.
+            */
+            std::size_t size() const {
+                return(data.capacity() + entries.capacity() * sizeof(Entry));
+            }
+
+            /**
+             * @brief
+             * Pass the records to `store`, until `stopped()` returns `true`
+             * after a record. Returns `false` if stopped.
+            */
+            template<typename Store, typename Stopped>
+            bool replay(const Store& store, const Stopped& stopped) const {
+                std::string key;
+                std::string line;
+                std::size_t pos = 0;
+                for (const Entry& entry : entries) {
+                    if (entry.new_key) {
+                        key.assign(data, pos, entry.key_size);
+                        pos += entry.key_size;
+                    }
+                    line.assign(data, pos, entry.line_size);
+                    pos += entry.line_size;
+                    store(key, line, entry.line_no);
+                    if (stopped()) {
+                        return(false);
+                    }
+                }
+                return(true);
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Hands out the files of a run to workers: largest first from each
+     * worker's own queue, else stolen from the queue with the most bytes
+     * left, else (over the memory budget) in list order.
+    */
+    class Scheduler {
+        private:
+            struct Queue {
+                std::mutex mutex;
+                std::deque<std::size_t> files;
+                // weights of the unclaimed files of `files`
+                std::atomic<uint64_t> weight{0};
+            };
+
+            std::vector<uint64_t> weights;
+            std::vector<std::size_t> owners;
+            std::unique_ptr<std::atomic<bool>[]> claimed;
+            std::vector<std::unique_ptr<Queue>> queues;
+            std::mutex in_order_mutex;
+            std::size_t next_in_order = 0;
+
+            bool claim(const std::size_t& file) {
+                return(!claimed[file].exchange(true));
+            }
+
+            bool pop(Queue& queue, std::size_t& file) {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                while (queue.files.size() > 0) {
+                    std::size_t front = queue.files.front();
+                    queue.files.pop_front();
+                    if (claim(front)) {
+                        queue.weight -= weights[front];
+                        file = front;
+                        return(true);
+                    }
+                }
+                return(false);
+            }
+
+        public:
+            std::atomic<unsigned long long> steals{0};
+            std::atomic<unsigned long long> files_in_order{0};
+
+            /**
+             * @brief
+             * Spread the files of `file_paths` over `n_workers` queues,
+             * largest first, each to the queue with the least weight so far.
+            */
+            Scheduler(
+                const std::vector<std::string>& file_paths,
+                const unsigned int& n_workers
+            ) :
+                weights(file_paths.size()),
+                owners(file_paths.size()),
+                claimed(new std::atomic<bool>[file_paths.size()])
+            {
+                std::vector<std::size_t> order(file_paths.size());
+                for (std::size_t i = 0; i < file_paths.size(); ++i) {
+                    // + 1 so that empty files also weigh something
+                    weights[i] = file_size(file_paths[i]) + 1;
+                    order[i] = i;
+                    claimed[i] = false;
+                }
+                std::stable_sort(order.begin(), order.end(), [&](
+                    const std::size_t& a,
+                    const std::size_t& b
+                ) {
+                    return(weights[a] > weights[b]);
+                });
+                std::vector<uint64_t> loads(n_workers, 0);
+                for (unsigned int w = 0; w < n_workers; ++w) {
+                    queues.emplace_back(new Queue());
+                }
+                for (const std::size_t& file : order) {
+                    std::size_t w = static_cast<std::size_t>(
+                        std::min_element(loads.begin(), loads.end()) - loads.begin()
+                    );
+                    loads[w] += weights[file];
+                    owners[file] = w;
+                    queues[w]->files.push_back(file);
+                    queues[w]->weight += weights[file];
+                }
+            }
+
+            /**
+             * @brief
+             * Claim the next file for worker `w`; `false` once every file
+             * has been claimed.
+            */
+            bool next(const std::size_t& w, const bool& in_order, std::size_t& file) {
+                if (in_order) {
+                    std::lock_guard<std::mutex> lock(in_order_mutex);
+                    while (next_in_order < weights.size()) {
+                        std::size_t i = next_in_order;
+                        next_in_order += 1;
+                        if (claim(i)) {
+                            queues[owners[i]]->weight -= weights[i];
+                            files_in_order += 1;
+                            file = i;
+                            return(true);
+                        }
+                    }
+                    return(false);
+                }
+                if (pop(*queues[w], file)) {
+                    return(true);
+                }
+                while (true) {
+                    Queue* victim = nullptr;
+                    uint64_t victim_weight = 0;
+                    for (std::unique_ptr<Queue>& queue : queues) {
+                        uint64_t weight = queue->weight.load();
+                        if (weight > victim_weight) {
+                            victim = queue.get();
+                            victim_weight = weight;
+                        }
+                    }
+                    if (victim == nullptr) {
+                        return(false);
+                    }
+                    if (pop(*victim, file)) {
+                        steals += 1;
+                        return(true);
+                    }
+                }
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Extract keyed comments from the files at `file_paths` on
+     * `options.threads` worker threads and pass them to `store` on the
+     * calling thread, in the order of `extractor.extract(file_paths,
+     * store, stats)`. `stats` gets the counters of the files passed on.
+     * Throws what the first failing file (in list order) or `store` threw.
+     * @param report
+     * If not `nullptr`, filled in with what the scheduler did.
+    */
+    template<typename Store, typename = store::if_store<Store>>
+    void extract(
+        const extract::Extractor& extractor,
+        const std::vector<std::string>& file_paths,
+        const Store& store,
+        extract::Stats& stats,
+        const Options& options = Options(),
+        Report* report = nullptr
+    ) {
+        unsigned int n_threads = options.threads;
+        if (n_threads == 0) {
+            n_threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        if (file_paths.size() < n_threads) {
+            n_threads = static_cast<unsigned int>(std::max(file_paths.size(), std::size_t(1)));
+        }
+        if (report != nullptr) {
+            *report = Report();
+            report->threads = n_threads;
+        }
+        if (n_threads == 1) {
+            extractor.extract(file_paths, store, stats);
+            return;
+        }
+
+        Scheduler scheduler(file_paths, n_threads);
+        std::vector<std::unique_ptr<Records>> results(file_paths.size());
+        std::mutex mutex;
+        std::condition_variable done;
+        unsigned int workers_running = n_threads;
+        std::atomic<std::size_t> buffered{0};
+        std::size_t peak_buffered = 0;
+        std::atomic<bool> abort{false};
+        // thrown by workers' stores to leave a file once the run is over
+        struct Aborted {};
+
+        auto work = [&](const std::size_t& w) {
+            if (extractor.trace() != nullptr) {
+                extractor.trace()->name_thread("worker " + std::to_string(w));
+            }
+            std::size_t file;
+            while (!abort.load() && !extractor.stopped() && scheduler.next(
+                w, buffered.load() > options.memory_budget, file
+            )) {
+                std::unique_ptr<Records> records(new Records());
+                Records& r = *records;
+                try {
+                    extractor.extract(file_paths[file], [&r, &abort](
+                        const std::string& key,
+                        const std::string& line,
+                        const int& line_no
+                    ) {
+                        if (abort.load(std::memory_order_relaxed)) {
+                            throw Aborted();
+                        }
+                        r.add(key, line, line_no);
+                    }, r.stats);
+                } catch (const Aborted&) {
+                    break;
+                } catch (...) {
+                    r.error = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                buffered += r.size();
+                peak_buffered = std::max(peak_buffered, buffered.load());
+                results[file] = std::move(records);
+                done.notify_all();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            workers_running -= 1;
+            done.notify_all();
+        };
+
+        std::vector<std::thread> workers;
+        std::exception_ptr error;
+        try {
+            for (unsigned int w = 0; w < n_threads; ++w) {
+                workers.emplace_back(work, w);
+            }
+            auto stopped = [&extractor]() {
+                return(extractor.stopped());
+            };
+            for (std::size_t i = 0; i < file_paths.size(); ++i) {
+                std::unique_ptr<Records> records;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    if (results[i] == nullptr && workers_running > 0) {
+                        trace::Span span(extractor.trace(), "wait", "parallel", file_paths[i]);
+                        done.wait(lock, [&]() {
+                            return(results[i] != nullptr || workers_running == 0);
+                        });
+                    }
+                    records = std::move(results[i]);
+                }
+                // workers only leave files out once stopped
+                if (records == nullptr) {
+                    break;
+                }
+                buffered -= records->size();
+                stats.add(records->stats);
+                // a failing file's records up to the error are stored
+                if (!records->replay(store, stopped)) {
+                    break;
+                }
+                if (records->error != nullptr) {
+                    error = records->error;
+                    break;
+                }
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        abort = true;
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        if (report != nullptr) {
+            report->steals = scheduler.steals;
+            report->files_in_order = scheduler.files_in_order;
+            report->peak_buffered = peak_buffered;
+        }
+        if (error != nullptr) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    template<typename Store, typename = store::if_store<Store>>
+    void extract(
+        const extract::Extractor& extractor,
+        const std::vector<std::string>& file_paths,
+        const Store& store,
+        const Options& options = Options()
+    ) {
+        extract::Stats stats;
+        extract(extractor, file_paths, store, stats, options);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace parallel
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef REFERENCE_HPP
+#define REFERENCE_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <functional>
+
+#include "misc_utils.hpp"
+#include "keysets.hpp"
+#include "store.hpp"
+
+namespace extract {
+    namespace reference {
+        // ---------------------------------------------------------------------
+        // ---------------------------------------------------------------------
+        // ---------------------------------------------------------------------
+        /**
+         * @brief
+         * The original line loop: `std::getline` plus `std::regex` for every
+         * comment marker, tag and cleaning step. Slow, but it defines the
+         * semantics that faster engines must reproduce exactly; see
+         * `extract::Engine` and `differential::run`.
+         * @param input
+         * Stream to read until its end.
+         * @param multiline_comment_start
+         * See `kecx::extract::extract` for this and the remaining arguments.
+        */
+        inline void extract(
+            std::istream& input,
+            const std::string& multiline_comment_start,
+            const std::string& multiline_comment_stop,
+            const std::string& singleline_comment,
+            const std::vector<std::string>& header_only_tag_set,
+            const std::vector<std::string>& header_tag_set,
+            const std::vector<std::string>& footer_tag_set,
+            const std::vector<std::string>& either_tag_set,
+            const store::store_type& store,
+            const bool& store_only_comments_ho = true,
+            const bool& store_only_comments_hf = false,
+            const bool& store_only_comments_e  = false,
+            const int& verbosity = 0
+        )
+        {
+            // -----------------------------------------------------------------
+            // -----------------------------------------------------------------
+            bool search_for_multiline_comments = multiline_comment_start != "" &&
+                multiline_comment_stop != "";
+            bool search_for_singleline_comments = singleline_comment != "";
+            std::regex re_mlc_start = std::regex(multiline_comment_start);
+            std::regex re_mlc_stop = std::regex(multiline_comment_stop);
+            std::regex re_slc = std::regex(singleline_comment);
+
+            std::string clean_re_prefix = "[ ]*";
+            std::string clean_re_suffix = "[ ]?";
+            std::vector<std::regex> clean_re_set;
+            if (search_for_multiline_comments) {
+                clean_re_set.push_back(std::regex(
+                    clean_re_prefix + multiline_comment_start + clean_re_suffix
+                ));
+                clean_re_set.push_back(std::regex(
+                    clean_re_prefix + multiline_comment_stop + clean_re_suffix
+                ));
+            }
+            if (search_for_singleline_comments) {
+                clean_re_set.push_back(std::regex(
+                    clean_re_prefix + singleline_comment + clean_re_suffix
+                ));
+            }
+
+            // -----------------------------------------------------------------
+            // -----------------------------------------------------------------
+            keysets::KeySet key_set_ho;
+            keysets::KeySet key_set_hf;
+            keysets::KeySet key_set_e;
+
+            // header, footer --------------------------------------------------
+            bool search_for_hf = header_tag_set.size() > 0 &&
+                footer_tag_set.size() > 0;
+            std::regex re_hf_h;
+            std::regex re_hf_f;
+            if (search_for_hf) {
+                re_hf_h = utils::tag_set_to_regex(header_tag_set);
+                re_hf_f = utils::tag_set_to_regex(footer_tag_set);
+            }
+            // either ----------------------------------------------------------
+            bool search_for_e = either_tag_set.size() > 0;
+            std::regex re_e;
+            if (search_for_e) {
+                re_e = utils::tag_set_to_regex(either_tag_set);
+            }
+            // header_only -----------------------------------------------------
+            bool search_for_ho = header_only_tag_set.size() > 0;
+            std::regex re_ho;
+            if (search_for_ho) {
+                re_ho = utils::tag_set_to_regex(header_only_tag_set);
+            }
+
+            // -----------------------------------------------------------------
+            // -----------------------------------------------------------------
+            if (verbosity >= 1) {
+                std::cout <<
+                    "kecx::extract::extract: preparations done --- "
+                    << "starting while loop over lines"
+                    << std::endl;
+            }
+            int line_no = -1;
+            std::string line;
+            bool is_comment_line = false;
+            bool in_multiline_comment = false;
+            while (std::getline(input, line)) {
+                // -------------------------------------------------------------
+                // -------------------------------------------------------------
+                line_no += 1;
+                if (verbosity >= 2) {
+                    utils::print(line_no, "line_no");
+                }
+
+                // -------------------------------------------------------------
+                // comment detection -------------------------------------------
+                bool is_multiline_comment_start = false;
+                bool is_multiline_comment_stop = false;
+                if (search_for_multiline_comments) {
+                    if (in_multiline_comment) {
+                        // check whether multiline stops here
+                        is_multiline_comment_stop = utils::re_detect(
+                            line, re_mlc_stop
+                        );
+                        if (is_multiline_comment_stop) {
+                            in_multiline_comment = false;
+                            is_comment_line = true;
+                        }
+                    } else {
+                        // check whether multiline starts here
+                        is_multiline_comment_start = utils::re_detect(
+                            line, re_mlc_start
+                        );
+                        if (is_multiline_comment_start) {
+                            in_multiline_comment = true;
+                            is_comment_line = true;
+                        }
+                    }
+                }
+                // singleline comment detection --------------------------------
+                bool is_singleline_comment = false;
+                if (!in_multiline_comment && search_for_singleline_comments) {
+                    is_singleline_comment = utils::re_detect(line, re_slc);
+                    is_comment_line = is_singleline_comment;
+                }
+
+                // comment detection verbosity ---------------------------------
+                if (verbosity >= 2) {
+                    utils::print(is_multiline_comment_start, "is_multiline_comment_start");
+                    utils::print(is_multiline_comment_stop, "is_multiline_comment_stop");
+                    utils::print(in_multiline_comment, "in_multiline_comment");
+                    utils::print(is_singleline_comment, "is_singleline_comment");
+                    utils::print(is_comment_line, "is_comment_line");
+                }
+
+                // -------------------------------------------------------------
+                // key detection -----------------------------------------------
+                bool line_has_key = false;
+
+                // detect header -----------------------------------------------
+                // e.g. "// @start my_key"
+                std::string key_hf_h = "";
+                if (search_for_hf && is_comment_line && !line_has_key) {
+                    key_hf_h = utils::re_extract_last_group(line, re_hf_h);
+                    if (key_hf_h != "") {
+                        // found a header tag
+                        line_has_key = true;
+                        key_set_hf.activate(key_hf_h);
+                    }
+                }
+
+                // detect footer -----------------------------------------------
+                // e.g. "// @stop my_key"
+                std::string key_hf_f = "";
+                if (search_for_hf && is_comment_line && !line_has_key) {
+                    key_hf_f = utils::re_extract_last_group(line, re_hf_f);
+                    if (key_hf_f != "") {
+                        // found a footer tag
+                        line_has_key = true;
+                        key_set_hf.deactivate(key_hf_f);
+                    }
+                }
+
+                // detect either -----------------------------------------------
+                // e.g. "// @block my_key"
+                std::string key_e = "";
+                if (search_for_e && is_comment_line && !line_has_key) {
+                    key_e = utils::re_extract_last_group(line, re_e);
+                    if (key_e != "") {
+                        // found an either tag
+                        line_has_key = true;
+                        key_set_ho.deactivate_all();
+                        if (key_set_e.is_active(key_e)) {
+                            key_set_e.deactivate(key_e);
+                        } else {
+                            key_set_e.activate(key_e);
+                        }
+                    }
+                }
+
+                // detect header_only ------------------------------------------
+                // e.g. "// @chunk my_key"
+                std::string key_ho = "";
+                if (search_for_ho && is_comment_line && !line_has_key) {
+                    key_ho = utils::re_extract_last_group(line, re_ho);
+                }
+                if (key_ho != "") {
+                    // found a header_only tag
+                    line_has_key = true;
+                    key_set_ho.deactivate_all();
+                    key_set_ho.activate(key_ho);
+                } else if (!is_comment_line || line_has_key) {
+                    key_set_ho.deactivate_all();
+                }
+
+                // -------------------------------------------------------------
+                // key detection verbosity -------------------------------------
+                if (verbosity >= 2) {
+                    utils::print(line, "line");
+                    utils::print(key_set_ho.get(), "key_set_ho.get()");
+                    utils::print(key_set_hf.get(), "key_set_hf.get()");
+                    utils::print(key_set_e.get(), "key_set_e.get()");
+                    utils::print(line_has_key, "line_has_key");
+                }
+
+                // -------------------------------------------------------------
+                // store -------------------------------------------------------
+                bool store_hf = !line_has_key &&
+                    key_set_hf.size() > 0 &&
+                    (is_comment_line || !store_only_comments_hf);
+                bool store_e = !line_has_key &&
+                    key_set_e.size() > 0 &&
+                    (is_comment_line || !store_only_comments_e);
+                bool store_ho = !line_has_key &&
+                    key_set_ho.size() > 0 &&
+                    (is_comment_line || !store_only_comments_ho);
+                bool store_any = store_hf || store_e || store_ho;
+                std::string clean_line = line;
+                if (store_any) {
+                    for (auto clean_re : clean_re_set) {
+                        clean_line = std::regex_replace(
+                            clean_line,
+                            clean_re,
+                            "",
+                            std::regex_constants::format_first_only
+                        );
+                    }
+                    if (store_hf) {
+                        for (std::string key : key_set_hf.get()) {
+                            store(key, clean_line, line_no);
+                        }
+                    }
+                    if (store_e) {
+                        for (std::string key : key_set_e.get()) {
+                            store(key, clean_line, line_no);
+                        }
+                    }
+                    if (store_ho) {
+                        for (std::string key : key_set_ho.get()) {
+                            store(key, clean_line, line_no);
+                        }
+                    }
+                }
+
+                // -------------------------------------------------------------
+                // store verbosity ---------------------------------------------
+                if (verbosity >= 2) {
+                    utils::print(clean_line, "clean_line");
+                    utils::print(store_hf, "store_hf");
+                    utils::print(store_e, "store_e");
+                    utils::print(store_ho, "store_ho");
+                    utils::print(store_any, "store_any");
+                    if (verbosity >= 3) {
+                        utils::press_enter_to_proceed();
+                    }
+                }
+
+                // -------------------------------------------------------------
+                // -------------------------------------------------------------
+            }
+            // -----------------------------------------------------------------
+            // final checks ----------------------------------------------------
+            auto key_set_hf_at_end = key_set_hf.get();
+            if (key_set_hf_at_end.size() > 0) {
+                throw keysets::KeySetNotEmptyException(key_set_hf_at_end);
+            }
+
+            if (verbosity >= 1) {
+                std::cout <<
+                    "kecx::extract::extract: while loop done --- processed "
+                    << line_no << " lines in total"
+                    << std::endl;
+            }
+            // -----------------------------------------------------------------
+            // -----------------------------------------------------------------
+        }
+        // ---------------------------------------------------------------------
+        // ---------------------------------------------------------------------
+        // ---------------------------------------------------------------------
+    } // namespace reference
+} // namespace extract
+
+#endif
@@ -0,0 +1,1206 @@
+#ifndef RX_HPP
+#define RX_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <bitset>
+#include <regex>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+
+namespace rx {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Built-in regex engine
+    //
+    // Comment markers and tags that are not plain literals (e.g. `"[#]+"`,
+    // `"^"`) are matched by `kecx::rx::Regex` instead of `std::regex`. It
+    // handles the subset of ECMAScript regexes kecx needs --- characters,
+    // `.`, classes such as `[a-z_]` and `\d \w \s`, groups `(...)` and
+    // `(?:...)`, alternation, greedy and lazy quantifiers `* + ? {n,m}` and
+    // the anchors `^` and `$` --- with the same results as `std::regex`.
+    // Patterns are compiled into an NFA. Whether a line matches at all is
+    // decided by a lazily built, cached DFA in one pass without
+    // backtracking; capture groups are only computed for matching lines, by
+    // a Pike VM with `std::regex`'s leftmost-first priorities. Both run in
+    // time linear in the line length and without recursion. Anything
+    // outside the subset (backreferences, lookaheads, `\b`, `[[:alpha:]]`,
+    // ...) is left to `std::regex`.
+    //
+    // @docstop README.md
+
+    /**
+     * @brief
+     * Positions of the groups of a match; group 0 is the whole match. An
+     * unmatched group is `(nullptr, nullptr)`.
+    */
+    struct Match {
+        std::vector<std::pair<const char*, const char*>> groups;
+
+        std::size_t size() const {
+            return(groups.size());
+        }
+
+        bool matched(const std::size_t& i) const {
+            return(groups[i].first != nullptr);
+        }
+
+        std::string_view view(const std::size_t& i) const {
+            if (!matched(i)) {
+                return(std::string_view());
+            }
+            return(std::string_view(
+                groups[i].first, groups[i].second - groups[i].first
+            ));
+        }
+
+        std::string str(const std::size_t& i) const {
+            return(std::string(view(i)));
+        }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // compiled program ---------------------------------------------------------
+    typedef std::bitset<256> ByteSet;
+
+    struct Inst {
+        enum Op {
+            byte,       // consume a byte in `sets[set]`, continue at `x`
+            split,      // continue at `x`, then (lower priority) at `y`
+            jump,       // continue at `x`
+            save,       // record the position in capture slot `slot`
+            begin,      // assert start of input
+            end,        // assert end of input
+            match
+        };
+        Op op;
+        int x = -1;
+        int y = -1;
+        int set = -1;
+        int slot = -1;
+    };
+
+    struct Program {
+        std::vector<Inst> insts;
+        std::vector<ByteSet> sets;
+        std::size_t n_groups = 0;
+        // unique in the process, see `thread_dfa`
+        uint64_t id = 0;
+    };
+
+    inline uint64_t new_program_id() {
+        static std::atomic<uint64_t> next{0};
+        return(++next);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // parser ------------------------------------------------------------------
+    /**
+     * @brief
+     * Parses a pattern into a tree and compiles it. `ok` is `false` if the
+     * pattern uses anything outside the supported subset, or anything whose
+     * `std::regex` semantics this engine does not reproduce exactly (such
+     * as quantified groups or quantified sub-patterns that can match the
+     * empty string).
+    */
+    class Compiler {
+        private:
+            struct Node {
+                enum Kind {empty, set, concat, alt, repeat, group, begin, end};
+                Kind kind;
+                std::vector<int> children;
+                int set_index = -1;
+                int min = 0;
+                int max = 0;   // -1: unbounded
+                bool greedy = true;
+                int group_index = 0;
+            };
+
+            const std::string& pattern;
+            std::size_t i = 0;
+            std::vector<Node> nodes;
+            Program& program;
+            int n_groups = 0;
+            static constexpr std::size_t max_insts = 10000;
+
+            int add(const Node& node) {
+                nodes.push_back(node);
+                return(static_cast<int>(nodes.size() - 1));
+            }
+
+            int add_set(const ByteSet& set) {
+                program.sets.push_back(set);
+                Node node;
+                node.kind = Node::set;
+                node.set_index = static_cast<int>(program.sets.size() - 1);
+                return(add(node));
+            }
+
+            bool at_end() const {
+                return(i >= pattern.size());
+            }
+
+            static ByteSet class_set(const char& c) {
+                ByteSet s;
+                for (int b = 0; b < 256; ++b) {
+                    bool in = false;
+                    if (c == 'd' || c == 'D') {
+                        in = b >= '0' && b <= '9';
+                    } else if (c == 'w' || c == 'W') {
+                        in = (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') ||
+                            (b >= '0' && b <= '9') || b == '_';
+                    } else if (c == 's' || c == 'S') {
+                        in = b == ' ' || (b >= '\t' && b <= '\r');
+                    }
+                    s[b] = in;
+                }
+                if (c == 'D' || c == 'W' || c == 'S') {
+                    s.flip();
+                }
+                return(s);
+            }
+
+            static int hex_value(const char& c) {
+                if (c >= '0' && c <= '9') {
+                    return(c - '0');
+                }
+                if (c >= 'a' && c <= 'f') {
+                    return(c - 'a' + 10);
+                }
+                if (c >= 'A' && c <= 'F') {
+                    return(c - 'A' + 10);
+                }
+                return(-1);
+            }
+
+            /**
+             * @brief
+             * Parse the escape after a `'\\'` at `i - 1`. Sets `byte` for a
+             * single byte, or `set` for a class escape.
+            */
+            bool parse_escape(int& byte, ByteSet& set, bool& is_set, const bool& in_class) {
+                if (at_end()) {
+                    return(false);
+                }
+                char c = pattern[i++];
+                is_set = false;
+                switch (c) {
+                    case 'd': case 'D': case 'w': case 'W': case 's': case 'S':
+                        is_set = true;
+                        set = class_set(c);
+                        return(true);
+                    case 't': byte = '\t'; return(true);
+                    case 'n': byte = '\n'; return(true);
+                    case 'r': byte = '\r'; return(true);
+                    case 'f': byte = '\f'; return(true);
+                    case 'v': byte = '\v'; return(true);
+                    case '0':
+                        if (!at_end() && pattern[i] >= '0' && pattern[i] <= '9') {
+                            return(false);
+                        }
+                        byte = 0;
+                        return(true);
+                    case 'x': {
+                        if (i + 2 > pattern.size()) {
+                            return(false);
+                        }
+                        int hi = hex_value(pattern[i]);
+                        int lo = hex_value(pattern[i + 1]);
+                        if (hi < 0 || lo < 0) {
+                            return(false);
+                        }
+                        i += 2;
+                        byte = hi * 16 + lo;
+                        return(true);
+                    }
+                    default:
+                        break;
+                }
+                unsigned char u = static_cast<unsigned char>(c);
+                if (u < 0x80 && std::ispunct(u) && !(in_class && c == 'b')) {
+                    byte = u;
+                    return(true);
+                }
+                // backreferences, \b, \B, \c, \u, ...
+                return(false);
+            }
+
+            bool parse_class(int& node) {
+                // at i: after '['
+                ByteSet set;
+                bool negate = false;
+                if (!at_end() && pattern[i] == '^') {
+                    negate = true;
+                    i += 1;
+                }
+                bool first = true;
+                while (true) {
+                    if (at_end()) {
+                        return(false);
+                    }
+                    char c = pattern[i];
+                    if (c == ']' && !first) {
+                        i += 1;
+                        break;
+                    }
+                    if (c == ']' || c == '[') {
+                        // "[]...]" and "[[:alpha:]]" are left to std::regex
+                        return(false);
+                    }
+                    first = false;
+                    int lo = -1;
+                    i += 1;
+                    if (c == '\\') {
+                        ByteSet escape_set;
+                        bool is_set = false;
+                        if (!parse_escape(lo, escape_set, is_set, true)) {
+                            return(false);
+                        }
+                        if (is_set) {
+                            set |= escape_set;
+                            if (!at_end() && pattern[i] == '-' &&
+                                    i + 1 < pattern.size() && pattern[i + 1] != ']') {
+                                return(false);
+                            }
+                            continue;
+                        }
+                    } else {
+                        lo = static_cast<unsigned char>(c);
+                    }
+                    if (i + 1 < pattern.size() && pattern[i] == '-' && pattern[i + 1] != ']') {
+                        i += 1;
+                        char h = pattern[i++];
+                        int hi = static_cast<unsigned char>(h);
+                        if (h == '\\' || h == '[') {
+                            return(false);
+                        }
+                        if (hi < lo || hi >= 0x80) {
+                            // std::regex compares range bounds as plain
+                            // (signed) chars
+                            return(false);
+                        }
+                        for (int b = lo; b <= hi; ++b) {
+                            set[b] = true;
+                        }
+                    } else {
+                        set[lo] = true;
+                    }
+                }
+                if (negate) {
+                    set.flip();
+                }
+                node = add_set(set);
+                return(true);
+            }
+
+            bool parse_atom(int& node) {
+                char c = pattern[i++];
+                switch (c) {
+                    case '.': {
+                        ByteSet set;
+                        set.set();
+                        set['\n'] = false;
+                        set['\r'] = false;
+                        node = add_set(set);
+                        return(true);
+                    }
+                    case '[':
+                        return(parse_class(node));
+                    case '(': {
+                        int group = -1;
+                        if (!at_end() && pattern[i] == '?') {
+                            if (i + 1 < pattern.size() && pattern[i + 1] == ':') {
+                                i += 2;
+                            } else {
+                                return(false);
+                            }
+                        } else {
+                            group = ++n_groups;
+                        }
+                        int inner;
+                        if (!parse_alt(inner)) {
+                            return(false);
+                        }
+                        if (at_end() || pattern[i] != ')') {
+                            return(false);
+                        }
+                        i += 1;
+                        if (group < 0) {
+                            node = inner;
+                        } else {
+                            Node g;
+                            g.kind = Node::group;
+                            g.group_index = group;
+                            g.children.push_back(inner);
+                            node = add(g);
+                        }
+                        return(true);
+                    }
+                    case '^': {
+                        Node n;
+                        n.kind = Node::begin;
+                        node = add(n);
+                        return(true);
+                    }
+                    case '$': {
+                        Node n;
+                        n.kind = Node::end;
+                        node = add(n);
+                        return(true);
+                    }
+                    case '\\': {
+                        int byte = -1;
+                        ByteSet set;
+                        bool is_set = false;
+                        if (!parse_escape(byte, set, is_set, false)) {
+                            return(false);
+                        }
+                        if (!is_set) {
+                            set[byte] = true;
+                        }
+                        node = add_set(set);
+                        return(true);
+                    }
+                    case '*': case '+': case '?': case '{': case '}': case ']': case ')':
+                        return(false);
+                    default: {
+                        ByteSet set;
+                        set[static_cast<unsigned char>(c)] = true;
+                        node = add_set(set);
+                        return(true);
+                    }
+                }
+            }
+
+            bool parse_number(int& value) {
+                std::size_t start = i;
+                value = 0;
+                while (!at_end() && pattern[i] >= '0' && pattern[i] <= '9') {
+                    value = value * 10 + (pattern[i] - '0');
+                    if (value > 1000) {
+                        return(false);
+                    }
+                    i += 1;
+                }
+                return(i > start);
+            }
+
+            bool parse_quantifier(int& min, int& max) {
+                char c = pattern[i];
+                if (c == '*') {
+                    min = 0;
+                    max = -1;
+                } else if (c == '+') {
+                    min = 1;
+                    max = -1;
+                } else if (c == '?') {
+                    min = 0;
+                    max = 1;
+                } else {
+                    // '{'
+                    i += 1;
+                    if (!parse_number(min)) {
+                        return(false);
+                    }
+                    max = min;
+                    if (!at_end() && pattern[i] == ',') {
+                        i += 1;
+                        max = -1;
+                        if (!at_end() && pattern[i] != '}') {
+                            if (!parse_number(max) || max < min) {
+                                return(false);
+                            }
+                        }
+                    }
+                    if (at_end() || pattern[i] != '}') {
+                        return(false);
+                    }
+                }
+                i += 1;
+                return(true);
+            }
+
+            bool parse_concat(int& node) {
+                Node concat;
+                concat.kind = Node::concat;
+                while (!at_end() && pattern[i] != '|' && pattern[i] != ')') {
+                    int atom;
+                    if (!parse_atom(atom)) {
+                        return(false);
+                    }
+                    while (!at_end() && (pattern[i] == '*' || pattern[i] == '+' ||
+                            pattern[i] == '?' || pattern[i] == '{')) {
+                        Node repeat;
+                        repeat.kind = Node::repeat;
+                        if (!parse_quantifier(repeat.min, repeat.max)) {
+                            return(false);
+                        }
+                        if (!at_end() && pattern[i] == '?') {
+                            repeat.greedy = false;
+                            i += 1;
+                        }
+                        Node::Kind kind = nodes[atom].kind;
+                        if (kind == Node::begin || kind == Node::end) {
+                            return(false);
+                        }
+                        repeat.children.push_back(atom);
+                        atom = add(repeat);
+                    }
+                    concat.children.push_back(atom);
+                }
+                node = add(concat);
+                return(true);
+            }
+
+            bool parse_alt(int& node) {
+                Node alt;
+                alt.kind = Node::alt;
+                while (true) {
+                    int branch;
+                    if (!parse_concat(branch)) {
+                        return(false);
+                    }
+                    alt.children.push_back(branch);
+                    if (at_end() || pattern[i] != '|') {
+                        break;
+                    }
+                    i += 1;
+                }
+                if (alt.children.size() == 1) {
+                    node = alt.children[0];
+                } else {
+                    node = add(alt);
+                }
+                return(true);
+            }
+
+            // checks ----------------------------------------------------------
+            bool nullable(const int& n) const {
+                const Node& node = nodes[n];
+                switch (node.kind) {
+                    case Node::set:
+                        return(false);
+                    case Node::concat:
+                        for (int c : node.children) {
+                            if (!nullable(c)) {
+                                return(false);
+                            }
+                        }
+                        return(true);
+                    case Node::alt:
+                        for (int c : node.children) {
+                            if (nullable(c)) {
+                                return(true);
+                            }
+                        }
+                        return(false);
+                    case Node::repeat:
+                        return(node.min == 0 || nullable(node.children[0]));
+                    case Node::group:
+                        return(nullable(node.children[0]));
+                    default:
+                        return(true);
+                }
+            }
+
+            bool has_group(const int& n) const {
+                const Node& node = nodes[n];
+                if (node.kind == Node::group) {
+                    return(true);
+                }
+                for (int c : node.children) {
+                    if (has_group(c)) {
+                        return(true);
+                    }
+                }
+                return(false);
+            }
+
+            bool supported(const int& n) const {
+                const Node& node = nodes[n];
+                if (node.kind == Node::repeat && node.max != 1 &&
+                        (nullable(node.children[0]) || has_group(node.children[0]))) {
+                    // std::regex's rules for empty iterations and for
+                    // resetting groups on each iteration
+                    return(false);
+                }
+                for (int c : node.children) {
+                    if (!supported(c)) {
+                        return(false);
+                    }
+                }
+                return(true);
+            }
+
+            // code generation -------------------------------------------------
+            int emit(const Inst::Op& op) {
+                Inst inst;
+                inst.op = op;
+                program.insts.push_back(inst);
+                return(static_cast<int>(program.insts.size() - 1));
+            }
+
+            /**
+             * @brief
+             * Emit code for node `n`; all dangling exits are patched to the
+             * instruction emitted next.
+            */
+            bool compile(const int& n) {
+                if (program.insts.size() > max_insts) {
+                    return(false);
+                }
+                const Node& node = nodes[n];
+                switch (node.kind) {
+                    case Node::empty:
+                        return(true);
+                    case Node::set: {
+                        int pc = emit(Inst::byte);
+                        program.insts[pc].set = node.set_index;
+                        program.insts[pc].x = pc + 1;
+                        return(true);
+                    }
+                    case Node::begin:
+                    case Node::end: {
+                        int pc = emit(node.kind == Node::begin ? Inst::begin : Inst::end);
+                        program.insts[pc].x = pc + 1;
+                        return(true);
+                    }
+                    case Node::concat:
+                        for (int c : node.children) {
+                            if (!compile(c)) {
+                                return(false);
+                            }
+                        }
+                        return(true);
+                    case Node::group: {
+                        int pc = emit(Inst::save);
+                        program.insts[pc].slot = 2 * node.group_index;
+                        program.insts[pc].x = pc + 1;
+                        if (!compile(node.children[0])) {
+                            return(false);
+                        }
+                        pc = emit(Inst::save);
+                        program.insts[pc].slot = 2 * node.group_index + 1;
+                        program.insts[pc].x = pc + 1;
+                        return(true);
+                    }
+                    case Node::alt: {
+                        std::vector<int> jumps;
+                        for (std::size_t k = 0; k < node.children.size(); ++k) {
+                            int split = -1;
+                            if (k + 1 < node.children.size()) {
+                                split = emit(Inst::split);
+                                program.insts[split].x = split + 1;
+                            }
+                            if (!compile(node.children[k])) {
+                                return(false);
+                            }
+                            if (k + 1 < node.children.size()) {
+                                jumps.push_back(emit(Inst::jump));
+                                program.insts[split].y =
+                                    static_cast<int>(program.insts.size());
+                            }
+                        }
+                        for (int j : jumps) {
+                            program.insts[j].x = static_cast<int>(program.insts.size());
+                        }
+                        return(true);
+                    }
+                    case Node::repeat: {
+                        int child = node.children[0];
+                        for (int k = 0; k < node.min; ++k) {
+                            if (!compile(child)) {
+                                return(false);
+                            }
+                        }
+                        if (node.max < 0) {
+                            // L: split body, out; body; jump L
+                            int split = emit(Inst::split);
+                            if (!compile(child)) {
+                                return(false);
+                            }
+                            int jump = emit(Inst::jump);
+                            program.insts[jump].x = split;
+                            set_split(split, split + 1, jump + 1, node.greedy);
+                            return(true);
+                        }
+                        std::vector<int> splits;
+                        for (int k = node.min; k < node.max; ++k) {
+                            splits.push_back(emit(Inst::split));
+                            if (!compile(child)) {
+                                return(false);
+                            }
+                        }
+                        int out = static_cast<int>(program.insts.size());
+                        for (int split : splits) {
+                            set_split(split, split + 1, out, node.greedy);
+                        }
+                        return(true);
+                    }
+                }
+                return(false);
+            }
+
+            void set_split(const int& split, const int& body, const int& out, const bool& greedy) {
+                program.insts[split].x = greedy ? body : out;
+                program.insts[split].y = greedy ? out : body;
+            }
+
+        public:
+            bool ok = false;
+
+            Compiler(const std::string& pattern, Program& program) :
+                pattern(pattern),
+                program(program)
+            {
+                int root;
+                if (!parse_alt(root) || !at_end() || !supported(root)) {
+                    return;
+                }
+                program.n_groups = static_cast<std::size_t>(n_groups) + 1;
+                // save 0; body; save 1; match
+                int pc = emit(Inst::save);
+                program.insts[pc].slot = 0;
+                program.insts[pc].x = pc + 1;
+                if (!compile(root)) {
+                    return;
+                }
+                pc = emit(Inst::save);
+                program.insts[pc].slot = 1;
+                program.insts[pc].x = pc + 1;
+                emit(Inst::match);
+                ok = program.insts.size() <= max_insts;
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // lazy DFA ------------------------------------------------------------------
+    /**
+     * @brief
+     * DFA states built on demand from sets of NFA instructions. It only
+     * answers whether a match exists somewhere in the input. A state is the
+     * set of `byte`, `match` and pending `end` instructions reachable at a
+     * position; transitions are computed the first time they are taken and
+     * then cached. If the cache grows beyond `max_states` it is cleared.
+    */
+    class Dfa {
+        private:
+            struct State {
+                std::vector<int> insts;
+                bool has_match = false;
+                // -1: not computed yet
+                int accepts_at_end = -1;
+                int next[256];
+            };
+
+            struct Hash {
+                std::size_t operator()(const std::vector<int>& v) const {
+                    std::size_t h = 1469598103934665603ull;
+                    for (int x : v) {
+                        h = (h ^ static_cast<std::size_t>(x)) * 1099511628211ull;
+                    }
+                    return(h);
+                }
+            };
+
+            const Program& program;
+            std::vector<State> states;
+            std::unordered_map<std::vector<int>, int, Hash> index;
+            int start_state = -1;
+            // scratch
+            std::vector<int> stack;
+            std::vector<int> seen;
+            int seen_mark = 0;
+            static constexpr std::size_t max_states = 2000;
+
+            void closure(
+                const int& pc0,
+                const bool& at_start,
+                const bool& at_end,
+                std::vector<int>& out
+            ) {
+                stack.push_back(pc0);
+                while (!stack.empty()) {
+                    int pc = stack.back();
+                    stack.pop_back();
+                    if (seen[pc] == seen_mark) {
+                        continue;
+                    }
+                    seen[pc] = seen_mark;
+                    const Inst& inst = program.insts[pc];
+                    switch (inst.op) {
+                        case Inst::jump:
+                        case Inst::save:
+                            stack.push_back(inst.x);
+                            break;
+                        case Inst::split:
+                            stack.push_back(inst.y);
+                            stack.push_back(inst.x);
+                            break;
+                        case Inst::begin:
+                            if (at_start) {
+                                stack.push_back(inst.x);
+                            }
+                            break;
+                        case Inst::end:
+                            if (at_end) {
+                                stack.push_back(inst.x);
+                            } else {
+                                out.push_back(pc);
+                            }
+                            break;
+                        case Inst::byte:
+                        case Inst::match:
+                            out.push_back(pc);
+                            break;
+                    }
+                }
+            }
+
+            void new_mark() {
+                seen_mark += 1;
+                if (seen_mark == 0) {
+                    std::fill(seen.begin(), seen.end(), -1);
+                    seen_mark = 1;
+                }
+            }
+
+            int state_for(std::vector<int>& insts) {
+                std::sort(insts.begin(), insts.end());
+                auto it = index.find(insts);
+                if (it != index.end()) {
+                    return(it->second);
+                }
+                State state;
+                state.insts = insts;
+                for (int pc : insts) {
+                    if (program.insts[pc].op == Inst::match) {
+                        state.has_match = true;
+                    }
+                }
+                std::fill(state.next, state.next + 256, -1);
+                states.push_back(std::move(state));
+                int id = static_cast<int>(states.size() - 1);
+                index.emplace(insts, id);
+                return(id);
+            }
+
+            int step(const int& from, const unsigned char& c) {
+                std::vector<int> insts;
+                new_mark();
+                for (int pc : states[from].insts) {
+                    const Inst& inst = program.insts[pc];
+                    if (inst.op == Inst::byte && program.sets[inst.set][c]) {
+                        closure(inst.x, false, false, insts);
+                    }
+                }
+                // unanchored search: a match may also start at the next byte
+                closure(0, false, false, insts);
+                if (states.size() >= max_states) {
+                    std::vector<int> keep = states[from].insts;
+                    states.clear();
+                    index.clear();
+                    start_state = -1;
+                    int new_from = state_for(keep);
+                    int to = state_for(insts);
+                    states[new_from].next[c] = to;
+                    return(to);
+                }
+                int to = state_for(insts);
+                states[from].next[c] = to;
+                return(to);
+            }
+
+            bool accepts_at_end(const int& s, const bool& at_start) {
+                if (!at_start && states[s].accepts_at_end >= 0) {
+                    return(states[s].accepts_at_end == 1);
+                }
+                std::vector<int> insts;
+                new_mark();
+                for (int pc : states[s].insts) {
+                    closure(pc, at_start, true, insts);
+                }
+                bool accepts = false;
+                for (int pc : insts) {
+                    if (program.insts[pc].op == Inst::match) {
+                        accepts = true;
+                    }
+                }
+                if (!at_start) {
+                    states[s].accepts_at_end = accepts;
+                }
+                return(accepts);
+            }
+
+        public:
+            Dfa(const Program& program) :
+                program(program),
+                seen(program.insts.size(), -1)
+            {}
+
+            bool search(const char* begin, const char* end) {
+                if (start_state < 0) {
+                    std::vector<int> insts;
+                    new_mark();
+                    closure(0, true, false, insts);
+                    start_state = state_for(insts);
+                }
+                int s = start_state;
+                const unsigned char* p = reinterpret_cast<const unsigned char*>(begin);
+                const unsigned char* e = reinterpret_cast<const unsigned char*>(end);
+                for (; p < e; ++p) {
+                    if (states[s].has_match) {
+                        return(true);
+                    }
+                    int next = states[s].next[*p];
+                    s = next >= 0 ? next : step(s, *p);
+                    if (states[s].insts.empty()) {
+                        return(false);
+                    }
+                }
+                if (states[s].has_match) {
+                    return(true);
+                }
+                return(accepts_at_end(s, begin == end));
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // Pike VM -------------------------------------------------------------------
+    /**
+     * @brief
+     * Leftmost-first search with captures: threads are kept in priority
+     * order, so the match found is the one a backtracking matcher would
+     * find first. Runs in O(input size * program size).
+    */
+    inline bool pike_search(
+        const Program& program,
+        const char* begin,
+        const char* end,
+        Match& match
+    ) {
+        const std::size_t n_insts = program.insts.size();
+        const std::size_t n_slots = 2 * program.n_groups;
+        const std::size_t n = static_cast<std::size_t>(end - begin);
+
+        struct ThreadList {
+            std::vector<int> dense;
+            std::vector<int> sparse;
+            std::vector<std::ptrdiff_t> caps;
+
+            ThreadList(const std::size_t& n_insts, const std::size_t& n_slots) :
+                sparse(n_insts, -1),
+                caps(n_insts * n_slots, -1)
+            {
+                dense.reserve(n_insts);
+            }
+            bool contains(const int& pc) const {
+                int k = sparse[pc];
+                return(k >= 0 && k < static_cast<int>(dense.size()) && dense[k] == pc);
+            }
+            void insert(const int& pc) {
+                sparse[pc] = static_cast<int>(dense.size());
+                dense.push_back(pc);
+            }
+        };
+        ThreadList current(n_insts, n_slots);
+        ThreadList next(n_insts, n_slots);
+
+        // explicit stack instead of recursion: either explore `pc` or
+        // restore capture slot `slot` to `value`
+        struct Frame {
+            int pc;
+            int slot;
+            std::ptrdiff_t value;
+        };
+        std::vector<Frame> stack;
+        std::vector<std::ptrdiff_t> caps(n_slots, -1);
+
+        auto add_thread = [&](
+            ThreadList& list,
+            const int& pc0,
+            const std::ptrdiff_t* from_caps,
+            const std::size_t& pos
+        ) {
+            std::copy(from_caps, from_caps + n_slots, caps.begin());
+            stack.push_back(Frame{pc0, -1, 0});
+            while (!stack.empty()) {
+                Frame frame = stack.back();
+                stack.pop_back();
+                if (frame.slot >= 0) {
+                    caps[frame.slot] = frame.value;
+                    continue;
+                }
+                int pc = frame.pc;
+                if (list.contains(pc)) {
+                    continue;
+                }
+                list.insert(pc);
+                const Inst& inst = program.insts[pc];
+                switch (inst.op) {
+                    case Inst::jump:
+                        stack.push_back(Frame{inst.x, -1, 0});
+                        break;
+                    case Inst::split:
+                        stack.push_back(Frame{inst.y, -1, 0});
+                        stack.push_back(Frame{inst.x, -1, 0});
+                        break;
+                    case Inst::save:
+                        stack.push_back(Frame{-1, inst.slot, caps[inst.slot]});
+                        caps[inst.slot] = static_cast<std::ptrdiff_t>(pos);
+                        stack.push_back(Frame{inst.x, -1, 0});
+                        break;
+                    case Inst::begin:
+                        if (pos == 0) {
+                            stack.push_back(Frame{inst.x, -1, 0});
+                        }
+                        break;
+                    case Inst::end:
+                        if (pos == n) {
+                            stack.push_back(Frame{inst.x, -1, 0});
+                        }
+                        break;
+                    case Inst::byte:
+                    case Inst::match:
+                        std::copy(
+                            caps.begin(), caps.end(),
+                            list.caps.begin() + static_cast<std::size_t>(pc) * n_slots
+                        );
+                        break;
+                }
+            }
+        };
+
+        std::vector<std::ptrdiff_t> no_caps(n_slots, -1);
+        std::vector<std::ptrdiff_t> best;
+        bool matched = false;
+        for (std::size_t pos = 0; ; ++pos) {
+            if (!matched) {
+                add_thread(current, 0, no_caps.data(), pos);
+            }
+            if (current.dense.empty()) {
+                break;
+            }
+            for (std::size_t k = 0; k < current.dense.size(); ++k) {
+                int pc = current.dense[k];
+                const Inst& inst = program.insts[pc];
+                const std::ptrdiff_t* thread_caps =
+                    current.caps.data() + static_cast<std::size_t>(pc) * n_slots;
+                if (inst.op == Inst::match) {
+                    matched = true;
+                    best.assign(thread_caps, thread_caps + n_slots);
+                    // threads of lower priority are cut
+                    break;
+                }
+                if (inst.op == Inst::byte && pos < n &&
+                        program.sets[inst.set][static_cast<unsigned char>(begin[pos])]) {
+                    add_thread(next, inst.x, thread_caps, pos + 1);
+                }
+            }
+            if (pos == n) {
+                break;
+            }
+            std::swap(current, next);
+            next.dense.clear();
+        }
+        if (!matched) {
+            return(false);
+        }
+        match.groups.assign(program.n_groups, std::make_pair(nullptr, nullptr));
+        for (std::size_t g = 0; g < program.n_groups; ++g) {
+            if (best[2 * g] >= 0 && best[2 * g + 1] >= 0) {
+                match.groups[g] = std::make_pair(
+                    begin + best[2 * g], begin + best[2 * g + 1]
+                );
+            }
+        }
+        return(true);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * The calling thread's `Dfa` of `program`, built on first use. Every
+     * thread keeps its own DFAs, so that threads sharing a `Regex` match
+     * without a lock. DFAs of programs no longer used by any `Regex` are
+     * dropped as new ones are added.
+    */
+    inline Dfa& thread_dfa(const std::shared_ptr<const Program>& program) {
+        struct Entry {
+            std::weak_ptr<const Program> program;
+            std::unique_ptr<Dfa> dfa;
+        };
+        thread_local std::unordered_map<uint64_t, Entry> dfas;
+        thread_local std::size_t prune_at = 64;
+        auto it = dfas.find(program->id);
+        if (it != dfas.end()) {
+            return(*it->second.dfa);
+        }
+        if (dfas.size() >= prune_at) {
+            for (it = dfas.begin(); it != dfas.end();) {
+                if (it->second.program.expired()) {
+                    it = dfas.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            prune_at = std::max(std::size_t(64), 2 * dfas.size());
+        }
+        Entry& entry = dfas[program->id];
+        entry.program = program;
+        entry.dfa.reset(new Dfa(*program));
+        return(*entry.dfa);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * A compiled regex with `std::regex`'s ECMAScript semantics. Patterns
+     * the built-in engine does not support are matched with `std::regex`;
+     * invalid patterns throw `std::regex_error` like `std::regex` does.
+     * Matching is safe from several threads; each thread uses its own
+     * DFA cache (see `thread_dfa`).
+    */
+    class Regex {
+        private:
+            std::string pattern_;
+            std::shared_ptr<const std::regex> fallback;
+            std::shared_ptr<const Program> program;
+
+            void compile() {
+                // also reports invalid patterns exactly as std::regex does
+                auto re = std::make_shared<const std::regex>(pattern_);
+                auto p = std::make_shared<Program>();
+                Compiler compiler(pattern_, *p);
+                if (compiler.ok) {
+                    p->id = new_program_id();
+                    program = p;
+                } else {
+                    fallback = re;
+                }
+            }
+
+        public:
+            Regex() : Regex("") {}
+
+            Regex(const std::string& pattern) : pattern_(pattern) {
+                compile();
+            }
+
+            Regex(const Regex&) = default;
+            Regex& operator=(const Regex&) = default;
+            Regex(Regex&&) = default;
+            Regex& operator=(Regex&&) = default;
+
+            const std::string& pattern() const {
+                return(pattern_);
+            }
+
+            /**
+             * @brief
+             * `true` if the pattern is handled by the built-in engine,
+             * `false` if it is left to `std::regex`.
+            */
+            bool is_builtin() const {
+                return(program != nullptr);
+            }
+
+            /**
+             * @brief
+             * Number of capture groups plus one, like `std::smatch::size()`
+             * after a match.
+            */
+            std::size_t n_groups() const {
+                if (program) {
+                    return(program->n_groups);
+                }
+                return(fallback->mark_count() + 1);
+            }
+
+            /**
+             * @brief
+             * Same as `std::regex_search(begin, end, re)`.
+            */
+            bool search(const char* begin, const char* end) const {
+                if (!program) {
+                    return(std::regex_search(begin, end, *fallback));
+                }
+                return(thread_dfa(program).search(begin, end));
+            }
+
+            bool search(const std::string_view& x) const {
+                return(search(x.data(), x.data() + x.size()));
+            }
+
+            /**
+             * @brief
+             * Same as `std::regex_search(begin, end, m, re)`: find the first
+             * match and its groups.
+            */
+            bool search(const char* begin, const char* end, Match& match) const {
+                if (!program) {
+                    std::cmatch m;
+                    if (!std::regex_search(begin, end, m, *fallback)) {
+                        return(false);
+                    }
+                    match.groups.assign(m.size(), std::make_pair(nullptr, nullptr));
+                    for (std::size_t g = 0; g < m.size(); ++g) {
+                        if (m[g].matched) {
+                            match.groups[g] = std::make_pair(m[g].first, m[g].second);
+                        }
+                    }
+                    return(true);
+                }
+                // most inputs do not match; let the DFA reject those
+                if (!search(begin, end)) {
+                    return(false);
+                }
+                return(pike_search(*program, begin, end, match));
+            }
+
+            bool search(const std::string_view& x, Match& match) const {
+                return(search(x.data(), x.data() + x.size(), match));
+            }
+
+            /**
+             * @brief
+             * Same as `std::regex_replace(x, re, "", format_first_only)`:
+             * remove the first match from `x`, in place.
+            */
+            void erase_first(std::string& x) const {
+                Match m;
+                if (!search(x.data(), x.data() + x.size(), m)) {
+                    return;
+                }
+                std::size_t first = static_cast<std::size_t>(m.groups[0].first - x.data());
+                std::size_t last = static_cast<std::size_t>(m.groups[0].second - x.data());
+                x.erase(first, last - first);
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace rx
+
+#endif
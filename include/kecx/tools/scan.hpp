@@ -0,0 +1,475 @@
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define KECX_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace scan {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // Bulk byte scanning used to classify whole buffers of lines at once.
+    // On x86-64 the kernels are compiled for SSE4.2, AVX2 and AVX-512BW via
+    // target attributes and the best one supported by the running CPU is
+    // chosen once at runtime; everything else uses the scalar kernel.
+
+    enum class Isa {
+        scalar,
+        sse42,
+        avx2,
+        avx512
+    };
+
+    /**
+     * @brief
+     * Maximum number of distinct bytes `find_any` can search for at once.
+    */
+    const std::size_t max_set_size = 16;
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    inline void find_any_scalar(
+        const char* data,
+        const std::size_t& n,
+        const char* set,
+        const std::size_t& set_size,
+        std::vector<uint32_t>& positions
+    ) {
+        bool in_set[256] = {};
+        for (std::size_t i = 0; i < set_size; ++i) {
+            in_set[static_cast<unsigned char>(set[i])] = true;
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            if (in_set[static_cast<unsigned char>(data[i])]) {
+                positions.push_back(static_cast<uint32_t>(i));
+            }
+        }
+    }
+
+#ifdef KECX_SCAN_X86
+    inline void push_mask_positions(
+        uint64_t mask,
+        const std::size_t& base,
+        std::vector<uint32_t>& positions
+    ) {
+        while (mask != 0) {
+            positions.push_back(static_cast<uint32_t>(base + __builtin_ctzll(mask)));
+            mask &= mask - 1;
+        }
+    }
+
+    __attribute__((target("sse4.2")))
+    inline void find_any_sse42(
+        const char* data,
+        const std::size_t& n,
+        const char* set,
+        const std::size_t& set_size,
+        std::vector<uint32_t>& positions
+    ) {
+        char set_bytes[16] = {};
+        std::memcpy(set_bytes, set, set_size);
+        const __m128i needles = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(set_bytes)
+        );
+        const int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK;
+        std::size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i block = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(data + i)
+            );
+            __m128i m = _mm_cmpestrm(
+                needles, static_cast<int>(set_size), block, 16, mode
+            );
+            push_mask_positions(
+                static_cast<uint64_t>(_mm_cvtsi128_si32(m)) & 0xFFFF, i, positions
+            );
+        }
+        std::size_t before = positions.size();
+        find_any_scalar(data + i, n - i, set, set_size, positions);
+        for (std::size_t j = before; j < positions.size(); ++j) {
+            positions[j] += static_cast<uint32_t>(i);
+        }
+    }
+
+    __attribute__((target("avx2")))
+    inline void find_any_avx2(
+        const char* data,
+        const std::size_t& n,
+        const char* set,
+        const std::size_t& set_size,
+        std::vector<uint32_t>& positions
+    ) {
+        __m256i needles[max_set_size];
+        for (std::size_t k = 0; k < set_size; ++k) {
+            needles[k] = _mm256_set1_epi8(set[k]);
+        }
+        std::size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            __m256i block = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(data + i)
+            );
+            __m256i hits = _mm256_cmpeq_epi8(block, needles[0]);
+            for (std::size_t k = 1; k < set_size; ++k) {
+                hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, needles[k]));
+            }
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+            push_mask_positions(mask, i, positions);
+        }
+        std::size_t before = positions.size();
+        find_any_scalar(data + i, n - i, set, set_size, positions);
+        for (std::size_t j = before; j < positions.size(); ++j) {
+            positions[j] += static_cast<uint32_t>(i);
+        }
+    }
+
+    __attribute__((target("avx512f,avx512bw")))
+    inline void find_any_avx512(
+        const char* data,
+        const std::size_t& n,
+        const char* set,
+        const std::size_t& set_size,
+        std::vector<uint32_t>& positions
+    ) {
+        __m512i needles[max_set_size];
+        for (std::size_t k = 0; k < set_size; ++k) {
+            needles[k] = _mm512_set1_epi8(set[k]);
+        }
+        std::size_t i = 0;
+        for (; i + 64 <= n; i += 64) {
+            __m512i block = _mm512_loadu_si512(
+                reinterpret_cast<const void*>(data + i)
+            );
+            __mmask64 mask = 0;
+            for (std::size_t k = 0; k < set_size; ++k) {
+                mask |= _mm512_cmpeq_epi8_mask(block, needles[k]);
+            }
+            push_mask_positions(static_cast<uint64_t>(mask), i, positions);
+        }
+        std::size_t before = positions.size();
+        find_any_scalar(data + i, n - i, set, set_size, positions);
+        for (std::size_t j = before; j < positions.size(); ++j) {
+            positions[j] += static_cast<uint32_t>(i);
+        }
+    }
+#endif
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Best instruction set supported by the running CPU. Detected once.
+    */
+    inline Isa detected_isa() {
+        static const Isa isa = []() {
+#ifdef KECX_SCAN_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512bw") &&
+                    __builtin_cpu_supports("avx512f")) {
+                return(Isa::avx512);
+            }
+            if (__builtin_cpu_supports("avx2")) {
+                return(Isa::avx2);
+            }
+            if (__builtin_cpu_supports("sse4.2")) {
+                return(Isa::sse42);
+            }
+#endif
+            return(Isa::scalar);
+        }();
+        return(isa);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Append to `positions` the offsets of all bytes of `data[0, n)` that
+     * occur in `set`, in increasing order. `n` must be below 4 GiB.
+     * @param set
+     * Bytes to look for; at most `max_set_size`.
+     * @param isa
+     * Kernel to use; requests for kernels the CPU does not support fall
+     * back to the best supported one.
+    */
+    inline void find_any(
+        const char* data,
+        const std::size_t& n,
+        const char* set,
+        const std::size_t& set_size,
+        std::vector<uint32_t>& positions,
+        Isa isa = detected_isa()
+    ) {
+        if (isa > detected_isa()) {
+            isa = detected_isa();
+        }
+#ifdef KECX_SCAN_X86
+        switch (isa) {
+            case Isa::avx512:
+                find_any_avx512(data, n, set, set_size, positions);
+                return;
+            case Isa::avx2:
+                find_any_avx2(data, n, set, set_size, positions);
+                return;
+            case Isa::sse42:
+                find_any_sse42(data, n, set, set_size, positions);
+                return;
+            default:
+                break;
+        }
+#endif
+        find_any_scalar(data, n, set, set_size, positions);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * If regex `re` only matches one fixed string (e.g. `"[/][*]"`, `"//"`,
+     * `"#"`), write that string into `literal` and return `true`.
+     * Recognised are plain characters, single-character classes such as
+     * `[*]` and backslash-escaped punctuation such as `\*`.
+    */
+    inline bool regex_to_literal(const std::string& re, std::string& literal) {
+        const std::string meta = "^$\\.*+?()[]{}|";
+        literal.clear();
+        std::size_t i = 0;
+        while (i < re.size()) {
+            char c = re[i];
+            if (c == '[') {
+                // exactly one plain character in the class
+                if (i + 2 < re.size() && re[i + 2] == ']' &&
+                        re[i + 1] != '^' && re[i + 1] != '\\' &&
+                        re[i + 1] != ']' && re[i + 1] != '[') {
+                    literal += re[i + 1];
+                    i += 3;
+                    continue;
+                }
+                return(false);
+            }
+            if (c == '\\') {
+                if (i + 1 < re.size() &&
+                        std::ispunct(static_cast<unsigned char>(re[i + 1]))) {
+                    literal += re[i + 1];
+                    i += 2;
+                    continue;
+                }
+                return(false);
+            }
+            if (meta.find(c) != std::string::npos) {
+                return(false);
+            }
+            literal += c;
+            i += 1;
+        }
+        return(literal.size() > 0 && literal.find('\n') == std::string::npos);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Write into `literal` a string that every match of regex `re` contains
+     * and return `true`, or return `false` if none can be derived. This is
+     * the whole pattern if it is a literal (see `regex_to_literal`), else
+     * its longest literal prefix that is not subject to a quantifier, e.g.
+     * `"@doc"` for `"@doc(start)?"` or `"@"` for `"@[a-z]+"`. Patterns
+     * with alternation `|` anywhere give `false`.
+    */
+    inline bool required_literal(const std::string& re, std::string& literal) {
+        if (regex_to_literal(re, literal)) {
+            return(true);
+        }
+        literal.clear();
+        bool in_class = false;
+        for (std::size_t i = 0; i < re.size(); ++i) {
+            if (re[i] == '\\') {
+                i += 1;
+            } else if (re[i] == '[') {
+                in_class = true;
+            } else if (re[i] == ']') {
+                in_class = false;
+            } else if (re[i] == '|' && !in_class) {
+                return(false);
+            }
+        }
+        const std::string meta = "^$\\.*+?()[]{}|";
+        std::size_t i = 0;
+        // size of `literal` before its last element was appended
+        std::size_t before_last = 0;
+        while (i < re.size()) {
+            char c = re[i];
+            std::size_t size = literal.size();
+            if (c == '[' && i + 2 < re.size() && re[i + 2] == ']' &&
+                    re[i + 1] != '^' && re[i + 1] != '\\' &&
+                    re[i + 1] != ']' && re[i + 1] != '[') {
+                literal += re[i + 1];
+                i += 3;
+            } else if (c == '\\' && i + 1 < re.size() &&
+                    std::ispunct(static_cast<unsigned char>(re[i + 1]))) {
+                literal += re[i + 1];
+                i += 2;
+            } else if (meta.find(c) == std::string::npos) {
+                literal += c;
+                i += 1;
+            } else {
+                if (c == '*' || c == '?' || c == '{') {
+                    // the last element may occur zero times
+                    literal.resize(before_last);
+                }
+                break;
+            }
+            before_last = size;
+        }
+        return(literal.size() > 0 && literal.find('\n') == std::string::npos);
+    }
+
+    /**
+     * @brief
+     * `true` if `data[0, n)` contains any of `literals`.
+    */
+    inline bool contains_any(
+        const char* data,
+        const std::size_t& n,
+        const std::vector<std::string>& literals
+    ) {
+        for (const std::string& literal : literals) {
+            if (memmem(data, n, literal.data(), literal.size()) != nullptr) {
+                return(true);
+            }
+        }
+        return(false);
+    }
+
+    /**
+     * @brief
+     * Flags of `line` as set by `classify_lines`: bit `k` is set if `line`
+     * contains `literals[k]`.
+    */
+    inline uint8_t literal_flags(
+        const std::string_view& line,
+        const std::vector<std::string>& literals
+    ) {
+        uint8_t flags = 0;
+        for (std::size_t k = 0; k < literals.size(); ++k) {
+            if (line.find(literals[k]) != std::string_view::npos) {
+                flags |= static_cast<uint8_t>(1u << k);
+            }
+        }
+        return(flags);
+    }
+
+    /**
+     * @brief
+     * Number of leading bytes looked at by `looks_binary`.
+    */
+    const std::size_t binary_sniff_size = 8192;
+
+    /**
+     * @brief
+     * `true` if `data[0, n)` does not look like text in an 8-bit encoding:
+     * it starts with a UTF-16 or UTF-32 byte order mark or has a NUL byte
+     * in its first `binary_sniff_size` bytes (as in git and grep).
+    */
+    inline bool looks_binary(const char* data, const std::size_t& n) {
+        const unsigned char* u = reinterpret_cast<const unsigned char*>(data);
+        if (n >= 2 && ((u[0] == 0xFF && u[1] == 0xFE) || (u[0] == 0xFE && u[1] == 0xFF))) {
+            return(true);
+        }
+        return(std::memchr(data, '\0', std::min(n, binary_sniff_size)) != nullptr);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Bytes `classify_lines` passes to `find_any` at a time, so that the
+     * positions fit in 32 bits however long a line is.
+    */
+    const std::size_t classify_window = std::size_t(1) << 30;
+
+    /**
+     * @brief
+     * Split `data[0, n)` into lines and flag, for each line, which of the
+     * `literals` it contains. Line `i` ends at `line_ends[i]` (the position
+     * of its `'\n'`, or `n` for a last line without one); bit `k` of
+     * `flags[i]` is set if the line contains `literals[k]`. Lines follow
+     * `std::getline` conventions: a trailing `'\n'` does not start another
+     * line. Only the bytes `'\n'` and the first bytes of the literals are
+     * looked at individually, so the cost on comment-sparse text is
+     * dominated by the vector kernel.
+     * @param literals
+     * At most 8 non-empty literals without `'\n'`.
+    */
+    inline void classify_lines(
+        const char* data,
+        const std::size_t& n,
+        const std::vector<std::string>& literals,
+        std::vector<uint32_t>& positions,
+        std::vector<std::size_t>& line_ends,
+        std::vector<uint8_t>& flags,
+        const Isa& isa = detected_isa()
+    ) {
+        line_ends.clear();
+        flags.clear();
+        positions.clear();
+
+        char set[max_set_size];
+        std::size_t set_size = 0;
+        set[set_size++] = '\n';
+        for (const std::string& literal : literals) {
+            if (std::memchr(set, literal[0], set_size) == nullptr) {
+                set[set_size++] = literal[0];
+            }
+        }
+        uint8_t line_flags = 0;
+        for (std::size_t window = 0; window < n; window += classify_window) {
+            find_any(
+                data + window, std::min(classify_window, n - window),
+                set, set_size, positions, isa
+            );
+            for (uint32_t window_p : positions) {
+                std::size_t p = window + window_p;
+                char c = data[p];
+                if (c == '\n') {
+                    line_ends.push_back(p);
+                    flags.push_back(line_flags);
+                    line_flags = 0;
+                    continue;
+                }
+                for (std::size_t k = 0; k < literals.size(); ++k) {
+                    const std::string& literal = literals[k];
+                    if (literal[0] == c && p + literal.size() <= n &&
+                            std::memcmp(data + p, literal.data(), literal.size()) == 0) {
+                        line_flags |= static_cast<uint8_t>(1u << k);
+                    }
+                }
+            }
+            positions.clear();
+        }
+        if (n > 0 && (line_ends.size() == 0 || line_ends.back() + 1 < n)) {
+            line_ends.push_back(n);
+            flags.push_back(line_flags);
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace scan
+
+#endif
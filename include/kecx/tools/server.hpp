@@ -0,0 +1,826 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "keysets.hpp"
+#include "store.hpp"
+#include "extractor.hpp"
+#include "trace.hpp"
+
+namespace server {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Extraction server
+    //
+    // Short incremental documentation builds spend most of their time
+    // starting up and reading cold files. `kecx::server::Server` keeps
+    // compiled extractors and the results of every file it has extracted in
+    // memory and serves extraction requests over a Unix domain socket;
+    // `kecx::server::Client` sends a request with the settings and file
+    // paths and replays the results into a `store`, as
+    // `kecx::extract::Extractor::extract` would. A file is extracted again
+    // only if its inode, size or modification time have changed, so repeat
+    // requests for unchanged files are answered from memory. Errors are
+    // passed back per file and rethrown by the client (the key-set
+    // exceptions with their original types). See
+    // `./examples/example_05.cpp`.
+    //
+    // The server answers one request at a time, in the order they arrive,
+    // from any number of connected clients; a long extraction delays the
+    // requests of the other clients. Idle clients may stay connected, but a
+    // client that stalls for longer than `Server::set_timeout` (default
+    // 10 s) in the middle of sending a request or receiving a response is
+    // disconnected.
+    //
+    // @docstop README.md
+
+    /**
+     * @brief
+     * Default limit of the memory used by cached results of a `Server`.
+    */
+    const std::size_t default_cache_bytes = std::size_t(512) << 20;
+
+    /**
+     * @brief
+     * Default limit of the size of a request a `Server` accepts.
+    */
+    const std::size_t default_max_request_bytes = std::size_t(256) << 20;
+
+    /**
+     * @brief
+     * Default time in milliseconds after which a `Server` drops a client
+     * that stalls in the middle of a request or response.
+    */
+    const unsigned int default_timeout_ms = 10000;
+
+    /**
+     * @brief
+     * Default number of compiled extractors, one per distinct settings, a
+     * `Server` keeps.
+    */
+    const std::size_t default_max_extractors = 16;
+
+    // request kinds
+    const uint8_t request_extract = 1;
+    const uint8_t request_shutdown = 2;
+
+    // response status
+    const uint8_t response_ok = 0;
+    const uint8_t response_error = 1;
+
+    // kinds of per-file errors
+    const uint8_t error_none = 0;
+    const uint8_t error_key_already_active = 1;
+    const uint8_t error_key_not_active = 2;
+    const uint8_t error_key_set_not_empty = 3;
+    const uint8_t error_other = 4;
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Builds a message: integers in host byte order, strings and lists
+     * prefixed with their 32-bit size.
+    */
+    class Message {
+        public:
+            std::string data;
+
+            void put_u8(const uint8_t& x) {
+                data += static_cast<char>(x);
+            }
+
+            void put_u32(const uint32_t& x) {
+                data.append(reinterpret_cast<const char*>(&x), sizeof(x));
+            }
+
+            void put_i32(const int32_t& x) {
+                data.append(reinterpret_cast<const char*>(&x), sizeof(x));
+            }
+
+            void put_string(const std::string& x) {
+                put_u32(static_cast<uint32_t>(x.size()));
+                data += x;
+            }
+
+            void put_strings(const std::vector<std::string>& x) {
+                put_u32(static_cast<uint32_t>(x.size()));
+                for (const std::string& s : x) {
+                    put_string(s);
+                }
+            }
+    };
+
+    /**
+     * @brief
+     * Reads a message built by `Message`; throws `std::runtime_error` if it
+     * ends early.
+    */
+    class MessageReader {
+        private:
+            const std::string& data;
+            std::size_t position = 0;
+
+            const char* take(const std::size_t& n) {
+                if (data.size() - position < n) {
+                    throw std::runtime_error("kecx: truncated server message");
+                }
+                const char* p = data.data() + position;
+                position += n;
+                return(p);
+            }
+
+        public:
+            MessageReader(const std::string& data) : data(data) {}
+
+            bool at_end() const {
+                return(position == data.size());
+            }
+
+            uint8_t get_u8() {
+                return(static_cast<uint8_t>(*take(1)));
+            }
+
+            uint32_t get_u32() {
+                uint32_t x;
+                std::memcpy(&x, take(sizeof(x)), sizeof(x));
+                return(x);
+            }
+
+            int32_t get_i32() {
+                int32_t x;
+                std::memcpy(&x, take(sizeof(x)), sizeof(x));
+                return(x);
+            }
+
+            std::string get_string() {
+                uint32_t n = get_u32();
+                return(std::string(take(n), n));
+            }
+
+            void get_string(std::string& x) {
+                uint32_t n = get_u32();
+                x.assign(take(n), n);
+            }
+
+            std::vector<std::string> get_strings() {
+                uint32_t n = get_u32();
+                // each string takes at least its size: check the count
+                // before allocating for it
+                if (n > (data.size() - position) / sizeof(uint32_t)) {
+                    throw std::runtime_error("kecx: truncated server message");
+                }
+                std::vector<std::string> x(n);
+                for (std::string& s : x) {
+                    get_string(s);
+                }
+                return(x);
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Send `message` over `fd`, prefixed with its 64-bit size. Returns
+     * `false` if the peer is gone.
+    */
+    inline bool send_frame(const int& fd, const std::string& message) {
+        uint64_t size = message.size();
+        std::string frame(reinterpret_cast<const char*>(&size), sizeof(size));
+        frame += message;
+        const char* p = frame.data();
+        std::size_t left = frame.size();
+        while (left > 0) {
+            ssize_t sent = ::send(fd, p, left, MSG_NOSIGNAL);
+            if (sent <= 0) {
+                return(false);
+            }
+            p += sent;
+            left -= static_cast<std::size_t>(sent);
+        }
+        return(true);
+    }
+
+    inline bool receive_all(const int& fd, char* p, std::size_t n) {
+        while (n > 0) {
+            ssize_t got = ::recv(fd, p, n, 0);
+            if (got <= 0) {
+                return(false);
+            }
+            p += got;
+            n -= static_cast<std::size_t>(got);
+        }
+        return(true);
+    }
+
+    /**
+     * @brief
+     * Receive a frame sent by `send_frame` into `message`. Returns `false`
+     * if the peer is gone or announces a frame larger than `max_size`.
+    */
+    inline bool receive_frame(
+        const int& fd,
+        std::string& message,
+        const uint64_t& max_size = UINT64_MAX
+    ) {
+        uint64_t size;
+        if (!receive_all(fd, reinterpret_cast<char*>(&size), sizeof(size)) ||
+                size > max_size || size > message.max_size()) {
+            return(false);
+        }
+        message.resize(size);
+        return(receive_all(fd, &message[0], size));
+    }
+
+    inline sockaddr_un socket_address(const std::string& socket_path) {
+        sockaddr_un address = sockaddr_un();
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument(
+                "socket_path = \"" + socket_path + "\" is too long"
+            );
+        }
+        std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+        return(address);
+    }
+
+    inline void put_settings(Message& message, const extract::Settings& settings) {
+        message.put_string(settings.multiline_comment_start);
+        message.put_string(settings.multiline_comment_stop);
+        message.put_string(settings.singleline_comment);
+        message.put_strings(settings.header_only_tag_set);
+        message.put_strings(settings.header_tag_set);
+        message.put_strings(settings.footer_tag_set);
+        message.put_strings(settings.either_tag_set);
+        message.put_u8(settings.store_only_comments_ho);
+        message.put_u8(settings.store_only_comments_hf);
+        message.put_u8(settings.store_only_comments_e);
+        message.put_i32(settings.verbosity);
+    }
+
+    inline extract::Settings get_settings(MessageReader& reader) {
+        extract::Settings settings;
+        settings.multiline_comment_start = reader.get_string();
+        settings.multiline_comment_stop = reader.get_string();
+        settings.singleline_comment = reader.get_string();
+        settings.header_only_tag_set = reader.get_strings();
+        settings.header_tag_set = reader.get_strings();
+        settings.footer_tag_set = reader.get_strings();
+        settings.either_tag_set = reader.get_strings();
+        settings.store_only_comments_ho = reader.get_u8() != 0;
+        settings.store_only_comments_hf = reader.get_u8() != 0;
+        settings.store_only_comments_e = reader.get_u8() != 0;
+        settings.verbosity = reader.get_i32();
+        return(settings);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Serves extraction requests on a Unix domain socket, one request at
+     * a time, and caches the results per settings and file.
+    */
+    class Server {
+        private:
+            struct CacheEntry {
+                dev_t device;
+                ino_t inode;
+                off_t size;
+                struct timespec mtime;
+                // the file's part of a response, see `extract_file`
+                std::string result;
+                std::list<std::string>::iterator lru;
+            };
+
+            std::string socket_path;
+            int listen_fd = -1;
+            std::size_t cache_bytes;
+            std::size_t cache_bytes_used = 0;
+            std::size_t max_request_bytes = default_max_request_bytes;
+            unsigned int timeout_ms = default_timeout_ms;
+            std::size_t max_extractors = default_max_extractors;
+            // compiled extractors by serialized settings, with the request
+            // that last used them
+            struct CompiledSettings {
+                std::unique_ptr<extract::Extractor> extractor;
+                unsigned long long last_used = 0;
+            };
+            std::map<std::string, CompiledSettings> extractors;
+            // by settings id, '\0' and file path
+            std::unordered_map<std::string, CacheEntry> cache;
+            // cache keys, least recently used first
+            std::list<std::string> lru;
+            unsigned long long requests_ = 0;
+            unsigned long long cache_hits_ = 0;
+            unsigned long long cache_misses_ = 0;
+            trace::Recorder* trace_ = nullptr;
+
+            static bool same_file(const CacheEntry& entry, const struct stat& st) {
+                return(
+                    entry.device == st.st_dev &&
+                    entry.inode == st.st_ino &&
+                    entry.size == st.st_size &&
+                    entry.mtime.tv_sec == st.st_mtim.tv_sec &&
+                    entry.mtime.tv_nsec == st.st_mtim.tv_nsec
+                );
+            }
+
+            /**
+             * @brief
+             * Extract `file_path` into `result`: the number of records, the
+             * records and the error kind with its details.
+            */
+            static void extract_file(
+                const extract::Extractor& extractor,
+                const std::string& file_path,
+                std::string& result
+            ) {
+                Message message;
+                message.put_u32(0);
+                uint32_t n_records = 0;
+                uint8_t error = error_none;
+                Message details;
+                try {
+                    extractor.extract(
+                        file_path,
+                        [&message, &n_records](
+                            const std::string& key,
+                            const std::string& line,
+                            const int& line_no
+                        ) -> void
+                        {
+                            message.put_string(key);
+                            message.put_string(line);
+                            message.put_i32(line_no);
+                            n_records += 1;
+                        }
+                    );
+                } catch (const keysets::KeyAlreadyActiveException& e) {
+                    error = error_key_already_active;
+                    details.put_string(e.key());
+                } catch (const keysets::KeyNotActiveException& e) {
+                    error = error_key_not_active;
+                    details.put_string(e.key());
+                } catch (const keysets::KeySetNotEmptyException& e) {
+                    error = error_key_set_not_empty;
+                    details.put_strings(e.keys());
+                } catch (const std::exception& e) {
+                    error = error_other;
+                    details.put_string(e.what());
+                }
+                std::memcpy(&message.data[0], &n_records, sizeof(n_records));
+                message.put_u8(error);
+                message.data += details.data;
+                result.swap(message.data);
+            }
+
+            void evict() {
+                while (cache_bytes_used > cache_bytes && !lru.empty()) {
+                    auto it = cache.find(lru.front());
+                    cache_bytes_used -= it->second.result.size() + it->first.size();
+                    cache.erase(it);
+                    lru.pop_front();
+                }
+            }
+
+            /**
+             * @brief
+             * Append the result of `file_path` to `response`, from the cache
+             * if the file is unchanged.
+            */
+            void respond_file(
+                const std::string& settings_id,
+                const extract::Extractor& extractor,
+                const std::string& file_path,
+                Message& response
+            ) {
+                struct stat st;
+                bool can_cache = ::stat(file_path.c_str(), &st) == 0 &&
+                    settings_id.size() > 0;
+                std::string cache_key = settings_id + '\0' + file_path;
+                if (can_cache) {
+                    auto it = cache.find(cache_key);
+                    if (it != cache.end() && same_file(it->second, st)) {
+                        cache_hits_ += 1;
+                        lru.splice(lru.end(), lru, it->second.lru);
+                        response.put_u8(1);
+                        response.data += it->second.result;
+                        return;
+                    }
+                    if (it != cache.end()) {
+                        cache_bytes_used -= it->second.result.size() + cache_key.size();
+                        lru.erase(it->second.lru);
+                        cache.erase(it);
+                    }
+                }
+                cache_misses_ += 1;
+                std::string result;
+                extract_file(extractor, file_path, result);
+                response.put_u8(0);
+                response.data += result;
+                if (can_cache) {
+                    CacheEntry& entry = cache[cache_key];
+                    entry.device = st.st_dev;
+                    entry.inode = st.st_ino;
+                    entry.size = st.st_size;
+                    entry.mtime = st.st_mtim;
+                    entry.result.swap(result);
+                    entry.lru = lru.insert(lru.end(), cache_key);
+                    cache_bytes_used += entry.result.size() + cache_key.size();
+                    evict();
+                }
+            }
+
+            /**
+             * @brief
+             * Answer one extract request.
+            */
+            void respond(MessageReader& request, Message& response) {
+                Message settings_message;
+                put_settings(settings_message, get_settings(request));
+                std::string& settings_id = settings_message.data;
+                auto it = extractors.find(settings_id);
+                if (it == extractors.end()) {
+                    // drop the least recently used extractor; cached
+                    // results stay, they are keyed by the settings
+                    if (extractors.size() >= std::max<std::size_t>(max_extractors, 1)) {
+                        auto oldest = extractors.begin();
+                        for (auto x = extractors.begin(); x != extractors.end(); ++x) {
+                            if (x->second.last_used < oldest->second.last_used) {
+                                oldest = x;
+                            }
+                        }
+                        extractors.erase(oldest);
+                    }
+                    MessageReader settings_reader(settings_id);
+                    CompiledSettings compiled;
+                    compiled.extractor.reset(
+                        new extract::Extractor(get_settings(settings_reader))
+                    );
+                    compiled.extractor->set_trace(trace_);
+                    it = extractors.emplace(settings_id, std::move(compiled)).first;
+                }
+                it->second.last_used = requests_;
+                const extract::Extractor& extractor = *it->second.extractor;
+                // the output of verbose runs goes to the server's stdout
+                // and must not be skipped
+                std::string cache_id = extractor.settings().verbosity == 0 ?
+                    settings_id : "";
+                std::vector<std::string> file_paths = request.get_strings();
+                response.put_u8(response_ok);
+                response.put_u32(static_cast<uint32_t>(file_paths.size()));
+                for (const std::string& file_path : file_paths) {
+                    respond_file(cache_id, extractor, file_path, response);
+                }
+            }
+
+        public:
+            /**
+             * @brief
+             * Listen on `socket_path`, replacing a stale socket file there.
+             * Throws `std::invalid_argument` if anything else is there.
+             * @param cache_bytes
+             * Limit of the memory used by cached results; the least
+             * recently used ones are dropped beyond it.
+            */
+            Server(
+                const std::string& socket_path,
+                const std::size_t& cache_bytes = default_cache_bytes
+            ) :
+                socket_path(socket_path),
+                cache_bytes(cache_bytes)
+            {
+                sockaddr_un address = socket_address(socket_path);
+                listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                if (listen_fd < 0) {
+                    throw std::runtime_error("kecx: cannot create a socket");
+                }
+                // only ever remove a socket, never e.g. a file given by
+                // mistake
+                struct stat st;
+                if (::lstat(socket_path.c_str(), &st) == 0) {
+                    if (!S_ISSOCK(st.st_mode)) {
+                        ::close(listen_fd);
+                        throw std::invalid_argument(
+                            "socket_path = \"" + socket_path + "\" exists and "
+                            "is not a socket"
+                        );
+                    }
+                    ::unlink(socket_path.c_str());
+                }
+                if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+                        ::listen(listen_fd, 16) != 0) {
+                    ::close(listen_fd);
+                    throw std::invalid_argument(
+                        "Cannot listen on socket_path = \"" + socket_path + "\""
+                    );
+                }
+            }
+
+            Server(const Server&) = delete;
+            Server& operator=(const Server&) = delete;
+
+            ~Server() {
+                ::close(listen_fd);
+                ::unlink(socket_path.c_str());
+            }
+
+            /**
+             * @brief
+             * Receive and answer one request on `fd`. Returns `false` if
+             * the connection is to be closed.
+            */
+            bool serve_request(const int& fd, std::string& request, bool& running) {
+                // a malformed, oversized or stalled frame ends the
+                // connection like a client that is gone
+                bool received = false;
+                try {
+                    received = receive_frame(fd, request, max_request_bytes);
+                } catch (const std::exception& e) {
+                    request = std::string();
+                }
+                if (!received) {
+                    return(false);
+                }
+                trace::Span request_span(trace_, "request", "server");
+                requests_ += 1;
+                Message response;
+                try {
+                    MessageReader reader(request);
+                    uint8_t kind = reader.get_u8();
+                    if (kind == request_shutdown) {
+                        running = false;
+                        response.put_u8(response_ok);
+                    } else if (kind == request_extract) {
+                        respond(reader, response);
+                    } else {
+                        throw std::runtime_error("kecx: unknown request");
+                    }
+                } catch (const std::exception& e) {
+                    // e.g. invalid regexes in the settings
+                    response = Message();
+                    response.put_u8(response_error);
+                    response.put_string(e.what());
+                }
+                return(send_frame(fd, response.data));
+            }
+
+            /**
+             * @brief
+             * Serve connections until a client sends a shutdown request.
+             * Any number of clients can be connected; their requests are
+             * answered one at a time, as they arrive.
+            */
+            void serve() {
+                // the listening socket, then the connections
+                std::vector<pollfd> fds(1, pollfd{listen_fd, POLLIN, 0});
+                std::string request;
+                bool running = true;
+                while (running) {
+                    trace::Span wait_span(trace_, "wait", "server");
+                    int ready = ::poll(fds.data(), fds.size(), -1);
+                    wait_span.end();
+                    if (ready <= 0) {
+                        continue;
+                    }
+                    for (std::size_t i = 1; i < fds.size() && running; ++i) {
+                        if (fds[i].revents == 0) {
+                            continue;
+                        }
+                        if (!serve_request(fds[i].fd, request, running)) {
+                            ::close(fds[i].fd);
+                            fds[i].fd = -1;
+                        }
+                    }
+                    if (running && (fds[0].revents & POLLIN) != 0) {
+                        int fd = ::accept(listen_fd, nullptr, nullptr);
+                        if (fd >= 0) {
+                            if (timeout_ms > 0) {
+                                timeval timeout;
+                                timeout.tv_sec = timeout_ms / 1000;
+                                timeout.tv_usec = (timeout_ms % 1000) * 1000;
+                                ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                                ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                            }
+                            fds.push_back(pollfd{fd, POLLIN, 0});
+                        }
+                    }
+                    fds.erase(std::remove_if(fds.begin() + 1, fds.end(), [](const pollfd& p) {
+                        return(p.fd < 0);
+                    }), fds.end());
+                }
+                for (std::size_t i = 1; i < fds.size(); ++i) {
+                    ::close(fds[i].fd);
+                }
+            }
+
+            /**
+             * @brief
+             * Close connections that stall for `timeout_ms` milliseconds
+             * while sending a request or receiving a response (default
+             * `default_timeout_ms`); `0` waits indefinitely. Idle
+             * connections between requests are kept.
+            */
+            void set_timeout(const unsigned int& timeout_ms) {
+                this->timeout_ms = timeout_ms;
+            }
+
+            /**
+             * @brief
+             * Drop connections that send a request larger than
+             * `max_request_bytes` (default `default_max_request_bytes`).
+            */
+            void set_max_request_bytes(const std::size_t& max_request_bytes) {
+                this->max_request_bytes = max_request_bytes;
+            }
+
+            /**
+             * @brief
+             * Keep at most `max_extractors` compiled extractors (default
+             * `default_max_extractors`), dropping the least recently used
+             * one for new settings.
+            */
+            void set_max_extractors(const std::size_t& max_extractors) {
+                this->max_extractors = max_extractors;
+            }
+
+            unsigned long long requests() const {
+                return(requests_);
+            }
+
+            unsigned long long cache_hits() const {
+                return(cache_hits_);
+            }
+
+            unsigned long long cache_misses() const {
+                return(cache_misses_);
+            }
+
+            /**
+             * @brief
+             * Record trace spans of the served requests and of their
+             * extractions with `recorder` (see `kecx::trace`), or stop
+             * recording if it is `nullptr`.
+            */
+            void set_trace(trace::Recorder* recorder) {
+                trace_ = recorder;
+                for (auto& settings_extractor : extractors) {
+                    settings_extractor.second.extractor->set_trace(recorder);
+                }
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Connection to a `Server`.
+    */
+    class Client {
+        private:
+            int fd = -1;
+            unsigned long long cache_hits_ = 0;
+
+            std::string call(const std::string& request) {
+                std::string response;
+                if (!send_frame(fd, request) || !receive_frame(fd, response)) {
+                    throw std::runtime_error("kecx: lost the connection to the server");
+                }
+                return(response);
+            }
+
+        public:
+            /**
+             * @brief
+             * Connect to the server at `socket_path`; throws
+             * `std::invalid_argument` if none is listening there.
+            */
+            Client(const std::string& socket_path) {
+                sockaddr_un address = socket_address(socket_path);
+                fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+                    if (fd >= 0) {
+                        ::close(fd);
+                    }
+                    throw std::invalid_argument(
+                        "No kecx server is listening on socket_path = \""
+                        + socket_path + "\""
+                    );
+                }
+            }
+
+            Client(const Client&) = delete;
+            Client& operator=(const Client&) = delete;
+
+            ~Client() {
+                ::close(fd);
+            }
+
+            /**
+             * @brief
+             * Extract `file_paths` with `settings` on the server and pass
+             * the results to `store`, file by file. Throws at the first file
+             * that failed, after passing on its records, like extracting
+             * the files in this process would.
+            */
+            void extract(
+                const extract::Settings& settings,
+                const std::vector<std::string>& file_paths,
+                const store::store_type& store
+            ) {
+                // the server resolves paths in its own working directory
+                std::vector<std::string> absolute_paths = file_paths;
+                char cwd[4096];
+                if (::getcwd(cwd, sizeof(cwd)) != nullptr) {
+                    for (std::string& path : absolute_paths) {
+                        if (path.size() > 0 && path[0] != '/') {
+                            path = std::string(cwd) + "/" + path;
+                        }
+                    }
+                }
+                Message request;
+                request.put_u8(request_extract);
+                put_settings(request, settings);
+                request.put_strings(absolute_paths);
+                std::string response = call(request.data);
+
+                MessageReader reader(response);
+                if (reader.get_u8() != response_ok) {
+                    throw std::runtime_error("kecx: server: " + reader.get_string());
+                }
+                uint32_t n_files = reader.get_u32();
+                std::string key;
+                std::string line;
+                for (uint32_t f = 0; f < n_files; ++f) {
+                    cache_hits_ += reader.get_u8();
+                    uint32_t n_records = reader.get_u32();
+                    for (uint32_t r = 0; r < n_records; ++r) {
+                        reader.get_string(key);
+                        reader.get_string(line);
+                        int line_no = reader.get_i32();
+                        store(key, line, line_no);
+                    }
+                    uint8_t error = reader.get_u8();
+                    if (error == error_key_already_active) {
+                        throw keysets::KeyAlreadyActiveException(reader.get_string());
+                    } else if (error == error_key_not_active) {
+                        throw keysets::KeyNotActiveException(reader.get_string());
+                    } else if (error == error_key_set_not_empty) {
+                        throw keysets::KeySetNotEmptyException(reader.get_strings());
+                    } else if (error == error_other) {
+                        throw std::runtime_error(reader.get_string());
+                    }
+                }
+            }
+
+            /**
+             * @brief
+             * Number of files answered from the server's cache so far.
+            */
+            unsigned long long cache_hits() const {
+                return(cache_hits_);
+            }
+
+            /**
+             * @brief
+             * Ask the server to stop after answering this request.
+            */
+            void shutdown() {
+                Message request;
+                request.put_u8(request_shutdown);
+                call(request.data);
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace server
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef SETTINGS_HPP
+#define SETTINGS_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace extract {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Arguments of `kecx::extract::extract` other than the input and `store`,
+     * kept together so that an `Extractor` can be rebuilt or described.
+    */
+    struct Settings {
+        std::string multiline_comment_start;
+        std::string multiline_comment_stop;
+        std::string singleline_comment;
+        std::vector<std::string> header_only_tag_set;
+        std::vector<std::string> header_tag_set;
+        std::vector<std::string> footer_tag_set;
+        std::vector<std::string> either_tag_set;
+        bool store_only_comments_ho = true;
+        bool store_only_comments_hf = false;
+        bool store_only_comments_e = false;
+        int verbosity = 0;
+    };
+
+    /**
+     * @brief
+     * Line loop used by `Extractor`. `reference` is the original
+     * `std::getline` plus `std::regex` implementation in
+     * `extract::reference::extract`; `fast` is the default chunked loop.
+     * Both must produce identical results, see `differential::run`.
+    */
+    enum class Engine {
+        fast,
+        reference
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Keys to extract, see `Extractor::set_key_filter`. A key passes if it
+     * equals one of `keys` or starts with one of `prefixes`; an empty
+     * filter passes every key.
+    */
+    struct KeyFilter {
+        static constexpr int no_match = -1;
+        static constexpr int prefix_match = -2;
+
+        std::vector<std::string> keys;
+        std::vector<std::string> prefixes;
+        // promise that each of `keys` opens at most one block per file, so
+        // that a file can be left once all of them have been closed
+        bool once_per_file = false;
+
+        bool empty() const {
+            return(keys.size() == 0 && prefixes.size() == 0);
+        }
+
+        /**
+         * @brief
+         * Index of `key` in `keys`, `prefix_match` if it only matches a
+         * prefix, or `no_match`.
+        */
+        int match(const std::string_view& key) const {
+            for (std::size_t i = 0; i < keys.size(); ++i) {
+                if (key == keys[i]) {
+                    return(static_cast<int>(i));
+                }
+            }
+            for (const std::string& prefix : prefixes) {
+                if (key.substr(0, prefix.size()) == prefix) {
+                    return(prefix_match);
+                }
+            }
+            return(no_match);
+        }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Counters of extraction runs. `Extractor::extract` adds to them, so one
+     * object can collect the totals of many files.
+    */
+    struct Stats {
+        unsigned long long files = 0;
+        // files skipped by the prefilter (included in `files`), see
+        // `Extractor::set_prefilter`
+        unsigned long long files_skipped = 0;
+        // files not read to their end (included in `files`), see
+        // `Extractor::set_key_filter` and `Extractor::set_stop`
+        unsigned long long files_stopped = 0;
+        // files skipped as binary (included in `files`) and lines cut at
+        // the maximum line length, see `Extractor::set_skip_binary` and
+        // `Extractor::set_max_line_length`
+        unsigned long long files_binary = 0;
+        unsigned long long lines_truncated = 0;
+        unsigned long long bytes = 0;
+        unsigned long long lines = 0;
+        unsigned long long comment_lines = 0;
+        // lines passed to `store`, and the number of `store` calls (one per
+        // active key of a stored line)
+        unsigned long long stored_lines = 0;
+        unsigned long long store_calls = 0;
+        // `store` calls left out because the line was dropped by a
+        // transform (not included in `store_calls`), see
+        // `Extractor::set_transforms`
+        unsigned long long lines_dropped = 0;
+        // heap allocations made while reading and processing lines; only
+        // counted if `allocations_counted`, see `KECX_COUNT_ALLOCATIONS` in
+        // `misc_utils.hpp`
+        bool allocations_counted = false;
+        unsigned long long line_loop_allocations = 0;
+
+        /**
+         * @brief
+         * Add the counters of `other`, e.g. of a run on another thread.
+        */
+        void add(const Stats& other) {
+            files += other.files;
+            files_skipped += other.files_skipped;
+            files_stopped += other.files_stopped;
+            files_binary += other.files_binary;
+            lines_truncated += other.lines_truncated;
+            bytes += other.bytes;
+            lines += other.lines;
+            comment_lines += other.comment_lines;
+            stored_lines += other.stored_lines;
+            store_calls += other.store_calls;
+            lines_dropped += other.lines_dropped;
+            allocations_counted = allocations_counted || other.allocations_counted;
+            line_loop_allocations += other.line_loop_allocations;
+        }
+    };
+
+    /**
+     * @brief
+     * One stored line as yielded by `Extractor::Records`: the arguments
+     * `store` would have been called with. The views are only valid until
+     * the next record is requested.
+    */
+    struct Record {
+        std::string_view key;
+        std::string_view line;
+        int line_no;
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace extract
+
+#endif
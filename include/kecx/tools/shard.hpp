@@ -0,0 +1,307 @@
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <exception>
+#include <stdexcept>
+#include <cstdint>
+
+#include "store.hpp"
+#include "extractor.hpp"
+#include "multiplex.hpp"
+
+namespace shard {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Sharding across processes
+    //
+    // A list of files too large for one machine can be split among worker
+    // processes, on one host or on several sharing a file system. Every
+    // worker gets the same list and its shard `index` of `count`;
+    // `kecx::shard::extract` processes the files whose path hashes to its
+    // shard (64-bit FNV-1a of the path, so the same on every host and run)
+    // and writes their records into a partial file. The partial file is a
+    // multiplexed file (see "Single multiplexed output file") that also
+    // notes the input file each record comes from.
+    //
+    // ```
+    // // worker i of n
+    // kecx::extract::Extractor extractor(settings);
+    // kecx::shard::extract(
+    //     extractor, file_paths, i, n,
+    //     "./partial/" + std::to_string(i) + ".mux"
+    // );
+    // ```
+    //
+    // Once all workers are done, `kecx::shard::merge` combines the `count`
+    // partial files into one text file per key. The output is byte for
+    // byte that of a single process extracting all files in list order
+    // into the same directory. Partial files of other lists or shard
+    // counts, and missing or duplicate shards, are rejected. A file that
+    // fails in a worker is noted in its partial file; `merge` then stops at
+    // that file and throws its message, as the single process would have.
+    //
+    // ```
+    // kecx::shard::merge(partial_paths, "./output/");
+    // ```
+    //
+    // @docstop README.md
+
+    const uint64_t fnv_offset_basis = 14695981039346656037ull;
+    const uint64_t fnv_prime = 1099511628211ull;
+
+    /**
+     * @brief
+     * 64-bit FNV-1a hash of `data[0, n)`, continuing from `hash`.
+    */
+    inline uint64_t fnv1a(
+        const char* data,
+        const std::size_t& n,
+        uint64_t hash = fnv_offset_basis
+    ) {
+        for (std::size_t i = 0; i < n; ++i) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= fnv_prime;
+        }
+        return(hash);
+    }
+
+    /**
+     * @brief
+     * Hash of `file_path` deciding its shard; the same on every platform.
+    */
+    inline uint64_t path_hash(const std::string& file_path) {
+        return(fnv1a(file_path.data(), file_path.size()));
+    }
+
+    /**
+     * @brief
+     * Hash of the list `file_paths`, in order, recorded in partial files so
+     * that `merge` can tell whether they belong together.
+    */
+    inline uint64_t file_list_hash(const std::vector<std::string>& file_paths) {
+        uint64_t hash = fnv_offset_basis;
+        for (const std::string& file_path : file_paths) {
+            hash = fnv1a(file_path.data(), file_path.size() + 1, hash);
+        }
+        return(hash);
+    }
+
+    /**
+     * @brief
+     * Whether shard `index` of `count` processes the file at `file_path`.
+    */
+    inline bool owns(
+        const std::string& file_path,
+        const uint32_t& index,
+        const uint32_t& count
+    ) {
+        return(path_hash(file_path) % count == index);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Extract the files of `file_paths` belonging to shard `index` of
+     * `count` (see `owns`), in list order, into the partial file
+     * `partial_path`. If a file throws, the error is recorded, the partial
+     * file is closed and the exception is rethrown.
+    */
+    inline void extract(
+        const extract::Extractor& extractor,
+        const std::vector<std::string>& file_paths,
+        const uint32_t& index,
+        const uint32_t& count,
+        const std::string& partial_path,
+        extract::Stats& stats
+    ) {
+        if (count == 0 || index >= count) {
+            throw std::invalid_argument(
+                "Invalid shard index = " + std::to_string(index)
+                + " of count = " + std::to_string(count)
+            );
+        }
+        multiplex::Writer writer(partial_path);
+        writer.add_shard(multiplex::ShardHeader{
+            index,
+            count,
+            static_cast<uint64_t>(file_paths.size()),
+            file_list_hash(file_paths)
+        });
+        uint32_t file = 0;
+        bool file_started = false;
+        // the file is only noted once it has records
+        auto store = [&](
+            const std::string& key,
+            const std::string& line,
+            const int& line_no
+        ) {
+            if (!file_started) {
+                writer.begin_file(file, file_paths[file]);
+                file_started = true;
+            }
+            writer.add(key, line, line_no);
+        };
+        for (std::size_t i = 0; i < file_paths.size(); ++i) {
+            if (!owns(file_paths[i], index, count)) {
+                continue;
+            }
+            file = static_cast<uint32_t>(i);
+            file_started = false;
+            try {
+                extractor.extract(file_paths[i], store, stats);
+            } catch (const std::exception& e) {
+                writer.add_error(file, e.what());
+                writer.close();
+                throw;
+            }
+        }
+        writer.close();
+    }
+
+    inline void extract(
+        const extract::Extractor& extractor,
+        const std::vector<std::string>& file_paths,
+        const uint32_t& index,
+        const uint32_t& count,
+        const std::string& partial_path
+    ) {
+        extract::Stats stats;
+        extract(extractor, file_paths, index, count, partial_path, stats);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Pass the records of the partial files `partial_paths` (one per shard,
+     * in any order) to `store` in the order a single `Extractor` run over
+     * all input files would have. Throws `std::invalid_argument` if the
+     * files are not the complete, closed shards of one input, and
+     * `std::runtime_error` with the recorded message once the records of a
+     * file that failed in its worker have been passed on.
+    */
+    template<typename Store, typename = store::if_store<Store>>
+    void merge(
+        const std::vector<std::string>& partial_paths,
+        const Store& store
+    ) {
+        struct Part {
+            multiplex::Reader reader;
+            multiplex::Record record;
+            bool has_record;
+        };
+        std::vector<std::unique_ptr<Part>> parts;
+        for (const std::string& partial_path : partial_paths) {
+            parts.emplace_back(new Part{multiplex::Reader(partial_path), {}, false});
+            const multiplex::Reader& reader = parts.back()->reader;
+            if (!reader.complete() || !reader.has_shard()) {
+                throw std::invalid_argument(
+                    "partial_path = \"" + partial_path + "\" is not a complete "
+                    "partial file of kecx::shard::extract"
+                );
+            }
+        }
+        if (parts.size() == 0) {
+            return;
+        }
+        const multiplex::ShardHeader& first = parts[0]->reader.shard();
+        std::vector<bool> seen(first.count, false);
+        for (std::size_t p = 0; p < parts.size(); ++p) {
+            const multiplex::ShardHeader& shard = parts[p]->reader.shard();
+            if (shard.count != first.count ||
+                    shard.index >= shard.count ||
+                    shard.n_files != first.n_files ||
+                    shard.file_list_hash != first.file_list_hash) {
+                throw std::invalid_argument(
+                    "partial_path = \"" + partial_paths[p] + "\" belongs to a "
+                    "different input or shard count than \"" + partial_paths[0] + "\""
+                );
+            }
+            if (seen[shard.index]) {
+                throw std::invalid_argument(
+                    "partial_path = \"" + partial_paths[p] + "\" repeats shard "
+                    + std::to_string(shard.index)
+                );
+            }
+            seen[shard.index] = true;
+        }
+        if (parts.size() != first.count) {
+            throw std::invalid_argument(
+                "Got " + std::to_string(parts.size()) + " partial files for "
+                + std::to_string(first.count) + " shards"
+            );
+        }
+
+        for (std::unique_ptr<Part>& part : parts) {
+            part->has_record = part->reader.next(part->record);
+        }
+        std::string key;
+        std::string line;
+        while (true) {
+            // the part holding the earliest input file: records of a file
+            // come from one part, in order, and each part's files ascend
+            Part* next = nullptr;
+            uint64_t next_file = UINT64_MAX;
+            for (std::unique_ptr<Part>& part : parts) {
+                uint64_t file = UINT64_MAX;
+                if (part->has_record) {
+                    file = part->record.file;
+                } else if (part->reader.failed()) {
+                    file = part->reader.failed_file();
+                }
+                if (file < next_file) {
+                    next = part.get();
+                    next_file = file;
+                }
+            }
+            if (next == nullptr) {
+                return;
+            }
+            if (!next->has_record) {
+                throw std::runtime_error(std::string(next->reader.error()));
+            }
+            while (next->has_record && next->record.file == next_file) {
+                key.assign(next->record.key.data(), next->record.key.size());
+                line.assign(next->record.line.data(), next->record.line.size());
+                store(key, line, next->record.line_no);
+                next->has_record = next->reader.next(next->record);
+            }
+        }
+    }
+
+    /**
+     * @brief
+     * Merge the partial files `partial_paths` into one text file per key,
+     * `output_dir_path + key`, as `store::store_to_txt_factory` does.
+    */
+    inline void merge(
+        const std::vector<std::string>& partial_paths,
+        const std::string& output_dir_path
+    ) {
+        multiplex::TxtWriter writer(output_dir_path);
+        merge(partial_paths, [&writer](
+            const std::string& key,
+            const std::string& line,
+            const int&
+        ) {
+            writer.add(key, line);
+        });
+        writer.flush();
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace shard
+
+#endif
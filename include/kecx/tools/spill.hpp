@@ -0,0 +1,469 @@
+#ifndef SPILL_HPP
+#define SPILL_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cerrno>
+#include <stdexcept>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "store.hpp"
+
+namespace spill {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Buffering with a memory budget
+    //
+    // Output that has to be held back before it is stored, e.g. the records
+    // of tar members that are replayed in path order, is kept in
+    // `kecx::spill::Buffer`s. A buffer keeps its records in the order they
+    // were added. All buffers of a `kecx::spill::Pool` share one memory
+    // budget: once it is exceeded, the records in memory of the largest
+    // buffer are appended to its (already unlinked) temporary file in one
+    // sequential write. `replay` reads them back front to back through a
+    // small buffer, followed by what is still in memory. Memory use
+    // therefore stays bounded by the budget no matter how many lines or
+    // keys there are; only the distinct keys themselves are always kept in
+    // memory. The temporary files go to `$TMPDIR` (default `/tmp`).
+    //
+    // @docstop README.md
+
+    /**
+     * @brief
+     * Default memory budget of a `Pool` in bytes.
+    */
+    const std::size_t default_memory_budget = std::size_t(256) << 20;
+
+    /**
+     * @brief
+     * Size of the read buffer of `Buffer::replay` for spilled records; a
+     * larger record gets a buffer of its own size.
+    */
+    const std::size_t replay_buffer_size = 1 << 16;
+
+    // record layout in memory and in the spill file, followed by the line
+    struct RecordHeader {
+        uint64_t size;
+        uint32_t key;
+        int32_t line_no;
+    };
+    static_assert(sizeof(RecordHeader) == 16, "unexpected spill::RecordHeader padding");
+
+    /**
+     * @brief
+     * Thrown if a spill file cannot be created, written or read, as
+     * opposed to errors of whatever produced the records.
+    */
+    class SpillError : public std::runtime_error {
+        public:
+            SpillError(const std::string& msg) : std::runtime_error(msg) {}
+    };
+
+    class Buffer;
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Memory budget shared by `Buffer`s. Must outlive them. Not thread-safe.
+    */
+    class Pool {
+        private:
+            friend class Buffer;
+
+            std::size_t memory_budget;
+            std::string temp_dir;
+            std::size_t used_ = 0;
+            std::size_t peak_ = 0;
+            unsigned long long spilled_bytes_ = 0;
+            // max-heap of the buffers by their bytes in memory, so that the
+            // largest is found without a scan; see `Buffer::heap_index`
+            std::vector<Buffer*> heap;
+
+            void insert(Buffer& buffer);
+            void remove(Buffer& buffer);
+            void sift_up(std::size_t i);
+            void sift_down(std::size_t i);
+            void swap_entries(const std::size_t& i, const std::size_t& j);
+            void grown(Buffer& buffer, const std::size_t& n);
+            void shrunk(Buffer& buffer, const std::size_t& n);
+
+        public:
+            /**
+             * @brief
+             * @param memory_budget
+             * Bytes of buffered records kept in memory before spilling.
+             * @param temp_dir
+             * Directory of the temporary files; empty means `$TMPDIR` or
+             * `/tmp`.
+            */
+            Pool(
+                const std::size_t& memory_budget = default_memory_budget,
+                const std::string& temp_dir = ""
+            ) :
+                memory_budget(memory_budget),
+                temp_dir(temp_dir)
+            {
+                if (this->temp_dir == "") {
+                    const char* tmpdir = std::getenv("TMPDIR");
+                    this->temp_dir = tmpdir != nullptr && *tmpdir != '\0' ? tmpdir : "/tmp";
+                }
+            }
+
+            Pool(const Pool&) = delete;
+            Pool& operator=(const Pool&) = delete;
+
+            /**
+             * @brief
+             * Bytes currently buffered in memory.
+            */
+            std::size_t used() const {
+                return(used_);
+            }
+
+            /**
+             * @brief
+             * Largest value `used()` has had.
+            */
+            std::size_t peak() const {
+                return(peak_);
+            }
+
+            /**
+             * @brief
+             * Bytes written to temporary files so far.
+            */
+            unsigned long long spilled_bytes() const {
+                return(spilled_bytes_);
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Ordered buffer of `(key, line, line_no)` records, kept in memory or,
+     * once its `Pool` is over budget, partly in a temporary file. The
+     * spilled records always precede those in memory.
+    */
+    class Buffer {
+        private:
+            friend class Pool;
+
+            Pool& pool;
+            std::vector<std::string> keys;
+            std::unordered_map<std::string, uint32_t> key_ids;
+            // records not spilled yet
+            std::string data;
+            // position in `Pool::heap`
+            std::size_t heap_index = 0;
+            int fd = -1;
+            // bytes of records in the spill file
+            uint64_t file_size = 0;
+
+            uint32_t key_id(const std::string& key) {
+                auto it = key_ids.find(key);
+                if (it != key_ids.end()) {
+                    return(it->second);
+                }
+                uint32_t id = static_cast<uint32_t>(keys.size());
+                key_ids.emplace(key, id);
+                keys.push_back(key);
+                return(id);
+            }
+
+            void open_file() {
+                std::string path = pool.temp_dir + "/kecx-spill-XXXXXX";
+                fd = ::mkstemp(&path[0]);
+                if (fd < 0) {
+                    throw SpillError(
+                        "kecx: cannot create a spill file in \"" + pool.temp_dir + "\""
+                    );
+                }
+                // the file disappears with its descriptor
+                ::unlink(path.c_str());
+            }
+
+            /**
+             * @brief
+             * Append the records in memory to the spill file.
+            */
+            void spill() {
+                if (fd < 0) {
+                    open_file();
+                }
+                const char* p = data.data();
+                std::size_t left = data.size();
+                while (left > 0) {
+                    ssize_t written = ::write(fd, p, left);
+                    if (written < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (written <= 0) {
+                        throw SpillError("kecx: cannot write spill file");
+                    }
+                    p += written;
+                    left -= static_cast<std::size_t>(written);
+                }
+                std::size_t n = data.size();
+                file_size += n;
+                pool.spilled_bytes_ += n;
+                // give the memory back, not just the size
+                std::string().swap(data);
+                pool.shrunk(*this, n);
+            }
+
+            /**
+             * @brief
+             * Reads spilled records through a window of the spill file,
+             * allocated on first use.
+            */
+            class FileReader {
+                private:
+                    int fd;
+                    uint64_t file_end;
+                    std::vector<char> window;
+                    uint64_t window_begin = 0;
+                    std::size_t window_size = 0;
+
+                public:
+                    FileReader(const int& fd, const uint64_t& file_end) :
+                        fd(fd),
+                        file_end(file_end)
+                    {}
+
+                    /**
+                     * @brief
+                     * The `n` bytes of the spill file at `offset`, valid
+                     * until the next call.
+                    */
+                    const char* get(const uint64_t& offset, const std::size_t& n) {
+                        if (offset >= window_begin && offset + n <= window_begin + window_size) {
+                            return(window.data() + (offset - window_begin));
+                        }
+                        if (offset + n > file_end) {
+                            throw SpillError("kecx: spill file is truncated");
+                        }
+                        if (window.size() < std::max(n, replay_buffer_size)) {
+                            window.resize(std::max(n, replay_buffer_size));
+                        }
+                        std::size_t want = static_cast<std::size_t>(
+                            std::min<uint64_t>(window.size(), file_end - offset)
+                        );
+                        window_begin = offset;
+                        window_size = 0;
+                        while (window_size < want) {
+                            ssize_t got = ::pread(
+                                fd,
+                                window.data() + window_size,
+                                want - window_size,
+                                static_cast<off_t>(offset + window_size)
+                            );
+                            if (got < 0 && errno == EINTR) {
+                                continue;
+                            }
+                            if (got <= 0) {
+                                throw SpillError("kecx: cannot read spill file");
+                            }
+                            window_size += static_cast<std::size_t>(got);
+                        }
+                        return(window.data());
+                    }
+            };
+
+        public:
+            Buffer(Pool& pool) : pool(pool) {
+                pool.insert(*this);
+            }
+
+            Buffer(const Buffer&) = delete;
+            Buffer& operator=(const Buffer&) = delete;
+
+            ~Buffer() {
+                clear();
+                pool.remove(*this);
+            }
+
+            /**
+             * @brief
+             * Bytes of records added so far, spilled or not; the position
+             * of the next record for `replay`.
+            */
+            uint64_t size() const {
+                return(file_size + data.size());
+            }
+
+            /**
+             * @brief
+             * Append a record. May spill any buffer of the pool.
+            */
+            void add(
+                const std::string& key,
+                const std::string& line,
+                const int& line_no
+            ) {
+                RecordHeader header{line.size(), key_id(key), line_no};
+                data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+                data.append(line);
+                pool.grown(*this, sizeof(header) + line.size());
+            }
+
+            /**
+             * @brief
+             * A `store` that appends to this buffer.
+            */
+            store::store_type store() {
+                return([this](
+                    const std::string& key,
+                    const std::string& line,
+                    const int& line_no
+                ) -> void
+                {
+                    add(key, line, line_no);
+                });
+            }
+
+            /**
+             * @brief
+             * Pass the records between the positions `begin` and `end` (see
+             * `size`) to `store` in the order they were added.
+            */
+            void replay(
+                const store::store_type& store,
+                const uint64_t& begin,
+                const uint64_t& end
+            ) const {
+                RecordHeader header;
+                std::string line;
+                uint64_t position = begin;
+                if (position < file_size) {
+                    FileReader reader(fd, std::min(end, file_size));
+                    while (position < std::min(end, file_size)) {
+                        std::memcpy(&header, reader.get(position, sizeof(header)), sizeof(header));
+                        position += sizeof(header);
+                        line.assign(reader.get(position, header.size), header.size);
+                        position += header.size;
+                        store(keys[header.key], line, header.line_no);
+                    }
+                }
+                while (position < end) {
+                    const char* p = data.data() + (position - file_size);
+                    std::memcpy(&header, p, sizeof(header));
+                    line.assign(p + sizeof(header), header.size);
+                    position += sizeof(header) + header.size;
+                    store(keys[header.key], line, header.line_no);
+                }
+            }
+
+            /**
+             * @brief
+             * Pass all records to `store` in the order they were added.
+            */
+            void replay(const store::store_type& store) const {
+                replay(store, 0, size());
+            }
+
+            /**
+             * @brief
+             * Drop all records and the spill file.
+            */
+            void clear() {
+                std::size_t n = data.size();
+                std::string().swap(data);
+                pool.shrunk(*this, n);
+                keys.clear();
+                key_ids.clear();
+                if (fd >= 0) {
+                    ::close(fd);
+                    fd = -1;
+                }
+                file_size = 0;
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    inline void Pool::swap_entries(const std::size_t& i, const std::size_t& j) {
+        std::swap(heap[i], heap[j]);
+        heap[i]->heap_index = i;
+        heap[j]->heap_index = j;
+    }
+
+    inline void Pool::sift_up(std::size_t i) {
+        while (i > 0 && heap[(i - 1) / 2]->data.size() < heap[i]->data.size()) {
+            swap_entries(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    inline void Pool::sift_down(std::size_t i) {
+        while (true) {
+            std::size_t largest = i;
+            for (std::size_t child = 2 * i + 1; child <= 2 * i + 2 && child < heap.size(); ++child) {
+                if (heap[child]->data.size() > heap[largest]->data.size()) {
+                    largest = child;
+                }
+            }
+            if (largest == i) {
+                return;
+            }
+            swap_entries(i, largest);
+            i = largest;
+        }
+    }
+
+    inline void Pool::insert(Buffer& buffer) {
+        buffer.heap_index = heap.size();
+        heap.push_back(&buffer);
+        sift_up(buffer.heap_index);
+    }
+
+    inline void Pool::remove(Buffer& buffer) {
+        std::size_t i = buffer.heap_index;
+        swap_entries(i, heap.size() - 1);
+        heap.pop_back();
+        if (i < heap.size()) {
+            Buffer* moved = heap[i];
+            sift_up(i);
+            sift_down(moved->heap_index);
+        }
+    }
+
+    /**
+     * @brief
+     * Account for `n` more bytes in memory of `buffer` and, if that exceeds
+     * the budget, spill the largest buffers until it does not.
+    */
+    inline void Pool::grown(Buffer& buffer, const std::size_t& n) {
+        used_ += n;
+        peak_ = std::max(peak_, used_);
+        sift_up(buffer.heap_index);
+        while (used_ > memory_budget && heap.size() > 0 && heap[0]->data.size() > 0) {
+            heap[0]->spill();
+        }
+    }
+
+    inline void Pool::shrunk(Buffer& buffer, const std::size_t& n) {
+        used_ -= n;
+        sift_down(buffer.heap_index);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace spill
+
+#endif
@@ -5,8 +5,12 @@
 #include <vector>
 #include <fstream>
 #include <iostream>
-#include <regex>
 #include <functional>
+#include <string_view>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace store{
     // -------------------------------------------------------------------------
@@ -21,6 +25,58 @@ namespace store{
         )>
         store_type;
     
+    /**
+     * @brief
+     * `is_store<T>::value` is `true` if a `const T&` can be called like a
+     * `store_type`. The line loop takes such stores as template parameters,
+     * so that concrete stores are inlined into it; `store_type` is the
+     * type-erased case.
+    */
+    template<typename T>
+    using is_store = std::is_invocable<
+        const T&,
+        const std::string&,
+        const std::string&,
+        const int&
+    >;
+
+    template<typename T>
+    using if_store = std::enable_if_t<is_store<T>::value>;
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Store that discards everything, e.g. to measure the line loop alone.
+    */
+    struct NullStore {
+        void operator()(
+            const std::string&,
+            const std::string&,
+            const int&
+        ) const {}
+    };
+
+    /**
+     * @brief
+     * Store that only counts the lines and bytes passed to it. Pass it
+     * directly, not as a `store_type` (which would count in a copy).
+    */
+    struct CountingStore {
+        mutable unsigned long long lines = 0;
+        mutable unsigned long long bytes = 0;
+
+        void operator()(
+            const std::string&,
+            const std::string& line,
+            const int&
+        ) const {
+            lines += 1;
+            bytes += line.size();
+        }
+    };
+
     // -------------------------------------------------------------------------
     // -------------------------------------------------------------------------
     // -------------------------------------------------------------------------
@@ -36,7 +92,7 @@ namespace store{
      * @param line_no
      * Line number not stored anywhere by default.
     */
-    void store_default(
+    inline void store_default(
         const std::string& key,
         const std::string& line,
         const int& line_no
@@ -63,8 +119,8 @@ namespace store{
      * @param output_dir_path
      * Path to directory into which the output function will write data.
     */
-    auto store_to_txt_factory(std::string output_dir_path) {
-        return [&](
+    inline auto store_to_txt_factory(std::string output_dir_path) {
+        return [output_dir_path](
             const std::string& key,
             const std::string& line,
             const int& line_no
@@ -81,6 +137,166 @@ namespace store{
             }
         };
     }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Block stores
+    //
+    // A `store` callback is invoked once per line and key. Stores that
+    // prefer whole blocks implement `kecx::store::BlockStore` instead and
+    // are passed to `kecx::extract::Extractor::extract`. They receive
+    // `begin(block)` when a tag opens a block (with its key, kind, file and
+    // the line number of the tag), the block's lines in one or more
+    // `lines(block, batch)` calls, and `end(block)` when it is closed (by
+    // its footer, by the next tag or by the end of the file). A batch is a
+    // single buffer of newline-terminated lines, so
+    // `kecx::store::TxtBlockStore` writes each block into its key's file
+    // with one `write` instead of opening the file once per line.
+    // `kecx::store::LineStoreAdapter` turns a line `store` into a block
+    // store.
+    //
+    // @docstop README.md
+
+    enum class BlockKind {
+        header_footer,
+        either,
+        header_only
+    };
+
+    /**
+     * @brief
+     * A block of lines under one key.
+    */
+    struct Block {
+        std::string key;
+        BlockKind kind;
+        // path of the file the block is in; empty for streams
+        std::string file;
+        // line number of the tag that opened the block
+        int line_no;
+    };
+
+    /**
+     * @brief
+     * Consecutive lines of a block.
+    */
+    struct LineBatch {
+        // the lines, each followed by '\n'
+        std::string_view text;
+        // `ends[i]` is the offset of the '\n' ending line `i` in `text`
+        const std::vector<std::size_t>& ends;
+        // `line_nos[i]` is the line number of line `i`
+        const std::vector<int>& line_nos;
+
+        std::size_t size() const {
+            return(ends.size());
+        }
+
+        std::string_view line(const std::size_t& i) const {
+            std::size_t start = i == 0 ? 0 : ends[i - 1] + 1;
+            return(text.substr(start, ends[i] - start));
+        }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Receives extraction results block by block. Blocks of different keys
+     * (and of the same key under different kinds) may be open at the same
+     * time, so calls for several blocks can be interleaved; the calls for
+     * one block are always `begin`, zero or more `lines` and `end`. If
+     * extraction fails, the lines read so far are still passed to `lines`,
+     * but the open blocks are not ended.
+    */
+    class BlockStore {
+        public:
+            virtual ~BlockStore() {}
+
+            virtual void begin(const Block& block) = 0;
+            virtual void lines(const Block& block, const LineBatch& batch) = 0;
+            virtual void end(const Block& block) = 0;
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Block store writing into the same files as `store_to_txt_factory`
+     * (`output_dir_path + key`), each batch with a single `write`. A key's
+     * file receives its blocks one after the other; only where blocks of
+     * the same key overlap (e.g. a header-footer and an "either" block)
+     * are their lines not interleaved as with the line store.
+    */
+    class TxtBlockStore : public BlockStore {
+        private:
+            std::string output_dir_path;
+
+        public:
+            TxtBlockStore(const std::string& output_dir_path) :
+                output_dir_path(output_dir_path)
+            {}
+
+            void begin(const Block&) override {}
+
+            void lines(const Block& block, const LineBatch& batch) override {
+                std::string output_file_path = output_dir_path + block.key;
+                int fd = ::open(
+                    output_file_path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644
+                );
+                if (fd < 0) {
+                    // like `store_to_txt_factory`, skip unwritable files
+                    return;
+                }
+                const char* data = batch.text.data();
+                std::size_t left = batch.text.size();
+                while (left > 0) {
+                    ssize_t written = ::write(fd, data, left);
+                    if (written <= 0) {
+                        break;
+                    }
+                    data += written;
+                    left -= static_cast<std::size_t>(written);
+                }
+                ::close(fd);
+            }
+
+            void end(const Block&) override {}
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Block store passing every line to a line `store`.
+    */
+    class LineStoreAdapter : public BlockStore {
+        private:
+            store_type store;
+            std::string line;
+
+        public:
+            LineStoreAdapter(const store_type& store) : store(store) {}
+
+            void begin(const Block&) override {}
+
+            void lines(const Block& block, const LineBatch& batch) override {
+                for (std::size_t i = 0; i < batch.size(); ++i) {
+                    std::string_view view = batch.line(i);
+                    line.assign(view.data(), view.size());
+                    store(block.key, line, batch.line_nos[i]);
+                }
+            }
+
+            void end(const Block&) override {}
+    };
+
     // -------------------------------------------------------------------------
     // -------------------------------------------------------------------------
     // -------------------------------------------------------------------------
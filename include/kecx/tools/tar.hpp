@@ -0,0 +1,522 @@
+#ifndef TAR_HPP
+#define TAR_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <functional>
+#include <stdexcept>
+#include <exception>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+#include <fnmatch.h>
+
+#include "store.hpp"
+#include "input.hpp"
+#include "extractor.hpp"
+#include "spill.hpp"
+#include "trace.hpp"
+
+namespace tar {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Extracting from tar archives
+    //
+    // `kecx::tar::extract` runs an `Extractor` over the members of a tar
+    // archive (plain, or gzip/zstd-compressed, see "Compressed input")
+    // without unpacking it. The archive is read once as a stream; regular
+    // file members whose path matches one of the given globs (`fnmatch`
+    // syntax, `*` also matches `/`) are fed to the extractor with their
+    // member path as the file identity. ustar, GNU long names and pax
+    // `path` headers are understood. The extracted records are handed to
+    // the store in member-path order, i.e. exactly as a run of the
+    // multi-file `extract` over the sorted paths of the unpacked files would
+    // produce them --- including where such a run would stop on an
+    // exception.
+    //
+    // ```
+    // kecx::extract::Extractor extractor(
+    //     "[/][*]", "[*][/]", "//", {}, {"@start"}, {"@stop"}, {}
+    // );
+    // kecx::tar::extract(
+    //     "release.tar.gz", extractor, {"*.hpp", "*.cpp"},
+    //     kecx::store::store_to_txt_factory("output")
+    // );
+    // ```
+    //
+    // @docstop README.md
+
+    /**
+     * @brief
+     * Thrown for malformed or truncated archives, as opposed to errors in
+     * the contents of a member.
+    */
+    class ArchiveError : public std::runtime_error {
+        public:
+            ArchiveError(const std::string& msg) : std::runtime_error(msg) {}
+    };
+
+    /**
+     * @brief
+     * Size of a tar block; headers and member bodies are padded to it.
+    */
+    const std::size_t block_size = 512;
+
+    /**
+     * @brief
+     * Read `n` bytes of the archive into `out`. A short read or an error of
+     * the underlying (e.g. decompressing) stream throws `ArchiveError`.
+     * Returns `false` only if the archive ended before the first byte and
+     * `allow_end`.
+    */
+    inline bool read_archive(
+        std::istream& archive,
+        char* out,
+        const std::size_t& n,
+        const bool& allow_end = false
+    ) {
+        std::size_t got = 0;
+        try {
+            archive.read(out, static_cast<std::streamsize>(n));
+            got = static_cast<std::size_t>(archive.gcount());
+        } catch (const std::exception& e) {
+            throw ArchiveError(std::string("kecx: cannot read tar archive: ") + e.what());
+        }
+        if (got == 0 && n > 0 && allow_end) {
+            return(false);
+        }
+        if (got != n) {
+            throw ArchiveError("kecx: tar archive is truncated");
+        }
+        return(true);
+    }
+
+    /**
+     * @brief
+     * A member of a tar archive as announced by its header. `type` is the
+     * ustar type flag, with `'\0'` normalised to `'0'`; `size` is the size
+     * of its body.
+    */
+    struct Member {
+        std::string path;
+        char type = '0';
+        uint64_t size = 0;
+
+        bool is_regular_file() const {
+            return(type == '0' || type == '7');
+        }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Stream buffer over the next `size` bytes of `source`, i.e. the body of
+     * one member.
+    */
+    class BodyStreambuf : public std::streambuf {
+        private:
+            std::istream& source;
+            uint64_t remaining;
+            std::vector<char> buffer;
+
+        protected:
+            int_type underflow() override {
+                if (gptr() < egptr()) {
+                    return(traits_type::to_int_type(*gptr()));
+                }
+                if (remaining == 0) {
+                    return(traits_type::eof());
+                }
+                std::size_t n = static_cast<std::size_t>(
+                    std::min<uint64_t>(remaining, buffer.size())
+                );
+                read_archive(source, buffer.data(), n);
+                remaining -= n;
+                setg(buffer.data(), buffer.data(), buffer.data() + n);
+                return(traits_type::to_int_type(*gptr()));
+            }
+
+        public:
+            BodyStreambuf(std::istream& source, const uint64_t& size) :
+                source(source),
+                remaining(size),
+                buffer(input::decompression_buffer_size)
+            {
+                setg(buffer.data(), buffer.data(), buffer.data());
+            }
+
+            /**
+             * @brief
+             * Copy up to `n` bytes from the start of the body into `out`
+             * without consuming them; returns how many were copied. Only
+             * valid before anything was read.
+            */
+            std::size_t peek(char* out, const std::size_t& n) {
+                if (sgetc() == traits_type::eof()) {
+                    return(0);
+                }
+                std::size_t k = std::min<std::size_t>(n, egptr() - gptr());
+                std::memcpy(out, gptr(), k);
+                return(k);
+            }
+
+            /**
+             * @brief
+             * Skip the unread rest of the body.
+            */
+            void skip_rest() {
+                setg(buffer.data(), buffer.data(), buffer.data());
+                while (remaining > 0) {
+                    std::size_t n = static_cast<std::size_t>(
+                        std::min<uint64_t>(remaining, buffer.size())
+                    );
+                    read_archive(source, buffer.data(), n);
+                    remaining -= n;
+                }
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Sequential reader of a tar archive. Call `next` to advance to the next
+     * member and read its contents from `body()` before calling `next`
+     * again; whatever is left unread is skipped. GNU long name (`'L'`) and
+     * pax (`'x'`) headers are consumed and applied to the member that
+     * follows them; they are not returned as members themselves.
+    */
+    class Reader {
+        private:
+            std::istream& archive;
+            std::unique_ptr<BodyStreambuf> body_buffer;
+            std::unique_ptr<std::istream> body_stream;
+            uint64_t padding = 0;
+            bool done = false;
+
+            static uint64_t parse_number(const char* field, const std::size_t& n) {
+                const unsigned char* f = reinterpret_cast<const unsigned char*>(field);
+                uint64_t value = 0;
+                if (f[0] & 0x80) {
+                    // GNU base-256 encoding for large values
+                    value = f[0] & 0x7f;
+                    for (std::size_t i = 1; i < n; ++i) {
+                        value = (value << 8) | f[i];
+                    }
+                    return(value);
+                }
+                std::size_t i = 0;
+                while (i < n && field[i] == ' ') {
+                    i += 1;
+                }
+                for (; i < n && field[i] >= '0' && field[i] <= '7'; ++i) {
+                    value = value * 8 + static_cast<uint64_t>(field[i] - '0');
+                }
+                return(value);
+            }
+
+            static std::string field_string(const char* field, const std::size_t& n) {
+                const char* end = static_cast<const char*>(std::memchr(field, '\0', n));
+                return(std::string(field, end == nullptr ? n : end - field));
+            }
+
+            static bool checksum_ok(const char* header) {
+                const unsigned char* h = reinterpret_cast<const unsigned char*>(header);
+                uint64_t sum = 0;
+                for (std::size_t i = 0; i < block_size; ++i) {
+                    // the checksum field itself counts as spaces
+                    sum += (i >= 148 && i < 156) ? ' ' : h[i];
+                }
+                return(sum == parse_number(header + 148, 8));
+            }
+
+            std::string read_body(const uint64_t& size) {
+                std::string body(static_cast<std::size_t>(size), '\0');
+                read_archive(archive, &body[0], body.size());
+                skip_padding(size);
+                return(body);
+            }
+
+            void skip_padding(const uint64_t& size) {
+                char block[block_size];
+                std::size_t pad = static_cast<std::size_t>(
+                    (block_size - size % block_size) % block_size
+                );
+                read_archive(archive, block, pad);
+            }
+
+            static std::string pax_path(const std::string& records) {
+                // records are "<length> <key>=<value>\n"
+                std::string path;
+                std::size_t i = 0;
+                while (i < records.size()) {
+                    std::size_t space = records.find(' ', i);
+                    if (space == std::string::npos) {
+                        break;
+                    }
+                    std::size_t length = static_cast<std::size_t>(
+                        std::strtoull(records.c_str() + i, nullptr, 10)
+                    );
+                    if (length == 0 || i + length > records.size()) {
+                        break;
+                    }
+                    std::string record = records.substr(space + 1, i + length - space - 2);
+                    std::size_t eq = record.find('=');
+                    if (eq != std::string::npos && record.substr(0, eq) == "path") {
+                        path = record.substr(eq + 1);
+                    }
+                    i += length;
+                }
+                return(path);
+            }
+
+        public:
+            Reader(std::istream& archive) : archive(archive) {}
+
+            /**
+             * @brief
+             * Advance to the next member. Returns `false` at the end of the
+             * archive. Throws `ArchiveError` on malformed or truncated
+             * archives.
+            */
+            bool next(Member& member) {
+                if (done) {
+                    return(false);
+                }
+                if (body_buffer) {
+                    body_buffer->skip_rest();
+                    body_stream.reset();
+                    body_buffer.reset();
+                    char block[block_size];
+                    read_archive(archive, block, padding);
+                }
+                std::string long_path;
+                char header[block_size];
+                while (true) {
+                    bool zero = !read_archive(archive, header, block_size, true) ||
+                        std::all_of(header, header + block_size, [](char c) {
+                            return(c == '\0');
+                        });
+                    if (zero) {
+                        // end-of-archive marker (or an archive without one)
+                        done = true;
+                        return(false);
+                    }
+                    if (!checksum_ok(header)) {
+                        throw ArchiveError(
+                            "kecx: invalid tar header checksum --- not a tar archive?"
+                        );
+                    }
+                    char type = header[156] == '\0' ? '0' : header[156];
+                    uint64_t size = parse_number(header + 124, 12);
+                    if (type == 'L') {
+                        long_path = field_string(read_body(size).c_str(), size);
+                        continue;
+                    }
+                    if (type == 'x') {
+                        std::string path = pax_path(read_body(size));
+                        if (path != "") {
+                            long_path = path;
+                        }
+                        continue;
+                    }
+                    if (type == 'g' || type == 'K') {
+                        read_body(size);
+                        continue;
+                    }
+
+                    member.type = type;
+                    if (long_path != "") {
+                        member.path = long_path;
+                    } else {
+                        member.path = field_string(header, 100);
+                        std::string prefix = field_string(header + 345, 155);
+                        if (std::memcmp(header + 257, "ustar", 5) == 0 && prefix != "") {
+                            member.path = prefix + "/" + member.path;
+                        }
+                    }
+                    // links, devices, directories and FIFOs have no body
+                    bool has_body = std::strchr("123456", type) == nullptr;
+                    member.size = has_body ? size : 0;
+                    padding = (block_size - member.size % block_size) % block_size;
+                    body_buffer.reset(new BodyStreambuf(archive, member.size));
+                    body_stream.reset(new std::istream(body_buffer.get()));
+                    // let `ArchiveError`s through instead of ending the body
+                    body_stream->exceptions(std::ios::badbit);
+                    return(true);
+                }
+            }
+
+            /**
+             * @brief
+             * Contents of the current member.
+            */
+            std::istream& body() {
+                return(*body_stream);
+            }
+
+            /**
+             * @brief
+             * Up to `n` bytes from the start of the current member, without
+             * consuming them. Only valid before `body()` was read from.
+            */
+            std::size_t peek(char* out, const std::size_t& n) {
+                return(body_buffer->peek(out, n));
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * `true` if `patterns` is empty or `path` matches one of them
+     * (`fnmatch` without flags, so `*` also matches `/`).
+    */
+    inline bool path_matches(
+        const std::string& path,
+        const std::vector<std::string>& patterns
+    ) {
+        if (patterns.size() == 0) {
+            return(true);
+        }
+        for (const std::string& pattern : patterns) {
+            if (fnmatch(pattern.c_str(), path.c_str(), 0) == 0) {
+                return(true);
+            }
+        }
+        return(false);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Extract keyed comments from the regular file members of the tar archive
+     * at `archive_path` whose path matches `patterns`.
+     * @param archive_path
+     * Path to a tar archive, optionally gzip- or zstd-compressed.
+     * @param extractor
+     * Settings to extract with.
+     * @param patterns
+     * Globs the member paths must match (any of them); empty means all.
+     * @param store_for
+     * Called with each member path, in sorted order, to obtain the `store`
+     * for that member's records.
+     * @param stats
+     * Counters to add to.
+     * @param memory_budget
+     * Bytes of buffered records kept in memory; more are spilled to a
+     * temporary file (see `spill::Pool`).
+    */
+    inline void extract(
+        const std::string& archive_path,
+        const extract::Extractor& extractor,
+        const std::vector<std::string>& patterns,
+        const std::function<store::store_type(const std::string&)>& store_for,
+        extract::Stats& stats,
+        const std::size_t& memory_budget = spill::default_memory_budget
+    ) {
+        struct MemberResult {
+            // range of the member's records in `records`
+            uint64_t begin;
+            uint64_t end;
+            std::exception_ptr error;
+        };
+        // members arrive in archive order; their records are buffered one
+        // after another in a single spill buffer and replayed in path
+        // order. A later member with the same path replaces an earlier one,
+        // as when unpacking.
+        spill::Pool pool(memory_budget);
+        spill::Buffer records(pool);
+        store::store_type buffer_store = records.store();
+        std::map<std::string, MemberResult> results;
+
+        input::FileInput archive_input(archive_path);
+        Reader reader(archive_input.stream());
+        Member member;
+        while (reader.next(member)) {
+            if (!member.is_regular_file() || !path_matches(member.path, patterns)) {
+                continue;
+            }
+            MemberResult& result = results[member.path];
+            result = MemberResult();
+            result.begin = records.size();
+            try {
+                // compressed members are decompressed as on disk
+                char magic[4];
+                std::size_t n_magic = reader.peek(magic, sizeof(magic));
+                std::unique_ptr<std::streambuf> decompressor;
+                std::unique_ptr<std::istream> decompressed =
+                    input::decompressing_stream(
+                        reader.body(),
+                        input::detect_compression(magic, n_magic),
+                        decompressor,
+                        member.path
+                    );
+                extractor.extract(
+                    decompressed ? *decompressed : reader.body(),
+                    buffer_store,
+                    stats
+                );
+            } catch (const ArchiveError&) {
+                throw;
+            } catch (const spill::SpillError&) {
+                throw;
+            } catch (...) {
+                result.error = std::current_exception();
+            }
+            result.end = records.size();
+        }
+
+        for (const auto& path_result : results) {
+            const MemberResult& result = path_result.second;
+            trace::Span span(extractor.trace(), "store", "tar", path_result.first);
+            records.replay(store_for(path_result.first), result.begin, result.end);
+            span.end();
+            if (result.error) {
+                std::rethrow_exception(result.error);
+            }
+        }
+    }
+
+    /**
+     * @brief
+     * As above, with one `store` for all members.
+    */
+    inline void extract(
+        const std::string& archive_path,
+        const extract::Extractor& extractor,
+        const std::vector<std::string>& patterns,
+        const store::store_type& store = store::store_default
+    ) {
+        extract::Stats stats;
+        extract(
+            archive_path,
+            extractor,
+            patterns,
+            [&store](const std::string&) -> store::store_type {
+                return(store);
+            },
+            stats
+        );
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace tar
+
+#endif
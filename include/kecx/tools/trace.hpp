@@ -0,0 +1,312 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace trace {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Tracing
+    //
+    // Counters such as `kecx::extract::Stats` tell how much was done, not
+    // when or on which thread. A `kecx::trace::Recorder` collects timed spans
+    // instead and writes them as Chrome trace JSON, which can be opened in
+    // Perfetto (https://ui.perfetto.dev) or `chrome://tracing`:
+    //
+    // ```
+    // kecx::trace::Recorder recorder;
+    // kecx::extract::Extractor extractor(settings);
+    // extractor.set_trace(&recorder);
+    // for (const std::string& file_path : file_paths) {
+    //     extractor.extract(file_path, store);
+    // }
+    // recorder.write("./output/kecx.trace.json");
+    // ```
+    //
+    // An `Extractor` records a span for opening and mapping each file
+    // (`open`), the prefilter (`prefilter`), the line loop (`scan`) and for
+    // passing lines to a `store::BlockStore` (`store`). `kecx::tar::extract`
+    // adds the replay of each member's records (`store`), and a
+    // `kecx::server::Server` given a recorder adds the time spent waiting
+    // for requests (`wait`) and answering them (`request`). Spans carry the
+    // id of the thread that recorded them, so a recorder shared by several
+    // threads shows one track per thread. Without a recorder (the default)
+    // no clock is read and nothing is recorded.
+    //
+    // @docstop README.md
+
+    /**
+     * @brief
+     * One completed span; times in nanoseconds since the recorder was
+     * created.
+    */
+    struct Event {
+        const char* name;
+        const char* category;
+        std::string detail;
+        int64_t begin;
+        int64_t duration;
+        long thread;
+    };
+
+    // default `detail` of a `Span`
+    inline const std::string no_detail;
+
+    /**
+     * @brief
+     * Id of the calling thread as shown by the OS (e.g. in `top -H`).
+    */
+    inline long thread_id() {
+        return(static_cast<long>(::syscall(SYS_gettid)));
+    }
+
+    /**
+     * @brief
+     * Append `x` to `out` as the contents of a JSON string.
+    */
+    inline void append_json_escaped(std::string& out, const std::string& x) {
+        for (char c : x) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char escaped[8];
+                        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        out += escaped;
+                    } else {
+                        out += c;
+                    }
+            }
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Collects spans from any number of threads. Recording a span takes a
+     * lock, so spans should cover work of at least a few microseconds (a
+     * file, a block of lines), not single lines.
+    */
+    class Recorder {
+        private:
+            typedef std::chrono::steady_clock clock;
+
+            clock::time_point origin;
+            mutable std::mutex mutex;
+            std::vector<Event> events_;
+            // (thread id, name) as set by `name_thread`
+            std::vector<std::pair<long, std::string>> thread_names;
+
+        public:
+            Recorder() : origin(clock::now()) {}
+
+            Recorder(const Recorder&) = delete;
+            Recorder& operator=(const Recorder&) = delete;
+
+            /**
+             * @brief
+             * Nanoseconds since the recorder was created.
+            */
+            int64_t now() const {
+                return(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    clock::now() - origin
+                ).count());
+            }
+
+            /**
+             * @brief
+             * Record a span of the calling thread.
+             * @param name
+             * Span name; must outlive the recorder, e.g. a string literal.
+             * @param category
+             * As `name`, e.g. "extract".
+             * @param detail
+             * Shown with the span, e.g. a file path; may be empty.
+            */
+            void add(
+                const char* name,
+                const char* category,
+                const std::string& detail,
+                const int64_t& begin,
+                const int64_t& end
+            ) {
+                long thread = thread_id();
+                std::lock_guard<std::mutex> lock(mutex);
+                events_.push_back(Event{name, category, detail, begin, end - begin, thread});
+            }
+
+            /**
+             * @brief
+             * Name the calling thread's track, e.g. "worker 3".
+            */
+            void name_thread(const std::string& name) {
+                long thread = thread_id();
+                std::lock_guard<std::mutex> lock(mutex);
+                thread_names.emplace_back(thread, name);
+            }
+
+            /**
+             * @brief
+             * Copy of the spans recorded so far, in the order they ended.
+            */
+            std::vector<Event> events() const {
+                std::lock_guard<std::mutex> lock(mutex);
+                return(events_);
+            }
+
+            void clear() {
+                std::lock_guard<std::mutex> lock(mutex);
+                events_.clear();
+                thread_names.clear();
+            }
+
+            /**
+             * @brief
+             * Write the spans recorded so far as Chrome trace JSON.
+            */
+            void write(std::ostream& out) const {
+                std::lock_guard<std::mutex> lock(mutex);
+                long pid = static_cast<long>(::getpid());
+                std::string json = "{\"traceEvents\":[\n";
+                bool first = true;
+                auto separate = [&json, &first]() {
+                    if (!first) {
+                        json += ",\n";
+                    }
+                    first = false;
+                };
+                char number[64];
+                for (const auto& thread_name : thread_names) {
+                    separate();
+                    json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":";
+                    json += std::to_string(pid);
+                    json += ",\"tid\":";
+                    json += std::to_string(thread_name.first);
+                    json += ",\"args\":{\"name\":\"";
+                    append_json_escaped(json, thread_name.second);
+                    json += "\"}}";
+                }
+                for (const Event& event : events_) {
+                    separate();
+                    json += "{\"name\":\"";
+                    append_json_escaped(json, event.name);
+                    json += "\",\"cat\":\"";
+                    append_json_escaped(json, event.category);
+                    // microseconds, as expected by the viewers
+                    std::snprintf(
+                        number, sizeof(number), "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f",
+                        event.begin / 1000.0, event.duration / 1000.0
+                    );
+                    json += number;
+                    json += ",\"pid\":";
+                    json += std::to_string(pid);
+                    json += ",\"tid\":";
+                    json += std::to_string(event.thread);
+                    if (event.detail.size() > 0) {
+                        json += ",\"args\":{\"detail\":\"";
+                        append_json_escaped(json, event.detail);
+                        json += "\"}";
+                    }
+                    json += "}";
+                }
+                json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+                out << json;
+            }
+
+            /**
+             * @brief
+             * Write the spans recorded so far to the file at `file_path`.
+            */
+            void write(const std::string& file_path) const {
+                std::ofstream out(file_path, std::ios::binary);
+                if (!out) {
+                    throw std::invalid_argument(
+                        "Cannot write trace to file_path = \"" + file_path + "\""
+                    );
+                }
+                write(out);
+                if (!out) {
+                    throw std::runtime_error("kecx: failed to write trace to " + file_path);
+                }
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Records the time from its construction to its destruction (or
+     * `end()`) with `recorder`; does nothing if `recorder` is `nullptr`.
+     * `name`, `category` and `detail` are as for `Recorder::add`; `detail`
+     * is only referenced and must outlive the span.
+    */
+    class Span {
+        private:
+            Recorder* recorder;
+            const char* name;
+            const char* category;
+            const std::string* detail;
+            int64_t begin = 0;
+
+        public:
+            Span(
+                Recorder* recorder,
+                const char* name,
+                const char* category,
+                const std::string& detail = no_detail
+            ) :
+                recorder(recorder),
+                name(name),
+                category(category),
+                detail(&detail)
+            {
+                if (recorder != nullptr) {
+                    begin = recorder->now();
+                }
+            }
+
+            Span(const Span&) = delete;
+            Span& operator=(const Span&) = delete;
+
+            /**
+             * @brief
+             * Record the span now instead of at destruction.
+            */
+            void end() {
+                if (recorder != nullptr) {
+                    recorder->add(name, category, *detail, begin, recorder->now());
+                    recorder = nullptr;
+                }
+            }
+
+            ~Span() {
+                end();
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace trace
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef TRANSFORM_HPP
+#define TRANSFORM_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+namespace transform {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // @docstart README.md
+    //
+    // ## Post-processing lines
+    //
+    // Cleaning only removes the comment markers and tags, so e.g. Doxygen
+    // comments keep their ` * ` gutter (see `example_02.cpp`). Instead of
+    // rewriting the output files afterwards, give the `Extractor` a
+    // `kecx::transform::Pipeline`: its stages are applied, in order, to
+    // every cleaned line of a block before it is stored.
+    //
+    // - `strip_gutter()`: remove a leading `*` gutter with the whitespace
+    //   before it and one space after it
+    // - `dedent()`: remove the indentation of the block's first non-blank
+    //   line from all its lines; blank lines become empty
+    // - `collapse_blank_lines()`: drop blank lines that follow a blank line
+    // - `drop_duplicate_lines()`: drop lines equal to the line before
+    // - `custom(function)`: any `bool(std::string_view& line)`, which may
+    //   narrow `line` and returns `false` to drop it
+    //
+    // ```
+    // kecx::extract::Extractor extractor(settings);
+    // extractor.set_transforms(kecx::transform::Pipeline()
+    //     .then(kecx::transform::strip_gutter())
+    //     .then(kecx::transform::dedent())
+    //     .then(kecx::transform::collapse_blank_lines()));
+    // ```
+    //
+    // Stages work on views of the cleaned line and do not copy it; the
+    // line is copied once more only if it has changed. "The line before"
+    // is the previous line of the same block that was stored, so each
+    // block (and each key of a line in several blocks) is processed on its
+    // own. Dropped lines are counted in `kecx::extract::Stats::lines_dropped`.
+    // Only the default fast engine applies transforms; combining them with
+    // `kecx::extract::Engine::reference` throws.
+    //
+    // @docstop README.md
+
+    /**
+     * @brief
+     * What a `Stage` does, see the functions of the same names.
+    */
+    enum class Step {
+        strip_gutter,
+        dedent,
+        collapse_blank_lines,
+        drop_duplicate_lines,
+        custom
+    };
+
+    /**
+     * @brief
+     * One step of a `Pipeline`. `function` is only used by `Step::custom`:
+     * it may narrow `line` or point it at other memory valid until the line
+     * is stored, and returns `false` to drop the line.
+    */
+    struct Stage {
+        Step step;
+        std::function<bool(std::string_view& line)> function;
+    };
+
+    inline Stage strip_gutter() {
+        return(Stage{Step::strip_gutter, nullptr});
+    }
+
+    inline Stage dedent() {
+        return(Stage{Step::dedent, nullptr});
+    }
+
+    inline Stage collapse_blank_lines() {
+        return(Stage{Step::collapse_blank_lines, nullptr});
+    }
+
+    inline Stage drop_duplicate_lines() {
+        return(Stage{Step::drop_duplicate_lines, nullptr});
+    }
+
+    inline Stage custom(const std::function<bool(std::string_view& line)>& function) {
+        return(Stage{Step::custom, function});
+    }
+
+    /**
+     * @brief
+     * Number of leading spaces and tabs of `line`.
+    */
+    inline std::size_t indentation(const std::string_view& line) {
+        std::size_t i = 0;
+        while (i < line.size() && (line[i] == ' ' || line[i] == '\t')) {
+            i += 1;
+        }
+        return(i);
+    }
+
+    inline bool is_blank(const std::string_view& line) {
+        return(indentation(line) == line.size());
+    }
+
+    /**
+     * @brief
+     * What a `Pipeline` remembers of one block.
+    */
+    struct BlockState {
+        // indentation removed by `dedent`, set by the first non-blank line
+        std::size_t indent = 0;
+        bool has_indent = false;
+        // the last line of the block that was stored
+        std::string previous;
+        bool has_previous = false;
+
+        void reset() {
+            indent = 0;
+            has_indent = false;
+            previous.clear();
+            has_previous = false;
+        }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    /**
+     * @brief
+     * Stages applied in order to each line of a block, see
+     * `extract::Extractor::set_transforms`.
+    */
+    class Pipeline {
+        private:
+            std::vector<Stage> stages_;
+            // whether a stage looks at the previous line
+            bool keeps_previous = false;
+
+        public:
+            Pipeline() {}
+
+            Pipeline(const std::vector<Stage>& stages) {
+                for (const Stage& stage : stages) {
+                    then(stage);
+                }
+            }
+
+            /**
+             * @brief
+             * Append `stage`.
+            */
+            Pipeline& then(const Stage& stage) {
+                stages_.push_back(stage);
+                keeps_previous = keeps_previous ||
+                    stage.step == Step::collapse_blank_lines ||
+                    stage.step == Step::drop_duplicate_lines;
+                return(*this);
+            }
+
+            const std::vector<Stage>& stages() const {
+                return(stages_);
+            }
+
+            bool empty() const {
+                return(stages_.size() == 0);
+            }
+
+            /**
+             * @brief
+             * Apply the stages to `line`, the next line of the block of
+             * `block`; `false` if the line is dropped.
+            */
+            bool apply(std::string_view& line, BlockState& block) const {
+                for (const Stage& stage : stages_) {
+                    switch (stage.step) {
+                        case Step::strip_gutter: {
+                            std::size_t i = indentation(line);
+                            if (i < line.size() && line[i] == '*') {
+                                i += 1;
+                                if (i < line.size() && line[i] == ' ') {
+                                    i += 1;
+                                }
+                                line.remove_prefix(i);
+                            }
+                            break;
+                        }
+                        case Step::dedent: {
+                            std::size_t n = indentation(line);
+                            if (n == line.size()) {
+                                line.remove_prefix(n);
+                                break;
+                            }
+                            if (!block.has_indent) {
+                                block.indent = n;
+                                block.has_indent = true;
+                            }
+                            line.remove_prefix(std::min(n, block.indent));
+                            break;
+                        }
+                        case Step::collapse_blank_lines:
+                            if (block.has_previous && is_blank(block.previous) && is_blank(line)) {
+                                return(false);
+                            }
+                            break;
+                        case Step::drop_duplicate_lines:
+                            if (block.has_previous && line == block.previous) {
+                                return(false);
+                            }
+                            break;
+                        case Step::custom:
+                            if (!stage.function(line)) {
+                                return(false);
+                            }
+                            break;
+                    }
+                }
+                if (keeps_previous) {
+                    block.previous.assign(line.data(), line.size());
+                    block.has_previous = true;
+                }
+                return(true);
+            }
+    };
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace transform
+
+#endif
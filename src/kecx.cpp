@@ -0,0 +1,178 @@
+// Compiled part of kecx, see `./include/kecx/kecx_lib.hpp`. Build as a
+// static library with
+//
+//     g++ -std=c++17 -O2 -flto -c -I./ src/kecx.cpp -o kecx.o
+//     ar rcs libkecx.a kecx.o
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <memory>
+#include <atomic>
+
+#include "../include/kecx/kecx_lib.hpp"
+#include "../include/kecx/kecx.hpp"
+
+namespace extract {
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // The `Extractor` templates for type-erased stores, used by
+    // `CompiledExtractor` and by translation units that define
+    // `KECX_EXTERN_TEMPLATES`.
+    template void Extractor::extract<store::store_type, void>(
+        const std::string& file_path,
+        const store::store_type& store,
+        Stats& stats
+    ) const;
+    template void Extractor::extract<store::store_type, void>(
+        const std::string& file_path,
+        const store::store_type& store
+    ) const;
+    template void Extractor::extract<store::store_type, void>(
+        const std::vector<std::string>& file_paths,
+        const store::store_type& store,
+        Stats& stats
+    ) const;
+    template void Extractor::extract<store::store_type, void>(
+        const std::vector<std::string>& file_paths,
+        const store::store_type& store
+    ) const;
+    template void Extractor::extract<store::store_type, void>(
+        std::istream& input,
+        const store::store_type& store,
+        Stats& stats
+    ) const;
+    template void Extractor::extract<store::store_type, void>(
+        std::istream& input,
+        const store::store_type& store
+    ) const;
+    template void Extractor::extract_buffer<store::store_type, void>(
+        const char* data,
+        const std::size_t& n,
+        const store::store_type& store,
+        Stats& stats
+    ) const;
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    CompiledExtractor::CompiledExtractor(const Settings& settings) :
+        extractor_(new Extractor(settings))
+    {}
+
+    CompiledExtractor::CompiledExtractor(CompiledExtractor&& other) noexcept = default;
+
+    CompiledExtractor& CompiledExtractor::operator=(
+        CompiledExtractor&& other
+    ) noexcept = default;
+
+    CompiledExtractor::~CompiledExtractor() = default;
+
+    const Settings& CompiledExtractor::settings() const {
+        return(extractor_->settings());
+    }
+
+    void CompiledExtractor::set_engine(const Engine& engine) {
+        extractor_->set_engine(engine);
+    }
+
+    void CompiledExtractor::set_prefilter(const bool& prefilter) {
+        extractor_->set_prefilter(prefilter);
+    }
+
+    void CompiledExtractor::set_key_filter(const KeyFilter& key_filter) {
+        extractor_->set_key_filter(key_filter);
+    }
+
+    void CompiledExtractor::set_stop(const std::atomic<bool>* stop) {
+        extractor_->set_stop(stop);
+    }
+
+    void CompiledExtractor::set_max_line_length(const std::size_t& max_line_length) {
+        extractor_->set_max_line_length(max_line_length);
+    }
+
+    void CompiledExtractor::set_skip_binary(const bool& skip_binary) {
+        extractor_->set_skip_binary(skip_binary);
+    }
+
+    void CompiledExtractor::set_transforms(const transform::Pipeline& transforms) {
+        extractor_->set_transforms(transforms);
+    }
+
+    const Extractor& CompiledExtractor::extractor() const {
+        return(*extractor_);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    void CompiledExtractor::extract(
+        const std::string& file_path,
+        const store::store_type& store,
+        Stats& stats
+    ) const {
+        extractor_->extract(file_path, store, stats);
+    }
+
+    void CompiledExtractor::extract(
+        const std::string& file_path,
+        const store::store_type& store
+    ) const {
+        extractor_->extract(file_path, store);
+    }
+
+    void CompiledExtractor::extract(
+        const std::vector<std::string>& file_paths,
+        const store::store_type& store,
+        Stats& stats
+    ) const {
+        extractor_->extract(file_paths, store, stats);
+    }
+
+    void CompiledExtractor::extract(
+        const std::vector<std::string>& file_paths,
+        const store::store_type& store
+    ) const {
+        extractor_->extract(file_paths, store);
+    }
+
+    void CompiledExtractor::extract(
+        std::istream& input,
+        const store::store_type& store,
+        Stats& stats
+    ) const {
+        extractor_->extract(input, store, stats);
+    }
+
+    void CompiledExtractor::extract_buffer(
+        const char* data,
+        const std::size_t& n,
+        const store::store_type& store,
+        Stats& stats
+    ) const {
+        extractor_->extract_buffer(data, n, store, stats);
+    }
+
+    void CompiledExtractor::extract(
+        const std::string& file_path,
+        store::BlockStore& blocks,
+        Stats& stats
+    ) const {
+        extractor_->extract(file_path, blocks, stats);
+    }
+
+    void CompiledExtractor::extract(
+        std::istream& input,
+        store::BlockStore& blocks,
+        Stats& stats,
+        const std::string& file
+    ) const {
+        extractor_->extract(input, blocks, stats, file);
+    }
+
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+} // namespace extract
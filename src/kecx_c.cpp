@@ -0,0 +1,292 @@
+// C interface of kecx, see `./include/kecx/kecx.h`. Build as a shared
+// library with
+//
+//     g++ -std=c++17 -O2 -shared -fPIC -I./ src/kecx_c.cpp -o libkecx.so
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <new>
+
+#include "../include/kecx/kecx.h"
+#include "../include/kecx/kecx.hpp"
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+struct kecx_config {
+    kecx::extract::Settings settings;
+    std::unique_ptr<kecx::extract::Extractor> extractor;
+    std::mutex compile_mutex;
+};
+
+namespace {
+    thread_local std::string last_error;
+
+    // records are passed on once either limit is reached
+    const std::size_t batch_records = 4096;
+    const std::size_t batch_bytes = 1 << 20;
+
+    /**
+     * @brief
+     * Collects records into batches for a `kecx_callback`. Keys and lines
+     * are copied into one buffer; the views are made when a batch is
+     * passed on, as the buffer may move while it grows.
+    */
+    class Batcher {
+        private:
+            kecx_callback callback;
+            void* user_data;
+            std::string text;
+            std::vector<kecx_record> records;
+            // offsets into `text` of the keys and lines of `records`
+            std::vector<std::size_t> key_offsets;
+            std::vector<std::size_t> line_offsets;
+
+        public:
+            Batcher(kecx_callback callback, void* user_data) :
+                callback(callback),
+                user_data(user_data)
+            {}
+
+            void add(const std::string& key, const std::string& line, const int& line_no) {
+                key_offsets.push_back(text.size());
+                text += key;
+                line_offsets.push_back(text.size());
+                text += line;
+                records.push_back(
+                    kecx_record{nullptr, key.size(), nullptr, line.size(), line_no}
+                );
+                if (records.size() >= batch_records || text.size() >= batch_bytes) {
+                    flush();
+                }
+            }
+
+            void flush() {
+                if (records.size() == 0) {
+                    return;
+                }
+                for (std::size_t i = 0; i < records.size(); ++i) {
+                    records[i].key = text.data() + key_offsets[i];
+                    records[i].line = text.data() + line_offsets[i];
+                }
+                callback(user_data, records.data(), records.size());
+                text.clear();
+                records.clear();
+                key_offsets.clear();
+                line_offsets.clear();
+            }
+    };
+
+    int fail(const int& code, const std::string& message) {
+        last_error = message;
+        return(code);
+    }
+
+    /**
+     * @brief
+     * Run `f`, translating exceptions into return codes: no exception may
+     * cross the C interface.
+    */
+    template<typename F>
+    int guarded(const F& f) {
+        try {
+            last_error.clear();
+            f();
+            return(KECX_OK);
+        } catch (const keysets::KeyAlreadyActiveException& e) {
+            return(fail(KECX_ERROR_KEY, e.what()));
+        } catch (const keysets::KeyNotActiveException& e) {
+            return(fail(KECX_ERROR_KEY, e.what()));
+        } catch (const keysets::KeySetNotEmptyException& e) {
+            return(fail(KECX_ERROR_UNCLOSED_BLOCK, e.what()));
+        } catch (const std::invalid_argument& e) {
+            return(fail(KECX_ERROR_ARGUMENT, e.what()));
+        } catch (const std::regex_error& e) {
+            return(fail(KECX_ERROR_ARGUMENT, std::string("invalid regex: ") + e.what()));
+        } catch (const std::exception& e) {
+            return(fail(KECX_ERROR, e.what()));
+        } catch (...) {
+            return(fail(KECX_ERROR, "unknown error"));
+        }
+    }
+
+    const kecx::extract::Extractor& compiled(kecx_config* config) {
+        std::lock_guard<std::mutex> lock(config->compile_mutex);
+        if (!config->extractor) {
+            config->extractor.reset(new kecx::extract::Extractor(config->settings));
+        }
+        return(*config->extractor);
+    }
+
+    /**
+     * @brief
+     * Run `extract(extractor, store)` into batches for `callback`; records
+     * found before an error are passed on as well.
+    */
+    template<typename F>
+    int extract_batched(
+        kecx_config* config,
+        kecx_callback callback,
+        void* user_data,
+        const F& extract
+    ) {
+        if (config == nullptr || callback == nullptr) {
+            return(fail(KECX_ERROR_ARGUMENT, "config and callback must not be NULL"));
+        }
+        Batcher batcher(callback, user_data);
+        kecx::store::store_type store = [&batcher](
+            const std::string& key,
+            const std::string& line,
+            const int& line_no
+        ) -> void
+        {
+            batcher.add(key, line, line_no);
+        };
+        int code = guarded([&]() {
+            extract(compiled(config), store);
+        });
+        batcher.flush();
+        return(code);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+extern "C" {
+    int kecx_abi_version(void) {
+        return(KECX_ABI_VERSION);
+    }
+
+    const char* kecx_last_error(void) {
+        return(last_error.c_str());
+    }
+
+    kecx_config* kecx_config_new(void) {
+        kecx_config* config = new (std::nothrow) kecx_config();
+        if (config == nullptr) {
+            fail(KECX_ERROR, "out of memory");
+        }
+        return(config);
+    }
+
+    void kecx_config_free(kecx_config* config) {
+        delete config;
+    }
+
+    int kecx_config_set_comments(
+        kecx_config* config,
+        const char* multiline_comment_start,
+        const char* multiline_comment_stop,
+        const char* singleline_comment
+    ) {
+        if (config == nullptr) {
+            return(fail(KECX_ERROR_ARGUMENT, "config must not be NULL"));
+        }
+        return(guarded([&]() {
+            auto or_empty = [](const char* x) {
+                return(std::string(x != nullptr ? x : ""));
+            };
+            config->settings.multiline_comment_start = or_empty(multiline_comment_start);
+            config->settings.multiline_comment_stop = or_empty(multiline_comment_stop);
+            config->settings.singleline_comment = or_empty(singleline_comment);
+            config->extractor.reset();
+        }));
+    }
+
+    int kecx_config_add_tag(kecx_config* config, int kind, const char* tag) {
+        if (config == nullptr || tag == nullptr) {
+            return(fail(KECX_ERROR_ARGUMENT, "config and tag must not be NULL"));
+        }
+        kecx::extract::Settings& settings = config->settings;
+        std::vector<std::string>* tag_set = nullptr;
+        switch (kind) {
+            case KECX_TAG_HEADER_ONLY: tag_set = &settings.header_only_tag_set; break;
+            case KECX_TAG_HEADER: tag_set = &settings.header_tag_set; break;
+            case KECX_TAG_FOOTER: tag_set = &settings.footer_tag_set; break;
+            case KECX_TAG_EITHER: tag_set = &settings.either_tag_set; break;
+            default:
+                return(fail(KECX_ERROR_ARGUMENT, "unknown tag kind " + std::to_string(kind)));
+        }
+        return(guarded([&]() {
+            tag_set->push_back(tag);
+            config->extractor.reset();
+        }));
+    }
+
+    int kecx_config_set_store_only_comments(
+        kecx_config* config,
+        int kind,
+        int store_only_comments
+    ) {
+        if (config == nullptr) {
+            return(fail(KECX_ERROR_ARGUMENT, "config must not be NULL"));
+        }
+        kecx::extract::Settings& settings = config->settings;
+        switch (kind) {
+            case KECX_TAG_HEADER_ONLY:
+                settings.store_only_comments_ho = store_only_comments != 0;
+                break;
+            case KECX_TAG_HEADER:
+            case KECX_TAG_FOOTER:
+                settings.store_only_comments_hf = store_only_comments != 0;
+                break;
+            case KECX_TAG_EITHER:
+                settings.store_only_comments_e = store_only_comments != 0;
+                break;
+            default:
+                return(fail(KECX_ERROR_ARGUMENT, "unknown tag kind " + std::to_string(kind)));
+        }
+        config->extractor.reset();
+        last_error.clear();
+        return(KECX_OK);
+    }
+
+    int kecx_config_compile(kecx_config* config) {
+        if (config == nullptr) {
+            return(fail(KECX_ERROR_ARGUMENT, "config must not be NULL"));
+        }
+        return(guarded([&]() {
+            compiled(config);
+        }));
+    }
+
+    int kecx_extract_file(
+        kecx_config* config,
+        const char* file_path,
+        kecx_callback callback,
+        void* user_data
+    ) {
+        if (file_path == nullptr) {
+            return(fail(KECX_ERROR_ARGUMENT, "file_path must not be NULL"));
+        }
+        return(extract_batched(config, callback, user_data, [&](
+            const kecx::extract::Extractor& extractor,
+            const kecx::store::store_type& store
+        ) {
+            extractor.extract(std::string(file_path), store);
+        }));
+    }
+
+    int kecx_extract_buffer(
+        kecx_config* config,
+        const char* data,
+        size_t size,
+        kecx_callback callback,
+        void* user_data
+    ) {
+        if (data == nullptr && size > 0) {
+            return(fail(KECX_ERROR_ARGUMENT, "data must not be NULL"));
+        }
+        return(extract_batched(config, callback, user_data, [&](
+            const kecx::extract::Extractor& extractor,
+            const kecx::store::store_type& store
+        ) {
+            kecx::extract::Stats stats;
+            extractor.extract_buffer(data, size, store, stats);
+        }));
+    }
+}